@@ -52,12 +52,25 @@
 #ifdef AREQ_SUPPORT
 #include "happeningsActions.h"
 #endif
+#include "opcflags.h"
+#ifdef EVENT_MPH
+#include "eventmph.h"
+#endif
+#ifdef KEY_INDEX
+#include "keyindex.h"
+#endif
+#ifdef EVENT_RANGES
+#include "eventrange.h"
+#endif
+#if defined(EVENT_COMPACT) && defined(TIMED_RESPONSE)
+#include "timedResponse.h"
+#endif
 
 extern BOOL validateNV(BYTE NVindex, BYTE oldValue, BYTE newValue);
 extern void actUponNVchange(BYTE NVindex, BYTE oldValue, BYTE NVvalue);
-extern BYTE evtIdxToTableIndex(BYTE evtIdx);
-extern BYTE tableIndexToEvtIdx(BYTE tableIndex);
-extern BOOL validStart(BYTE tableIndex);
+extern EVENT_INDEX_T evtIdxToTableIndex(BYTE evtIdx);
+extern BYTE tableIndexToEvtIdx(EVENT_INDEX_T tableIndex);
+extern BOOL validStart(EVENT_INDEX_T tableIndex);
 
 extern void clearAllEvents(void);
 
@@ -101,6 +114,22 @@ const rom near BYTE * NvBytePtr = (const rom near BYTE*)AT_NV; //nodeVarTable.no
 BOOL	FLiMFlash;              // LED is flashing
 BOOL	FlashStatus;			// Control flash on/off of LED during FLiM setup etc
 BOOL    NV_changed;
+#ifdef TEACH_SESSION
+TickValue   teachSessionStart;
+TickValue   teachLastTime;          // Time of the last change in this session
+WORD        teachStartWrites;       // flashWriteCount at the start of the session
+WORD        teachStartErases;
+WORD        teachEvs;
+
+WORD        teachSessionEvs;
+WORD        teachSessionSeconds;
+WORD        teachSessionWrites;
+WORD        teachSessionErases;
+#endif
+#ifdef EVENT_COMPACT
+TickValue   compactTime;            // Time of the last compaction step
+TickValue   compactHoldTime;        // Time events were last read or taught by index
+#endif
 /**
  * FLimInit called during initialisation Initialises FLiM support which will 
  * also include support for events in SLiM and CBUS/CAN
@@ -133,6 +162,22 @@ void flimInit(void) {
  */
 void FLiMSWCheck( void )
 {
+#ifdef TEACH_SESSION
+    teachSessionPoll();
+#endif
+#ifdef EVENT_COMPACT
+    // tidy the event table a step at a time whilst it isn't being taught, nor
+    // being read by a tool which may still use the event indexes it was given
+    if (((flimState == fsFLiM) || (flimState == fsSLiM)) && (tickTimeSince(compactTime) > COMPACT_INTERVAL)
+#ifdef TIMED_RESPONSE
+            && (timedResponse == TIMED_RESPONSE_NONE)
+#endif
+            && (tickTimeSince(compactHoldTime) > COMPACT_QUIET_TIME)) 
+    {
+        compactTime.Val = tickGet();
+        compactStep();
+    }
+#endif
 
     switch (flimState)
     {
@@ -142,9 +187,6 @@ void FLiMSWCheck( void )
             {
                 prevFlimState = flimState;
                 flimState = fsPressed;
-                                       
-                cbusMsg[d1] = (nodeID >>8)&0xff;
-                cbusMsg[d2] = nodeID & 0xff;  
                 switchTime.Val = tickGet();
             }
             break;
@@ -271,10 +313,10 @@ void FLiMSWCheck( void )
  */
 void requestNodeNumber( void ) 
 {
-    BYTE local_cbusMsg[d0+3];
+    BYTE msg[CBUS_MSG_LEN];
 
     // send request node number packet
-    cbusSendOpcNN(ALL_CBUS, OPC_RQNN, -1, local_cbusMsg);
+    cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, OPC_RQNN, MY_NN, NULL));
     
 } // requestNodeNumber
 
@@ -286,8 +328,10 @@ void requestNodeNumber( void )
 void SLiMRevert(void) 
 
 {   
+    BYTE msg[CBUS_MSG_LEN];
+
     // send nn release packet
-    cbusSendOpcNN(ALL_CBUS, OPC_NNREL, -1, cbusMsg);
+    cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, OPC_NNREL, MY_NN, NULL));
     
 } // SLiMrevert
 
@@ -301,15 +345,28 @@ void SLiMRevert(void)
 BOOL parseCBUSMsg(BYTE *msg)                // Process the incoming message
 
 {
+    BYTE flags;
+
+#ifdef NUM_APP_HANDLERS
+    if (dispatchAppHandler(msg))
+        return TRUE;
+#endif
+    flags = getOpcFlags(msg[d0]);
     // check this is an EVENT
-    if (((msg[d0] & EVENT_SET_MASK) == EVENT_SET_MASK) && ((~msg[d0] & EVENT_CLR_MASK)== EVENT_CLR_MASK)) 
+    if (flags & OPF_EVENT) 
     {
 	// it is an event pass to the module's event processing
         return parseCbusEvent(msg);
     }
+#ifdef CBUS_LONG_MESSAGE
+    if (flags & OPF_STREAM)
+        return cbusLongRx(msg);
+#endif
     // FLiM processing doesn't process Events
     // Process the incoming (non-event) message
-    return( parseFLiMCmd(msg));
+    if (flags & OPF_FLIM)
+        return( parseFLiMCmd(msg));
+    return FALSE;
 }
 
 
@@ -327,9 +384,10 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
 #else
     overlay BOOL     cmdProcessed = FALSE;
 #endif
+    BYTE    flags = getOpcFlags(rx_ptr[d0]);
 
 
-    if (flimState == fsFLiMLearn) 
+    if ((flags & OPF_LEARN) && (flimState == fsFLiMLearn)) 
     {
         cmdProcessed = TRUE;
 
@@ -342,6 +400,12 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
         case OPC_NNULN:
             // Release node from learn mode
              flimState = fsFLiM;
+#ifdef TEACH_SESSION
+            teachSessionEnd();
+#endif
+#ifdef EVENT_MPH
+            mphBuild();     // teaching has finished so bring the event hash up to date
+#endif
             break;
             
         case OPC_NNCLR:
@@ -375,7 +439,7 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
         }
     } // in learn mode
 
-    if (!cmdProcessed && thisNN(rx_ptr)) 
+    if (!cmdProcessed && (flags & OPF_THISNN) && thisNN(rx_ptr)) 
     {   // process commands specifically addressed to us
         cmdProcessed = TRUE;
 
@@ -388,8 +452,12 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
                 
             case OPC_NNLRN:
                 // Put node into learn mode
-                if (flimState == fsFLiM)
+                if (flimState == fsFLiM) {
                     flimState = fsFLiMLearn;
+#ifdef TEACH_SESSION
+                    teachSessionBegin();
+#endif
+                }
                 break;
                 
               case OPC_NNEVN:
@@ -451,7 +519,7 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
         }
     } // this NN
 
-    if (!cmdProcessed) 
+    if (!cmdProcessed && (flags & OPF_GLOBAL)) 
     {   // Process any command not sent specifically to us that still needs action
         switch (rx_ptr[d0]) 
         {
@@ -485,7 +553,7 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
     // In setup mode, also check for FLiM commands not addressed to
     // any particular node
 
-    if	((!cmdProcessed) && (flimState == fsFLiMSetup)) 
+    if	((!cmdProcessed) && (flags & OPF_SETUP) && (flimState == fsFLiMSetup)) 
     {
         cmdProcessed = TRUE;
 
@@ -512,6 +580,23 @@ BOOL parseFLiMCmd(BYTE *rx_ptr)
             break;
         }
     }
+#ifdef EVENT_COMPACT
+    if (cmdProcessed) 
+    {
+        switch(rx_ptr[d0]) 
+        {
+            case OPC_NERD:
+            case OPC_NENRD:
+            case OPC_RQEVN:
+            case OPC_REVAL:
+            case OPC_REQEV:
+            case OPC_EVLRNI:
+                // event indexes are in use so keep the rows where they are for a while
+                compactHoldTime.Val = tickGet();
+                break;
+        }
+    }
+#endif
 
     return( cmdProcessed );
 } // parse_FLiM_cmd
@@ -542,14 +627,15 @@ BYTE getParFlags() {
 void QNNrespond(void) 
 {
     FLiMprmptr  paramptr;
+    BYTE        msg[CBUS_MSG_LEN];
+    BYTE        data[3];
 
     paramptr = (FLiMprmptr)&FLiMparams;
 
-    cbusMsg[d0] = OPC_PNN;
-    cbusMsg[d3] = paramptr->params.manufacturer;
-    cbusMsg[d4] = paramptr->params.module_id;
-    cbusMsg[d5] = getParFlags();
-    cbusSendMsgNN(ALL_CBUS, -1, cbusMsg);
+    data[0] = paramptr->params.manufacturer;
+    data[1] = paramptr->params.module_id;
+    data[2] = getParFlags();
+    cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, OPC_PNN, MY_NN, data));
 }
 
 /**
@@ -558,25 +644,26 @@ void QNNrespond(void)
 void doRqnpn(BYTE idx) 
 {
     FLiMprmptr  paramptr;
+    BYTE        msg[CBUS_MSG_LEN];
+    BYTE        data[2];
 
     paramptr = (FLiMprmptr)&FLiMparams;
 
     if (idx <= FCUparams.parameter_count) 
     {
-        cbusMsg[d0] = OPC_PARAN;
-        cbusMsg[d3] = idx;
+        data[0] = idx;
 
         if (idx == 0) 
-            cbusMsg[d4] = FCUparams.parameter_count;
+            data[1] = FCUparams.parameter_count;
         else if ((idx >= PAR_CPUMID) && (idx < PAR_CPUMAN)  ) 
-            cbusMsg[d4] = readCPUType() >> (( idx - PAR_CPUMID )*8);
+            data[1] = readCPUType() >> (( idx - PAR_CPUMID )*8);
         else 
-            cbusMsg[d4] = paramptr->bytes[idx-1];
+            data[1] = paramptr->bytes[idx-1];
 
         if ((idx == PAR_FLAGS) && (flimState == fsFLiM)) 
-            cbusMsg[d4] |= PF_FLiM;
+            data[1] |= PF_FLiM;
         
-    	cbusSendMsgNN(ALL_CBUS, -1, cbusMsg);
+    	cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, OPC_PARAN, MY_NN, data));
     }
     else 
     {
@@ -601,14 +688,16 @@ void doNvrd(BYTE NVindex)
     else 
     {
         WORD flashIndex;
+        BYTE msg[CBUS_MSG_LEN];
+        BYTE data[2];
+
         flashIndex = AT_NV;
         flashIndex += NVindex;
         
         // Get NV index and send response with value of NV
-        cbusMsg[d0] = OPC_NVANS;
-        cbusMsg[d3] = NVindex;
-        cbusMsg[d4] = readFlashBlock(flashIndex);
-        cbusSendMsgMyNN( 0, cbusMsg );
+        data[0] = NVindex;
+        data[1] = readFlashBlock(flashIndex);
+        cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_NVANS, MY_NN, data));
     }
 } // doNvrd
 
@@ -629,6 +718,7 @@ void doNvset(BYTE NVindex, BYTE NVvalue)
     {
         WORD flashIndex;
         BYTE oldValue;
+        BYTE msg[CBUS_MSG_LEN];
 
         // *NVPtr[--NVindex] = NVvalue; // Set value of node variable (NV counts from 1 in opcode, adjust index to count from zero)
 
@@ -639,11 +729,15 @@ void doNvset(BYTE NVindex, BYTE NVvalue)
         if (validateNV(NVindex, oldValue, NVvalue)) 
         {
             writeFlashByte((BYTE *)flashIndex, NVvalue);
+#ifdef TEACH_SESSION
+            // NVs are read directly from Flash so mustn't be left in the buffer
+            commitFlashImage();
+#endif
 #ifdef NV_CACHE
             loadNvCache();
 #endif
             actUponNVchange(NVindex, oldValue, NVvalue);
-            cbusSendOpcMyNN( 0, OPC_WRACK, cbusMsg);
+            cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_WRACK, MY_NN, NULL));
         } 
         else 
         {
@@ -663,20 +757,19 @@ void doRqnp(void)
 {
     FLiMprmptr  paramptr;
     BYTE        copyCounter;
+    BYTE        msg[CBUS_MSG_LEN];
 
     paramptr = (FLiMprmptr)&FLiMparams;
 
-    cbusMsg[d0] = OPC_PARAMS;
-
     for (copyCounter = d1; copyCounter <= d7; copyCounter++) 
     {
-        cbusMsg[copyCounter] = paramptr->bytes[copyCounter-d1];
+        msg[copyCounter] = paramptr->bytes[copyCounter-d1];
     }
     
     // update the dynamic flags
-    cbusMsg[d1+PAR_FLAGS-1] = getParFlags();
+    msg[d1+PAR_FLAGS-1] = getParFlags();
     
-    cbusSendMsg(0, cbusMsg);
+    cbusSendMsg(0, cbusMakeMsg(msg, OPC_PARAMS, NULL));
     
 } // doRqnp
 
@@ -687,6 +780,7 @@ void doRqnp(void)
 void doRqmn(void) 
 {
     BYTE        copyCounter, padCounter;
+    BYTE        msg[CBUS_MSG_LEN];
 #ifdef __XC8__
     char*   namptr;
 #else
@@ -704,13 +798,12 @@ void doRqmn(void)
 
     
     
-    cbusMsg[d0] = OPC_NAME;
     // This MUST be 7 characters. 
     for (copyCounter = 0; copyCounter < 7; copyCounter++ ) 
-      cbusMsg[copyCounter+d1] = *namptr++;
+      msg[copyCounter+d1] = *namptr++;
     // The source module_type_name string is now padded with spaces so no need to do it here.
     
-    cbusSendMsg( 0, cbusMsg );
+    cbusSendMsg( 0, cbusMakeMsg(msg, OPC_NAME, NULL));
     
 } // doRqmn
 
@@ -720,6 +813,7 @@ void doRqmn(void)
  */
 void doSnn( BYTE *rx_ptr ) 
 {
+    BYTE msg[CBUS_MSG_LEN];
     
     // Get new node number for FLiM
     nodeID = rx_ptr[d1];
@@ -733,7 +827,7 @@ void doSnn( BYTE *rx_ptr )
  
     // Acknowledge new node id
 
-    cbusSendOpcMyNN( 0, OPC_NNACK, cbusMsg );
+    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_NNACK, MY_NN, NULL));
     setFLiMLed();
     
 } // doSnn
@@ -745,9 +839,20 @@ void doSnn( BYTE *rx_ptr )
  */
 void doError(BYTE code) 
 {
-		cbusMsg[d0] = OPC_CMDERR;
-		cbusMsg[d3] = code;
-		cbusSendMsgNN(ALL_CBUS, -1, cbusMsg);
+    doErrorTo(ALL_CBUS, code);
+}
+
+/**
+ * Send a CBUS error message on one connection. Errors from the event teaching
+ * commands have always gone to connection 0 only.
+ * @param cbusNum the connection, or ALL_CBUS
+ * @param code the error code - see cbusdefs.h
+ */
+void doErrorTo(BYTE cbusNum, BYTE code) 
+{
+    BYTE msg[CBUS_MSG_LEN];
+
+    cbusSendMsg(cbusNum, cbusMakeMsgNN(msg, OPC_CMDERR, MY_NN, &code));
 }
 
 /**
@@ -770,10 +875,49 @@ BOOL thisNN( BYTE *rx_ptr)
  */
 void SaveNodeDetails(WORD nodeID, enum FLiMStates flimState)
 {
+#if defined(HASH_TABLE) || defined(EVENT_MPH) || defined(KEY_INDEX) || defined(EVENT_RANGES) || defined(EVENT_BLOOM) || defined(EVENT_CACHE)
+    WORD oldNN = ee_read_short((WORD)EE_NODE_ID);
+#endif
     ee_write_short((WORD)EE_NODE_ID, nodeID);
     ee_write((WORD)EE_FLIM_MODE, flimState);
 #ifdef HASH_TABLE
-    rebuildHashtable();
+    // Only the forceOwnNN events hash differently with a new NN
+    if (oldNN == 0xFFFF) {
+        rebuildHashtable();     // hash table was built with the default NN
+    } else if (oldNN != nodeID) {
+        rehashOwnEvents(oldNN);
+    }
+#endif
+#ifdef EVENT_MPH
+    if ((oldNN != nodeID) && hasOwnNNEvents()) {
+        // forceOwnNN events now have a different NN
+        mphInvalidate();
+        mphBuild();
+    }
+#endif
+#ifdef KEY_INDEX
+    if (oldNN != nodeID) {
+        // forceOwnNN events now have a different NN so sort differently
+        keyIndexRebuild();
+    }
+#endif
+#ifdef EVENT_RANGES
+    if (oldNN != nodeID) {
+        // ranges of forceOwnNN events now have a different NN
+        rangeInit();
+    }
+#endif
+#ifdef EVENT_BLOOM
+    if (oldNN != nodeID) {
+        // forceOwnNN events now have a different NN
+        bloomRebuild();
+    }
+#endif
+#ifdef EVENT_CACHE
+    if (oldNN != nodeID) {
+        // cached lookups of forceOwnNN events are by the old NN
+        eventCacheClear();
+    }
 #endif
 } // SaveNodeDetails
 
@@ -783,14 +927,15 @@ void SaveNodeDetails(WORD nodeID, enum FLiMStates flimState)
  */
 void doNnclr(void) 
 {
+    BYTE msg[CBUS_MSG_LEN];
+
     if (flimState == fsFLiMLearn) {
         clearAllEvents();
-        cbusSendOpcMyNN( 0, OPC_WRACK, cbusMsg);    // Ian added 2k
+        cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_WRACK, MY_NN, NULL));    // Ian added 2k
     }
     else 
     {
-            cbusMsg[d3] = CMDERR_NOT_LRN;
-            cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, CMDERR_NOT_LRN);
  	}
 } //doNnclr
 
@@ -806,11 +951,12 @@ void doNnclr(void)
 void doEvlrn(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal) 
 {
     unsigned char error;
+    BYTE msg[CBUS_MSG_LEN];
+
     // evNum starts at 1 - convert to zero based
     if (evNum == 0) 
     {
-        cbusMsg[d3] = CMDERR_INV_EV_IDX;
-        cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, CMDERR_INV_EV_IDX);
         return;
     }
     evNum--;    // convert CBUS numbering (starts at 1) to internal numbering)
@@ -818,11 +964,14 @@ void doEvlrn(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal)
     if (error) 
     {
         // failed to write
-        cbusMsg[d3] = error;
-        cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, error);
         return;
     }
-    cbusSendOpcMyNN( 0, OPC_WRACK, cbusMsg);
+#ifdef TEACH_SESSION
+    teachEvs++;
+    teachLastTime.Val = tickGet();
+#endif
+    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_WRACK, MY_NN, NULL));
     return;
 }
 
@@ -834,12 +983,13 @@ void doReval(BYTE enNum, BYTE evNum)
 	// Get event index and event variable number from message
 	// Send response with EV value
     BYTE evIndex;
-    BYTE tableIndex = evtIdxToTableIndex(enNum);
+    EVENT_INDEX_T tableIndex = evtIdxToTableIndex(enNum);
+    BYTE msg[CBUS_MSG_LEN];
+    BYTE data[3];
     
     if (evNum > EVperEVT)
     {
-        cbusMsg[d3] = CMDERR_INV_EV_IDX;
-        cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, CMDERR_INV_EV_IDX);
         return;
     }
     
@@ -859,18 +1009,16 @@ void doReval(BYTE enNum, BYTE evNum)
                 evVal = getEv(tableIndex, evIndex);
             }
             if (evVal >= 0) {
-                cbusMsg[d3] = enNum;
-                cbusMsg[d4] = evNum;
-                cbusMsg[d5] = evVal;
-                cbusSendOpcMyNN( 0, OPC_NEVAL, cbusMsg );
+                data[0] = enNum;
+                data[1] = evNum;
+                data[2] = evVal;
+                cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_NEVAL, MY_NN, data));
                 return;
             }
-            cbusMsg[d3] = -evVal;   // a negative value is the error code
-            cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+            doErrorTo(0, -evVal);   // a negative value is the error code
             return;
         }
-    cbusMsg[d3] = CMDERR_INVALID_EVENT;
-    cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+    doErrorTo(0, CMDERR_INVALID_EVENT);
 } // doReval
 
 /**
@@ -881,9 +1029,64 @@ void doReval(BYTE enNum, BYTE evNum)
 void doEvuln(WORD nodeNumber, WORD eventNumber) 
 {
     removeEvent(nodeNumber, eventNumber);
+#ifdef TEACH_SESSION
+    teachLastTime.Val = tickGet();
+#endif
     // Don't send a WRACK
 }
 
+#ifdef TEACH_SESSION
+/**
+ * Start a teach session when entering learn mode. Flash changes are kept in
+ * the write buffer so a burst of EVLRNs to the same block costs one write. 
+ * Lookups read through the same buffer so they see the taught values.
+ */
+void teachSessionBegin(void) 
+{
+    teachSessionStart.Val = tickGet();
+    teachLastTime.Val = teachSessionStart.Val;
+    teachStartWrites = flashWriteCount;
+    teachStartErases = flashEraseCount;
+    teachEvs = 0;
+    flashDeferred = TRUE;
+}
+
+/**
+ * End the teach session, writing anything still deferred to flash and
+ * recording the session statistics.
+ */
+void teachSessionEnd(void) 
+{
+    if ( ! flashDeferred) 
+        return;
+    flashDeferred = FALSE;
+    commitFlashImage();
+    teachSessionEvs = teachEvs;
+    teachSessionSeconds = tickTimeSince(teachSessionStart) / ONE_SECOND;
+    teachSessionWrites = flashWriteCount - teachStartWrites;
+    teachSessionErases = flashEraseCount - teachStartErases;
+}
+
+/**
+ * Called regularly from FLiMSWCheck. Writes the deferred block once teaching
+ * has paused so it is not left unwritten, and ends the session if learn mode
+ * was left other than by NNULN.
+ */
+void teachSessionPoll(void) 
+{
+    if ( ! flashDeferred) 
+        return;
+    if (flimState != fsFLiMLearn) 
+    {
+        teachSessionEnd();
+    } 
+    else if (tickTimeSince(teachLastTime) > TEACH_IDLE_TIME) 
+    {
+        commitFlashImage();     // does nothing if already written
+    }
+}
+#endif
+
 /**
  * Read an event variable by event id.
  * @param nodeNumber
@@ -893,24 +1096,24 @@ void doEvuln(WORD nodeNumber, WORD eventNumber)
 void doReqev(WORD nodeNumber, WORD eventNumber, BYTE evNum) 
 {
     int evVal;
+    BYTE msg[CBUS_MSG_LEN];
+    BYTE data[4];
     // get the event
-    unsigned char tableIndex = findEvent(nodeNumber, eventNumber);
+    EVENT_INDEX_T tableIndex = findEvent(nodeNumber, eventNumber);
     if (tableIndex == NO_INDEX) 
     {
-        cbusMsg[d3] = CMDERR_INVALID_EVENT;
-        cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, CMDERR_INVALID_EVENT);
         return;
     }
     if (evNum > EVperEVT)
     {
-        cbusMsg[d3] = CMDERR_INV_EV_IDX;
-        cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+        doErrorTo(0, CMDERR_INV_EV_IDX);
         return;
     }
 
-    cbusMsg[d3] = eventNumber >> 8;
-    cbusMsg[d4] = eventNumber & 0x00FF;
-    cbusMsg[d5] = evNum;
+    data[0] = eventNumber >> 8;
+    data[1] = eventNumber & 0x00FF;
+    data[2] = evNum;
     if (evNum == 0) 
     {
         evVal = numEv(tableIndex);
@@ -919,12 +1122,11 @@ void doReqev(WORD nodeNumber, WORD eventNumber, BYTE evNum)
         evVal = getEv(tableIndex, evNum);
     }
     if (evVal >= 0) {
-        cbusMsg[d6] = evVal;
-        cbusSendOpcMyNN( 0, OPC_EVANS, cbusMsg);
+        data[3] = evVal;
+        cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_EVANS, MY_NN, data));
         return;
     }
-    cbusMsg[d3] = -evVal;   // a negative value is the error code
-    cbusSendOpcMyNN( 0, OPC_CMDERR, cbusMsg);
+    doErrorTo(0, -evVal);   // a negative value is the error code
 }
 
 
@@ -68,6 +68,21 @@
 #define SET_TEST_MODE_TIME 8 * ONE_SECOND
 #define NEXT_TEST_TIME ONE_SECOND
 
+#ifdef TEACH_SESSION
+#ifndef TEACH_IDLE_TIME
+#define TEACH_IDLE_TIME 2 * ONE_SECOND      // Write a deferred flash block after this long without teaching
+#endif
+#endif
+
+#ifdef EVENT_COMPACT
+#ifndef COMPACT_INTERVAL
+#define COMPACT_INTERVAL ONE_SECOND / 4     // Time between event table compaction steps
+#endif
+#ifndef COMPACT_QUIET_TIME
+#define COMPACT_QUIET_TIME 30 * ONE_SECOND  // No compaction for this long after events are read or taught by index
+#endif
+#endif
+
 
 
 extern BYTE BlinkLED( BOOL blinkstatus );
@@ -146,7 +161,7 @@ typedef struct
  *  generic FLiM code access to the node variables table without requiring any knowledge
  *  of the structure of the node variables themselves. 
  */
-typedef	BYTE		NodeBytes[];
+typedef	BYTE		NodeBytes[sizeof(ModuleNvDefs)];
 typedef union {
         ModuleNvDefs    moduleNVs;
         NodeBytes   	nodevars;               // Do not change this as it is used by FLiM.c
@@ -241,6 +256,23 @@ BOOL parseCBUSMsg(BYTE *msg);
 
 BOOL 	parseFLiMCmd(BYTE *rx_ptr);
 
+#ifdef TEACH_SESSION
+// Teach sessions. Whilst in learn mode flash writes are deferred and committed 
+// when another flash block is needed, after TEACH_IDLE_TIME without teaching or
+// when learn mode is left.
+
+void    teachSessionBegin(void);
+void    teachSessionEnd(void);
+void    teachSessionPoll(void);
+
+// Diagnostic variables for the last completed teach session
+
+extern  WORD  teachSessionEvs;                  // EVs taught
+extern  WORD  teachSessionSeconds;              // Duration of the session
+extern  WORD  teachSessionWrites;               // Flash blocks written
+extern  WORD  teachSessionErases;               // Flash blocks erased
+#endif
+
 
 
 // Internal functions
@@ -255,6 +287,7 @@ void 	doRqnp(void);
 void    doRqmn(void);
 void 	doSnn( BYTE *rx_ptr );
 void	doError(BYTE code);
+void	doErrorTo(BYTE cbusNum, BYTE code);
 BOOL	thisNN( BYTE *rx_ptr);
 void    SaveNodeDetails(WORD Node_id, enum FLiMStates flimState);
 WORD    readCPUType( void );
@@ -47,11 +47,25 @@ events.h - Definitions for CBUS callbacks from library to application code - Par
 
 */
 
+#include "GenericTypeDefs.h"
+#include "eventindex.h"
 
 
 // Function prototypes for callbacks
 
-BOOL processEvent( BYTE eventIndex, BYTE *msg );
+BOOL processEvent( EVENT_INDEX_T eventIndex, BYTE *msg );
+
+#ifdef CBUS_LONG_MESSAGE
+// Called when a long message has been received, or reassembly failed with status other than LM_OK
+void longMessageReceived( BYTE streamID, BYTE *data, WORD len, BYTE status );
+// Called when all of a long message has been sent, the data buffer may then be reused
+void longMessageSent( BYTE streamID );
+#endif
+
+#if defined(CBUS_REPLAY) && defined(REPLAY_COST_CALLBACK)
+// Called after each replayed frame with the time parseCBUSMsg took for it in 16uS ticks
+void replayFrameCost( BYTE *msg, WORD ticks );
+#endif
 
 
 
@@ -55,6 +55,9 @@
 
 #include "can18.h"
 #include "cbus.h"
+#ifdef CBUS_CAPTURE
+#include "capture.h"
+#endif
 #include <string.h>
 #ifdef __18CXX
 #pragma udata CANTX_FIFO
@@ -103,8 +106,8 @@ static BYTE* _PointBuffer(BYTE b);
 void processEnumeration(void);
 BOOL checkIncomingPacket(CanPacket *ptr);
 BOOL insertIntoRxFifo( CanPacket *ptr );
+void canTXPrepare( CanPacket *msg );
 
-extern BYTE    cbusMsg[sizeof(CanPacket)];
 
 
 //*******************************************************************************
@@ -345,14 +348,10 @@ BOOL canSend(BYTE *msg, BYTE msgLen)
     
 }
 
-// Transmit a packet - DLC must be set to packet length but other fields are set by this routine
+// Fill in the header fields of a packet to be transmitted - DLC must already be set to packet length
 
-BOOL canTX( CanPacket *msg )
+void canTXPrepare( CanPacket *msg )
 {
-  BYTE* ptr;
-  BOOL  fullUp;
-  BYTE hiIndex;
-
   msg->buffer[con] = 0;
   msg->buffer[dlc] &= 0x0F;  // Ensure not RTR
   msg->buffer[sidh] = 0b10110000 | ((canID & 0x78) >>3);
@@ -360,6 +359,17 @@ BOOL canTX( CanPacket *msg )
 
   if (msg->buffer[dlc] > 8)
       msg->buffer[dlc] = 8;
+}
+
+// Transmit a packet - DLC must be set to packet length but other fields are set by this routine
+
+BOOL canTX( CanPacket *msg )
+{
+  BYTE* ptr;
+  BOOL  fullUp;
+  BYTE hiIndex;
+
+  canTXPrepare(msg);
 
 
   TXBnIE = 0;    // Disable transmit buffer interrupt whilst we fiddle with registers and fifo
@@ -402,11 +412,98 @@ BOOL canTX( CanPacket *msg )
   }
 
   TXBnIE = 1;  // Enable transmit buffer interrupt
+
+#ifdef CBUS_CAPTURE
+  if (!fullUp)
+      captureRecord(TRUE, msg);
+#endif
  
   return !fullUp;   // Return true for successfully submitted for transmission
 }
 
 
+// Transmit a number of packets - DLC of each must be set to packet length but other fields are set by this routine
+// As many as will fit are put into the transmit buffer and software fifo under a single critical section
+// Returns the number of packets accepted, so the caller can resume from there later
+
+BYTE canTXBatch( CanPacket *msgs, BYTE count )
+{
+  BYTE* ptr;
+  BYTE  accepted;
+  BYTE  hiIndex;
+
+  for (accepted = 0; accepted < count; accepted++)
+      canTXPrepare(&msgs[accepted]);
+
+  accepted = 0;
+
+  TXBnIE = 0;    // Disable transmit buffer interrupt whilst we fiddle with registers and fifo
+
+  if ((count > 0) && ((txIndexNextUsed == txIndexNextFree) || canTransmitFailed) && (!TXB0CONbits.TXREQ))  // check if software fifo empty and transmit buffer ready
+  {
+     ptr = (BYTE*) & TXB0CON;
+     memcpy(ptr, (void *) msgs[0].buffer, msgs[0].buffer[dlc] + 6);
+
+     larbRetryCount = LARB_RETRIES;
+     canTransmitTimeout.Val = tickGet();
+     canTransmitFailed = FALSE;
+
+     TXB0CONbits.TXREQ = 1;    // Initiate transmission
+     accepted = 1;
+  }
+
+  while ((accepted < count) && (txIndexNextFree != 0xFF))  // remainder into software fifo whilst there is room
+  {
+      memcpy( canTxFifo[txIndexNextFree].buffer, msgs[accepted].buffer, msgs[accepted].buffer[dlc] + 6);
+      accepted++;
+      txFifoUsage++;
+
+      if (++txIndexNextFree == CANTX_FIFO_LEN )
+          txIndexNextFree = 0;
+
+      if (txIndexNextUsed == txIndexNextFree) // check if fifo now full
+          txIndexNextFree = 0xFF; // mark as full
+  }
+
+  // Track buffer usage
+
+  if (txIndexNextFree == 0xFF)
+      hiIndex = CANTX_FIFO_LEN;
+  else
+      hiIndex = ( txIndexNextFree < txIndexNextUsed ? txIndexNextFree + CANTX_FIFO_LEN : txIndexNextFree) - txIndexNextUsed;
+  if (hiIndex > maxCanTxFifo )
+    maxCanTxFifo = hiIndex;
+
+  TXBnIE = 1;  // Enable transmit buffer interrupt
+
+#ifdef CBUS_CAPTURE
+  for (hiIndex = 0; hiIndex < accepted; hiIndex++)
+      captureRecord(TRUE, &msgs[hiIndex]);
+#endif
+
+  return accepted;
+}
+
+
+// Number of packets that canTX() or canTXBatch() will certainly accept, used so that a
+// message for all connections can be refused before any of them has been given it
+
+BYTE canTXFree( void )
+{
+  BYTE  room;
+
+  TXBnIE = 0;    // Stop the fifo being emptied whilst we look at it
+
+  if (txIndexNextFree == 0xFF)
+      room = 0;
+  else
+      room = CANTX_FIFO_LEN - (( txIndexNextFree < txIndexNextUsed ? txIndexNextFree + CANTX_FIFO_LEN : txIndexNextFree) - txIndexNextUsed);
+
+  TXBnIE = 1;
+  return room;
+}
+
+
 // Queue a packet into the receive buffer
 // This is used to queue outgoing events back into the rx buffer so that the module
 // can be taught its own events
@@ -552,6 +649,11 @@ BOOL canbusRecv(CanPacket *msg)
     }
 
     FIFOWMIE = 1; // Re-enable FIFO interrupts now out of critical section
+
+#ifdef CBUS_CAPTURE
+    if (msgFound)
+        captureRecord(FALSE, msg);
+#endif
     return msgFound;
 }
 
@@ -582,6 +684,28 @@ BOOL insertIntoRxFifo( CanPacket *ptr )
 } // Insert into RX FIFO
 
 
+#ifdef CBUS_LOADGEN
+// **********************************************************************************
+// Put a generated packet into the receive path as if it had come from the ECAN hardware
+// Used by the traffic generator for load testing
+
+void canInjectRx( CanPacket *msg )
+{
+    BYTE  hiIndex;
+
+    FIFOWMIE = 0;   // Disable high water mark interrupt so nothing will fiddle with FIFO
+
+    if (checkIncomingPacket(msg))
+        insertIntoRxFifo( msg );
+
+    hiIndex = ( rxIndexNextFree < rxIndexNextUsed ? rxIndexNextFree + CANRX_FIFO_LEN : rxIndexNextFree);
+    if ((hiIndex - rxIndexNextUsed) > maxCanRxFifo )
+        maxCanRxFifo = hiIndex - rxIndexNextUsed;
+
+    FIFOWMIE = 1;
+}
+#endif
+
 // **********************************************************************************
 // Called from isr when high water mark interrupt received
 // Clears ECAN fifo into software FIFO
@@ -676,7 +800,8 @@ void processEnumeration(void)
                 canID = newCanId;
                 setNewCanId(canID);
                 if (resultRequired) {
-                    cbusSendOpcMyNN( 0, OPC_NNACK, cbusMsg );   // this will get sent for all successful self enums but maybe only required for the ENUM command
+                    BYTE msg[CBUS_MSG_LEN];
+                    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_NNACK, MY_NN, NULL));   // this will get sent for all successful self enums but maybe only required for the ENUM command
                 }
             }
         }
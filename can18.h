@@ -157,9 +157,14 @@ void canInit(BYTE busNum, BYTE initCanID);
 BOOL setNewCanId( BYTE newCanId );
 BOOL canSend(BYTE *msg, BYTE msgLen);
 BOOL canTX( CanPacket *msg );
+BYTE canTXBatch( CanPacket *msgs, BYTE count );
+BYTE canTXFree( void );
 BOOL canQueueRx( CanPacket *msg );
 BOOL canbusRecv(CanPacket *msg);
 void canFillRxFifo(void);
+#ifdef CBUS_LOADGEN
+void canInjectRx( CanPacket *msg );
+#endif
 void checkTxFifo( void );
 void checkCANTimeout( void );
 void canTxError( void );
@@ -0,0 +1,340 @@
+/*
+
+ CBUS traffic capture and replay - part of CBUS libraries for PIC 18F
+ Records frames sent and received on CAN in a compact binary format and replays
+ a capture through the library's message processing.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Capture and replay. The format is described in capture.h.
+ * 
+ * Capture (CBUS_CAPTURE): canbusRecv() and canTX() call captureRecord() for 
+ * every frame received or accepted for sending. Records are encoded into a 
+ * RAM buffer from which the application collects them with captureRead(), 
+ * for example to send them over TCP or a serial port, so that nothing slow is 
+ * done in the CAN routines themselves.
+ * 
+ * Replay (CBUS_REPLAY): a capture held in program memory is played back by 
+ * calling replayPoll() from the main loop. Each received frame is passed to 
+ * parseCBUSMsg() when it falls due, at the captured rate, a multiple of it, 
+ * or as fast as possible. Transmitted frames are skipped, they are what the 
+ * library is expected to send in response. The time taken in parseCBUSMsg() 
+ * is measured for every frame to give the processing cost, as totals and, 
+ * with REPLAY_COST_CALLBACK, per frame through replayFrameCost().
+ */
+
+#include <string.h>
+#include "devincs.h"
+#include "module.h"
+#include "cbus.h"
+#include "FliM.h"
+#include "TickTime.h"
+#include "capture.h"
+#include "callbacks.h"
+
+#ifdef CBUS_CAPTURE
+
+extern BYTE canID;
+
+BYTE    captureBuf[CAPTURE_BUF_LEN];
+BYTE    captureIndexNextFree;
+BYTE    captureIndexNextUsed;
+BOOL    captureRunning = FALSE;
+DWORD   captureLastTime;
+
+WORD  captureFrames;
+BYTE  captureOflowCount;
+
+// Internal routine definitions
+
+BYTE captureSpace(void);
+void capturePut(BYTE b);
+
+/**
+ * Start capturing. The header is put into the buffer first.
+ * 
+ * @param bus the cbusNum of the interface being captured, recorded in the header
+ */
+void captureStart(BYTE bus)
+{
+    captureIndexNextFree = 0;
+    captureIndexNextUsed = 0;
+    captureFrames = 0;
+    captureOflowCount = 0;
+
+    capturePut('C');
+    capturePut('B');
+    capturePut('U');
+    capturePut('S');
+    capturePut(CAPTURE_VERSION);
+    capturePut(bus);
+    capturePut(nodeID >> 8);
+    capturePut(nodeID & 0xFF);
+    capturePut(canID);
+    capturePut(CAPTURE_TIME_UNIT);
+
+    captureLastTime = tickGet();
+    captureRunning = TRUE;
+}
+
+/**
+ * Stop capturing. Records already in the buffer can still be collected.
+ */
+void captureStop(void)
+{
+    captureRunning = FALSE;
+}
+
+/**
+ * Record a frame. Called by the CAN routines.
+ * If there is no room for the whole record it is dropped and counted, the 
+ * next record's delta then covers the missing time.
+ * 
+ * @param tx TRUE if the frame was sent by us, FALSE if received
+ * @param msg the frame
+ */
+void captureRecord(BOOL tx, CanPacket *msg)
+{
+    DWORD   now;
+    DWORD   delta;
+    BYTE    info;
+    BYTE    len;
+    BYTE    i;
+
+    if (!captureRunning)
+        return;
+
+    now = tickGet();
+    delta = (now - captureLastTime) / CAPTURE_TIME_UNIT;
+    len = msg->buffer[dlc] & CAPTURE_INFO_DLC;
+    if (len > 8)
+        len = 8;
+    info = len;
+    if (tx)
+        info |= CAPTURE_INFO_TX;
+    if (delta > 0xFF)
+        info |= CAPTURE_INFO_DELTA2;
+
+    if (captureSpace() < len + ((info & CAPTURE_INFO_DELTA2) ? 5 : 4))
+    {
+        captureOflowCount++;
+        return;
+    }
+
+    if (delta > 0xFFFF)
+    {
+        delta = 0xFFFF;
+        captureLastTime = now;
+    }
+    else    // Only move the time on by whole units actually recorded, so that rounding does not accumulate
+        captureLastTime += delta * CAPTURE_TIME_UNIT;
+
+    capturePut(info);
+    if (info & CAPTURE_INFO_DELTA2)
+        capturePut(delta >> 8);
+    capturePut(delta & 0xFF);
+    capturePut(msg->buffer[sidh]);
+    capturePut(msg->buffer[sidl]);
+    for (i=0; i<len; i++)
+        capturePut(msg->buffer[d0+i]);
+    captureFrames++;
+}
+
+/**
+ * Collect captured data.
+ * 
+ * @param dest where to put the data
+ * @param maxLen maximum number of bytes wanted
+ * @return number of bytes put in dest
+ */
+BYTE captureRead(BYTE *dest, BYTE maxLen)
+{
+    BYTE    count = 0;
+
+    while ((count < maxLen) && (captureIndexNextUsed != captureIndexNextFree))
+    {
+        dest[count++] = captureBuf[captureIndexNextUsed];
+        if (++captureIndexNextUsed >= CAPTURE_BUF_LEN)
+            captureIndexNextUsed = 0;
+    }
+    return count;
+}
+
+/**
+ * @return number of bytes free in the capture buffer
+ */
+BYTE captureSpace(void)
+{
+    if (captureIndexNextFree >= captureIndexNextUsed)
+        return CAPTURE_BUF_LEN - 1 - (captureIndexNextFree - captureIndexNextUsed);
+    return captureIndexNextUsed - captureIndexNextFree - 1;
+}
+
+void capturePut(BYTE b)
+{
+    captureBuf[captureIndexNextFree] = b;
+    if (++captureIndexNextFree >= CAPTURE_BUF_LEN)
+        captureIndexNextFree = 0;
+}
+
+#endif  // CBUS_CAPTURE
+
+
+#ifdef CBUS_REPLAY
+
+CaptureRomPtr   replayPtr;
+CaptureRomPtr   replayEnd;
+BYTE            replaySpeed;
+BYTE            replayTimeUnit;
+DWORD           replayDue;                      // Tick time the next record is due
+
+WORD  replayFrames;
+DWORD replayTicksTotal;
+WORD  replayTicksMax;
+BYTE  replayBadCount;
+
+/**
+ * Start replaying a capture.
+ * 
+ * @param capture the capture including its header, in program memory
+ * @param len length of the capture in bytes
+ * @param speed REPLAY_AFAP, REPLAY_REALTIME, or a multiple of real time
+ * @return TRUE if the header is valid and replay has started
+ */
+BOOL replayStart(CaptureRomPtr capture, WORD len, BYTE speed)
+{
+    replayPtr = replayEnd = capture;
+    if ((len < CAPTURE_HDR_LEN) || (capture[0] != 'C') || (capture[1] != 'B')
+            || (capture[2] != 'U') || (capture[3] != 'S') || (capture[4] != CAPTURE_VERSION))
+        return FALSE;
+
+    replayTimeUnit = capture[9];
+    replayPtr = capture + CAPTURE_HDR_LEN;
+    replayEnd = capture + len;
+    replaySpeed = speed;
+    replayDue = tickGet();
+    replayFrames = 0;
+    replayTicksTotal = 0;
+    replayTicksMax = 0;
+    replayBadCount = 0;
+    return TRUE;
+}
+
+/**
+ * Replay the next record if it is due. Call regularly from the main loop.
+ * At most one received frame is processed per call so the rest of the main 
+ * loop still runs during an as fast as possible replay.
+ * 
+ * @return TRUE whilst there is more of the capture to replay
+ */
+BOOL replayPoll(void)
+{
+    BYTE        info;
+    WORD        delta;
+    BYTE        len;
+    BYTE        hdrLen;
+    CanPacket   pkt;
+    DWORD       startTime;
+    WORD        ticks;
+
+    while (replayPtr < replayEnd)
+    {
+        info = replayPtr[0];
+        len = info & CAPTURE_INFO_DLC;
+        hdrLen = (info & CAPTURE_INFO_DELTA2) ? 3 : 2;
+        if (replayPtr + hdrLen + 2 + len > replayEnd)
+            break;                              // Truncated record
+
+        if (info & CAPTURE_INFO_DELTA2)
+            delta = ((WORD)replayPtr[1] << 8) + replayPtr[2];
+        else
+            delta = replayPtr[1];
+
+        if (replaySpeed != REPLAY_AFAP)
+        {
+            if ((long)(tickGet() - (replayDue + (DWORD)delta * replayTimeUnit / replaySpeed)) < 0)
+                return TRUE;                    // Not due yet
+            replayDue += (DWORD)delta * replayTimeUnit / replaySpeed;
+        }
+
+        replayPtr += hdrLen;
+
+        if (info & CAPTURE_INFO_TX)
+        {
+            replayPtr += 2 + len;
+            continue;
+        }
+        if (len > 8)
+        {
+            replayPtr += 2 + len;               // Corrupt, would overrun the packet buffer
+            replayBadCount++;
+            continue;
+        }
+
+        pkt.buffer[con] = 0;
+        pkt.buffer[sidh] = replayPtr[0];
+        pkt.buffer[sidl] = replayPtr[1];
+        pkt.buffer[eidh] = 0;
+        pkt.buffer[eidl] = 0;
+        pkt.buffer[dlc] = len;
+        memset(pkt.buffer+d0, 0, 8);
+        for (delta=0; delta<len; delta++)
+            pkt.buffer[d0+delta] = replayPtr[2+delta];
+        replayPtr += 2 + len;
+
+        startTime = tickGet();
+        parseCBUSMsg(pkt.buffer);
+        ticks = (WORD)(tickGet() - startTime);
+
+        replayFrames++;
+        replayTicksTotal += ticks;
+        if (ticks > replayTicksMax)
+            replayTicksMax = ticks;
+#ifdef REPLAY_COST_CALLBACK
+        replayFrameCost(pkt.buffer, ticks);
+#endif
+        return TRUE;
+    }
+    replayPtr = replayEnd;
+    return FALSE;
+}
+
+#endif  // CBUS_REPLAY
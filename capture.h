@@ -0,0 +1,129 @@
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+/*
+
+ capture.h - Definitions for CBUS traffic capture and replay - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+/*
+ * Capture format
+ * 
+ * A capture is a header followed by a sequence of records, one per frame, 
+ * in the order they were seen. All multi-byte values are big-endian.
+ * 
+ * Header (CAPTURE_HDR_LEN bytes):
+ *      'C' 'B' 'U' 'S'     magic
+ *      version             CAPTURE_VERSION
+ *      bus                 cbusNum of the interface captured
+ *      nodeID hi, lo       node number of the capturing module
+ *      canID               CANID of the capturing module
+ *      timeUnit            length of one delta time unit in 16uS ticks
+ * 
+ * Record (4 to 13 bytes):
+ *      info                bit 7 set for a frame we transmitted, clear for received
+ *                          bit 6 set if the delta time is 2 bytes, clear if 1 byte
+ *                          bits 3-0 number of data bytes (DLC)
+ *      delta               time since the previous record in timeUnits (1 or 2 bytes)
+ *      sidh, sidl          the standard CAN identifier bytes as in CanPacket
+ *      data                DLC bytes, d0 onwards
+ * 
+ * A DLC over 8 is never written, replay skips such records as corrupt.
+ * 
+ * Gaps longer than a 2 byte delta are recorded as the maximum delta, which 
+ * only shortens idle periods when replayed.
+ */
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "can18.h"
+
+#define CAPTURE_VERSION     1
+#define CAPTURE_HDR_LEN     10
+#define CAPTURE_TIME_UNIT   16                  // 16 ticks, 256uS per delta unit
+
+#define CAPTURE_INFO_TX     0x80
+#define CAPTURE_INFO_DELTA2 0x40
+#define CAPTURE_INFO_DLC    0x0F
+
+#ifdef CBUS_CAPTURE
+
+#ifndef CAPTURE_BUF_LEN
+#define CAPTURE_BUF_LEN     128                 // Encoded records waiting to be collected by captureRead
+#endif
+
+// Diagnostic variables for capture
+
+extern  WORD  captureFrames;                    // Records written
+extern  BYTE  captureOflowCount;                // Records lost because captureRead was not called often enough
+
+void captureStart(BYTE bus);
+void captureStop(void);
+void captureRecord(BOOL tx, CanPacket *msg);
+BYTE captureRead(BYTE *dest, BYTE maxLen);
+
+#endif  // CBUS_CAPTURE
+
+#ifdef CBUS_REPLAY
+
+#ifdef __XC8__
+typedef const BYTE *        CaptureRomPtr;
+#else
+typedef const rom BYTE *    CaptureRomPtr;
+#endif
+
+#define REPLAY_AFAP         0                   // Speed for replaying as fast as possible
+#define REPLAY_REALTIME     1                   // Speed for replaying at the rate captured
+
+// Diagnostic variables for replay, the processing cost is in 16uS ticks
+
+extern  WORD  replayFrames;                     // Received frames passed to parseCBUSMsg
+extern  DWORD replayTicksTotal;                 // Total time spent in parseCBUSMsg
+extern  WORD  replayTicksMax;                   // Longest time for one frame
+extern  BYTE  replayBadCount;                   // Records skipped because their DLC was over 8
+
+BOOL replayStart(CaptureRomPtr capture, WORD len, BYTE speed);
+BOOL replayPoll(void);
+
+#endif  // CBUS_REPLAY
+
+#endif	// __CAPTURE_H
@@ -51,6 +51,7 @@
  * Routines to support CBUS over CAN or MIWI.
  */
 
+#include <stddef.h>
 #include "can18.h"
 
 
@@ -58,9 +59,19 @@
 #include "cbus.h"
 #include "romops.h"
 #include "EEPROM.h"
+#ifdef LOOPBACK_DIRECT
+#include "events.h"
+#endif
+#ifdef NODE_CACHE
+#include "nodecache.h"
+#endif
+#ifdef CBUS_LONG_MESSAGE
+#include "TickTime.h"
+#include "callbacks.h"
+#endif
 
 WORD    nodeID;
-BYTE    cbusMsg[sizeof(CanPacket)]; // Global buffer for fast access to CBUS packets - do NOT use in ISRs as would not be re-entrant
+BYTE    cbusMsg[sizeof(CanPacket)]; // Global buffer kept for application code - not used by the library, which builds messages in caller owned buffers
 #ifndef __XC8__
 //#pragma code APP
 #endif
@@ -88,7 +99,19 @@ void cbusInit( WORD initNodeID  )
     #endif
 
     #if defined(CBUS_OVER_TCP)
-        //TODO Look at moving Ethernet MLA library init toh here for use with CANEther
+        tcpInit();  // Ethernet MLA stack must already have been initialised by the application
+    #endif
+
+    #if defined(CBUS_OVER_UART)
+        uartInit(UART_BAUD);   // After canInit, which works out clkMHz
+    #endif
+
+    #if defined(CBUS_LONG_MESSAGE)
+        lmInit();
+    #endif
+
+    #if defined(NODE_CACHE)
+        nodeCacheInit();
     #endif
 
 
@@ -104,12 +127,17 @@ void cbusInit( WORD initNodeID  )
  */
 BOOL cbusMsgReceived( BYTE cbusNum, BYTE *msg )
 {
+    BOOL    received = FALSE;
+
+#if defined(LOOPBACK_DIRECT)
+    loopbackDispatch();     // Consume any of our own events first
+#endif
 
 #if defined(CBUS_OVER_CAN)
     // No other processing at this level at the moment
     if (cbusNum == CBUS_OVER_CAN)
     {
-        return( canbusRecv( (CanPacket *) msg ));
+        received = canbusRecv( (CanPacket *) msg );
     }
 #endif
 
@@ -119,7 +147,77 @@ BOOL cbusMsgReceived( BYTE cbusNum, BYTE *msg )
         // Put Miwi receive stuff in here
     }
 #endif
-    return FALSE;
+
+#if defined(CBUS_OVER_TCP)
+    if (cbusNum == CBUS_OVER_TCP)
+    {
+        received = tcpRecv( (CanPacket *) msg );
+    }
+#endif
+
+#if defined(CBUS_OVER_UART)
+    if (cbusNum == CBUS_OVER_UART)
+    {
+        received = uartRecv( (CanPacket *) msg );
+    }
+#endif
+
+#if defined(NODE_CACHE)
+    if (received)
+        nodeCacheObserve(cbusNum, msg);     // Every received frame passes here, with its interface
+#endif
+    return received;
+}
+
+/**
+ * Build a CBUS message that does not start with a node number.
+ * The number of data bytes is worked out from the opcode. The buffer is owned by the 
+ * caller so this is re-entrant and may be used to prepare several messages at once.
+ * 
+ * @param msg buffer of at least CBUS_MSG_LEN bytes to build the message in
+ * @param opc the CBUS opcode
+ * @param data the data bytes to follow the opcode, or NULL if they are already in msg
+ * @return msg, so the result can be passed straight to cbusSendMsg
+ */
+BYTE *cbusMakeMsg(BYTE *msg, BYTE opc, BYTE *data)
+{
+    BYTE    i;
+
+    msg[d0] = opc;
+    if (data != NULL)
+    {
+        for (i=0; i<cbusDataLen(opc); i++)
+            msg[d1+i] = data[i];
+    }
+    return msg;
+}
+
+/**
+ * Build a CBUS message with a node number in the first two data bytes.
+ * The number of data bytes is worked out from the opcode.
+ * 
+ * @param msg buffer of at least CBUS_MSG_LEN bytes to build the message in
+ * @param opc the CBUS opcode
+ * @param Node_id the node number, or MY_NN for our own node number
+ * @param data the data bytes to follow the node number, or NULL if they are already in msg
+ * @return msg, so the result can be passed straight to cbusSendMsg
+ */
+BYTE *cbusMakeMsgNN(BYTE *msg, BYTE opc, WORD Node_id, BYTE *data)
+{
+    BYTE    i;
+
+    if (Node_id == MY_NN)
+        Node_id = nodeID;
+
+    msg[d0] = opc;
+    msg[d1] = Node_id >> 8;
+    msg[d2] = Node_id & 0xFF;
+    if ((data != NULL) && (cbusDataLen(opc) > 2))
+    {
+        for (i=0; i<cbusDataLen(opc)-2; i++)
+            msg[d3+i] = data[i];
+    }
+    return msg;
 }
 
 /**
@@ -131,8 +229,9 @@ BOOL cbusMsgReceived( BYTE cbusNum, BYTE *msg )
  */
 BOOL cbusSendSingleOpc(BYTE cbusNum, BYTE opc )
 {
-    cbusMsg[d0] = opc;
-    return cbusSendMsg(cbusNum, cbusMsg);
+    BYTE    msg[CBUS_MSG_LEN];
+
+    return cbusSendMsg(cbusNum, cbusMakeMsg(msg, opc, NULL));
 }
 
 
@@ -180,7 +279,7 @@ BOOL cbusSendOpcNN(BYTE cbusNum, BYTE opc, WORD nodeID, BYTE *msg)
  */
 BOOL cbusSendMyEvent( BYTE cbusNum, WORD eventNum, BOOL onEvent )
 {
-    BYTE    msg[d0+4];
+    BYTE    msg[CBUS_MSG_LEN];
 
     return cbusSendEventWithData( cbusNum, -1, eventNum, onEvent, msg, 0);
 }
@@ -197,7 +296,7 @@ BOOL cbusSendMyEvent( BYTE cbusNum, WORD eventNum, BOOL onEvent )
  */
 BOOL cbusSendEvent( BYTE cbusNum, WORD eventNode, WORD eventNum, BOOL onEvent )
 {
-    BYTE    msg[d0+4];
+    BYTE    msg[CBUS_MSG_LEN];
 
     return cbusSendEventWithData( cbusNum, eventNode, eventNum, onEvent, msg, 0);
 }
@@ -239,6 +338,9 @@ BOOL cbusSendEventWithData( BYTE cbusNum, WORD eventNode, WORD eventNum, BOOL on
 
     #if defined(CBUS_OVER_CAN)
         if ((cbusNum == CBUS_OVER_CAN) || (cbusNum == 0xFF) )
+        #if defined(LOOPBACK_DIRECT)
+            if (!loopbackEvent(msg))            // Only loop back events that we consume
+        #endif
             canQueueRx( (CanPacket*)msg );      // Queue event into receive buffer so module can be taught its own events
 
     #endif
@@ -269,7 +371,7 @@ BOOL cbusSendMsgMyNN(BYTE cbusNum, BYTE *msg)
  */
 BOOL cbusSendMsgNN(BYTE cbusNum, WORD eventNode, BYTE *msg)
 {
-    if (eventNode == -1)
+    if (eventNode == MY_NN)
         eventNode = nodeID; // Use node id for this module
 
     msg[d1] = eventNode>>8;
@@ -281,7 +383,9 @@ BOOL cbusSendMsgNN(BYTE cbusNum, WORD eventNode, BYTE *msg)
 /**
  * Send a CBUS message where data bytes have already been loaded
  * Works out data length from opcode
- * If cbusNum is set to 0xFF, transmits on all defined CBUS connections
+ * If cbusNum is set to 0xFF, transmits on all defined CBUS connections. It is
+ * then only sent once they all have room for it, so if FALSE is returned it
+ * hasn't been sent anywhere and can be retried without duplicating it.
  * 
  * @param cbusNum whether CAN or MIWI bus is to be checked.
  * @param msg the CBUS message to be sent
@@ -289,9 +393,14 @@ BOOL cbusSendMsgNN(BYTE cbusNum, WORD eventNode, BYTE *msg)
  */
 BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg)
 {
+    BOOL    ret = TRUE;
+
+    if ((cbusNum == 0xFF) && (cbusTxFree(cbusNum) == 0))
+        return FALSE;
+
     #if defined(CBUS_OVER_CAN)
         if ((cbusNum == CBUS_OVER_CAN) || (cbusNum == 0xFF) )
-            return canSend( msg, (msg[d0] >> 5)+1);	// data length from opcode
+            ret = canSend( msg, (msg[d0] >> 5)+1);	// data length from opcode
 
     #endif
 
@@ -302,7 +411,127 @@ BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg)
 
         }
     #endif
-        return TRUE;
+
+    #if defined(CBUS_OVER_TCP)
+        if ((cbusNum == CBUS_OVER_TCP) || (cbusNum == 0xFF) )
+            ret &= tcpSend( msg, (msg[d0] >> 5)+1);
+
+    #endif
+
+    #if defined(CBUS_OVER_UART)
+        if ((cbusNum == CBUS_OVER_UART) || (cbusNum == 0xFF) )
+            ret &= uartSend( msg, (msg[d0] >> 5)+1);
+
+    #endif
+        return ret;
+}
+
+
+/**
+ * How many messages every selected CBUS connection will accept. A message for
+ * ALL_CBUS is only given to the connections once they all have room, so that
+ * none of them sends it twice when the caller retries.
+ * 
+ * @param cbusNum the connection, or ALL_CBUS
+ * @return number of messages that will be accepted
+ */
+BYTE cbusTxFree(BYTE cbusNum)
+{
+    BYTE    room = 0xFF;
+    BYTE    n;
+
+    #if defined(CBUS_OVER_CAN)
+        if ((cbusNum == CBUS_OVER_CAN) || (cbusNum == 0xFF) )
+        {
+            n = canTXFree();
+            if (n < room)
+                room = n;
+        }
+    #endif
+
+    #if defined(CBUS_OVER_TCP)
+        if ((cbusNum == CBUS_OVER_TCP) || (cbusNum == 0xFF) )
+        {
+            n = tcpTxFree();
+            if (n < room)
+                room = n;
+        }
+    #endif
+
+    #if defined(CBUS_OVER_UART)
+        if ((cbusNum == CBUS_OVER_UART) || (cbusNum == 0xFF) )
+        {
+            n = uartTxFree();
+            if (n < room)
+                room = n;
+        }
+    #endif
+        return room;
+}
+
+
+/**
+ * Send a number of CBUS messages where the data bytes have already been loaded.
+ * As many as possible are queued in one go, rather than taking the transmit 
+ * critical section once per message. The return value tells the caller where 
+ * to resume from later, so it does not need to busy wait for space.
+ * If cbusNum is ALL_CBUS only as many messages as every connection has room for
+ * are queued, so those not accepted haven't been sent anywhere and those 
+ * accepted have been given to every connection.
+ * 
+ * @param cbusNum whether CAN or MIWI bus is to be used.
+ * @param msgs array of messages, each built with d0 onwards filled in
+ * @param count number of messages in the array
+ * @return the number of messages, from the start of the array, that were accepted
+ */
+BYTE cbusSendBatch(BYTE cbusNum, CanPacket *msgs, BYTE count)
+{
+    BYTE    accepted = count;
+    BYTE    i;
+
+    if (cbusNum == 0xFF)
+    {
+        accepted = cbusTxFree(cbusNum);
+        if (accepted > count)
+            accepted = count;
+        count = accepted;
+    }
+
+    for (i=0; i<count; i++)
+        msgs[i].buffer[dlc] = cbusDataLen(msgs[i].buffer[d0]) + 1;
+
+    #if defined(CBUS_OVER_CAN)
+        if ((cbusNum == CBUS_OVER_CAN) || (cbusNum == 0xFF) )
+            accepted = canTXBatch( msgs, count );
+
+    #endif
+
+    #if defined(CBUS_OVER_TCP)
+        if ((cbusNum == CBUS_OVER_TCP) || (cbusNum == 0xFF) )
+        {
+            for (i=0; i<accepted; i++)
+            {
+                if (!tcpSend( msgs[i].buffer, msgs[i].buffer[dlc]))
+                    break;
+            }
+            accepted = i;
+        }
+
+    #endif
+
+    #if defined(CBUS_OVER_UART)
+        if ((cbusNum == CBUS_OVER_UART) || (cbusNum == 0xFF) )
+        {
+            for (i=0; i<accepted; i++)
+            {
+                if (!uartSend( msgs[i].buffer, msgs[i].buffer[dlc]))
+                    break;
+            }
+            accepted = i;
+        }
+
+    #endif
+        return accepted;
 }
 
 
@@ -315,15 +544,9 @@ BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg)
  */
 void cbusSendDataEvent(BYTE cbusNum, WORD nodeID, BYTE *debug_data )
 {
-    BYTE msg[d7+1];
+    BYTE msg[CBUS_MSG_LEN];
 
-    msg[d0] = OPC_ACDAT;
-    msg[d3] = debug_data[0];
-    msg[d4] = debug_data[1];
-    msg[d5] = debug_data[2];
-    msg[d6] = debug_data[3];
-    msg[d7] = debug_data[4];
-    cbusSendMsgNN(cbusNum, nodeID, msg);
+    cbusSendMsg(cbusNum, cbusMakeMsgNN(msg, OPC_ACDAT, nodeID, debug_data));
 
     #if defined(CBUS_OVER_CAN)
         if ((cbusNum == CBUS_OVER_CAN) || (cbusNum == 0xFF) )
@@ -332,6 +555,278 @@ void cbusSendDataEvent(BYTE cbusNum, WORD nodeID, BYTE *debug_data )
     #endif
 }
 
+#ifdef CBUS_LONG_MESSAGE
+
+/*
+ * Long message (DTXC) streams.
+ * 
+ * Sending: cbusLongSend() takes a payload and stream ID and cbusLongPoll(), called 
+ * from the main loop, sends the header then a data packet at most every LM_TX_PACING 
+ * so that a long message does not monopolise the bus. A packet that cannot be sent 
+ * is tried again on the next poll. longMessageSent() is called when the last packet 
+ * has gone.
+ * 
+ * Receiving: parseCBUSMsg() passes DTXC packets to cbusLongRx(). Each stream being
+ * received has a slot with a bounded buffer. Packets must arrive in sequence, and a
+ * stream is abandoned if the gap between packets exceeds LM_RX_TIMEOUT.
+ * longMessageReceived() is called when the payload is complete and its CRC checked,
+ * or with an error status if the stream is abandoned.
+ */
+
+typedef struct {
+    BOOL        active;
+    BYTE        cbusNum;
+    BYTE        streamID;
+    BYTE        seq;
+    BYTE        *data;
+    WORD        len;
+    WORD        sent;
+    WORD        crc;
+    DWORD       lastTime;
+} LmTxStream;
+
+typedef struct {
+    BOOL        active;
+    BYTE        streamID;
+    BYTE        nextSeq;
+    WORD        len;
+    WORD        received;
+    WORD        crc;
+    DWORD       lastTime;
+    BYTE        buf[LM_RX_BUF_LEN];
+} LmRxStream;
+
+LmTxStream  lmTx[LM_TX_STREAMS];
+LmRxStream  lmRx[LM_RX_STREAMS];
+
+WORD  lmTxPackets;
+WORD  lmRxPackets;
+BYTE  lmRxErrors;
+BYTE  lmRxNoSlotCount;
+
+// Internal routine definitions
+
+WORD lmCrc(BYTE *data, WORD len);
+void lmRxEnd(LmRxStream *s, BYTE status);
+BYTE lmNextSeq(BYTE seq);
+
+/**
+ * Initialise long message streams, called from cbusInit().
+ */
+void lmInit(void)
+{
+    BYTE    i;
+
+    for (i=0; i<LM_TX_STREAMS; i++)
+        lmTx[i].active = FALSE;
+    for (i=0; i<LM_RX_STREAMS; i++)
+        lmRx[i].active = FALSE;
+    lmTxPackets = 0;
+    lmRxPackets = 0;
+    lmRxErrors = 0;
+    lmRxNoSlotCount = 0;
+}
+
+/**
+ * Start sending a long message.
+ * The data must not be changed until longMessageSent() has been called for the stream.
+ * 
+ * @param cbusNum the interface to send on, or ALL_CBUS
+ * @param streamID stream identifier, agreed with the receiving application
+ * @param data the payload
+ * @param len length of the payload
+ * @return TRUE if accepted, FALSE if all send streams are in use
+ */
+BOOL cbusLongSend(BYTE cbusNum, BYTE streamID, BYTE *data, WORD len)
+{
+    LmTxStream  *s;
+    BYTE        i;
+
+    for (i=0; i<LM_TX_STREAMS; i++)
+    {
+        s = &lmTx[i];
+        if (!s->active)
+        {
+            s->cbusNum = cbusNum;
+            s->streamID = streamID;
+            s->seq = 0;
+            s->data = data;
+            s->len = len;
+            s->sent = 0;
+            s->crc = lmCrc(data, len);
+            s->lastTime = tickGet() - LM_TX_PACING;   // Send header on the next poll
+            s->active = TRUE;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Process a received DTXC packet.
+ * 
+ * @param msg the received CBUS message
+ * @return TRUE as the packet has always been dealt with
+ */
+BOOL cbusLongRx(BYTE *msg)
+{
+    LmRxStream  *s = NULL;
+    LmRxStream  *freeSlot = NULL;
+    BYTE        i;
+    BYTE        count;
+
+    lmRxPackets++;
+    for (i=0; i<LM_RX_STREAMS; i++)
+    {
+        if (lmRx[i].active)
+        {
+            if (lmRx[i].streamID == msg[d1])
+                s = &lmRx[i];
+        }
+        else if (freeSlot == NULL)
+            freeSlot = &lmRx[i];
+    }
+
+    if (msg[d2] == 0)
+    {   // Header, starts a new stream or restarts one in progress
+        if (s != NULL)
+            lmRxEnd(s, LM_SEQ_ERROR);
+        else
+            s = freeSlot;
+        if (s == NULL)
+        {
+            lmRxNoSlotCount++;
+            return TRUE;
+        }
+        s->streamID = msg[d1];
+        s->len = ((WORD)msg[d3] << 8) + msg[d4];
+        s->crc = ((WORD)msg[d5] << 8) + msg[d6];
+        s->nextSeq = 1;
+        s->received = 0;
+        s->lastTime = tickGet();
+        s->active = TRUE;
+        if (s->len > LM_RX_BUF_LEN)
+            lmRxEnd(s, LM_TOO_LONG);
+        else if (s->len == 0)           // No data packets follow, so it is complete already
+            lmRxEnd(s, (lmCrc(s->buf, 0) == s->crc) ? LM_OK : LM_CRC_ERROR);
+        return TRUE;
+    }
+
+    if (s == NULL)
+        return TRUE;                    // Not a stream we are receiving, perhaps we missed the header
+
+    if (msg[d2] != s->nextSeq)
+    {
+        lmRxEnd(s, LM_SEQ_ERROR);
+        return TRUE;
+    }
+    s->nextSeq = lmNextSeq(s->nextSeq);
+    s->lastTime = tickGet();
+
+    count = s->len - s->received < LM_DATA_PER_PACKET ? s->len - s->received : LM_DATA_PER_PACKET;
+    for (i=0; i<count; i++)
+        s->buf[s->received++] = msg[d3+i];
+
+    if (s->received >= s->len)
+        lmRxEnd(s, (lmCrc(s->buf, s->len) == s->crc) ? LM_OK : LM_CRC_ERROR);
+    return TRUE;
+}
+
+/**
+ * Send the next packet of any long messages being sent and time out stalled
+ * receptions. Call regularly from the main loop.
+ */
+void cbusLongPoll(void)
+{
+    LmTxStream  *s;
+    BYTE        msg[CBUS_MSG_LEN];
+    BYTE        i, j;
+    BYTE        count;
+
+    for (i=0; i<LM_TX_STREAMS; i++)
+    {
+        s = &lmTx[i];
+        if (!s->active || (tickGet() - s->lastTime < LM_TX_PACING))
+            continue;
+
+        msg[d0] = OPC_DTXC;
+        msg[d1] = s->streamID;
+        msg[d2] = s->seq;
+        if (s->seq == 0)
+        {
+            msg[d3] = s->len >> 8;
+            msg[d4] = s->len & 0xFF;
+            msg[d5] = s->crc >> 8;
+            msg[d6] = s->crc & 0xFF;
+            msg[d7] = 0;                // Flags, none defined
+            count = 0;
+        }
+        else
+        {
+            count = s->len - s->sent < LM_DATA_PER_PACKET ? s->len - s->sent : LM_DATA_PER_PACKET;
+            for (j=0; j<LM_DATA_PER_PACKET; j++)
+                msg[d3+j] = j < count ? s->data[s->sent+j] : 0;
+        }
+
+        if (!cbusSendMsg(s->cbusNum, msg))
+            continue;                   // Try again next time
+
+        lmTxPackets++;
+        s->lastTime = tickGet();
+        s->sent += count;
+        s->seq = lmNextSeq(s->seq);
+        if (s->sent >= s->len)
+        {
+            s->active = FALSE;
+            longMessageSent(s->streamID);
+        }
+    }
+
+    for (i=0; i<LM_RX_STREAMS; i++)
+    {
+        if (lmRx[i].active && (tickGet() - lmRx[i].lastTime > LM_RX_TIMEOUT))
+            lmRxEnd(&lmRx[i], LM_TIMEOUT);
+    }
+}
+
+/**
+ * Finish with a stream being received, telling the application the outcome.
+ */
+void lmRxEnd(LmRxStream *s, BYTE status)
+{
+    s->active = FALSE;
+    if (status != LM_OK)
+        lmRxErrors++;
+    longMessageReceived(s->streamID, s->buf, s->received, status);
+}
+
+/**
+ * Next sequence number, 0 is only used for the header.
+ */
+BYTE lmNextSeq(BYTE seq)
+{
+    return (seq == 255) ? 1 : seq + 1;
+}
+
+/**
+ * CRC16 CCITT (XMODEM, polynomial 0x1021, initial value 0) of a payload.
+ */
+WORD lmCrc(BYTE *data, WORD len)
+{
+    WORD    crc = 0;
+    BYTE    i;
+
+    while (len--)
+    {
+        crc ^= (WORD)(*data++) << 8;
+        for (i=0; i<8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+#endif  // CBUS_LONG_MESSAGE
+
 		
 
 
@@ -59,10 +59,26 @@
     #include "cbus2miwi.h"
 #endif
 
+#if defined(CBUS_OVER_TCP)
+    #include "cbustcp.h"
+#endif
+
+#if defined(CBUS_OVER_UART)
+    #include "cbusuart.h"
+#endif
+
 #define ALL_CBUS    0xFF
+#define MY_NN       0xFFFF              // Pass as node number to use our own node number
+
+#define CBUS_MSG_LEN        sizeof(CanPacket)       // Size of buffer needed for a message, transports use the bytes before d0
+#define cbusDataLen(opc)    ((opc) >> 5)            // Number of data bytes following the opcode
 
 extern WORD    nodeID;
-extern BYTE    cbusMsg[sizeof(CanPacket)];
+extern BYTE    cbusMsg[sizeof(CanPacket)];          // Retained for applications, not used by the library
+
+
+BYTE *cbusMakeMsg(BYTE *msg, BYTE opc, BYTE *data);
+BYTE *cbusMakeMsgNN(BYTE *msg, BYTE opc, WORD Node_id, BYTE *data);
 
 
 void cbusInit( WORD initNodeID );
@@ -73,10 +89,58 @@ BOOL cbusSendOpcNN(BYTE cbusNum, BYTE opc, WORD Node_id, BYTE *msg);
 BOOL cbusSendMsgMyNN(BYTE cbusNum, BYTE *msg);
 BOOL cbusSendMsgNN(BYTE cbusNum, WORD Node_id, BYTE *msg);
 BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg);
+BYTE cbusSendBatch(BYTE cbusNum, CanPacket *msgs, BYTE count);
+BYTE cbusTxFree(BYTE cbusNum);
 BOOL cbusSendMyEvent( BYTE cbusNum, WORD eventNum, BOOL onEvent );
 BOOL cbusSendEvent( BYTE cbusNum, WORD eventNode, WORD eventNum, BOOL onEvent );
 BOOL cbusSendEventWithData( BYTE cbusNum, WORD eventNode, WORD eventNum, BOOL onEvent, BYTE *msg, BYTE datalen );
 void cbusSendDataEvent(BYTE cbusNum, WORD Node_id, BYTE *debug_data );
 
 
+#ifdef CBUS_LONG_MESSAGE
+
+// Long messages are sent as a stream of DTXC packets: a header packet with sequence 0
+// giving the length and CRC16 of the payload, then 5 payload bytes per packet with 
+// sequence numbers counting from 1 and wrapping from 255 back to 1.
+//
+// Reassembly memory is LM_RX_BUF_LEN + 13 bytes per stream, and send throughput is
+// 5 bytes every LM_TX_PACING.
+
+#ifndef LM_TX_STREAMS
+#define LM_TX_STREAMS       1                       // Streams that can be sent at once
+#endif
+#ifndef LM_RX_STREAMS
+#define LM_RX_STREAMS       2                       // Streams that can be received at once
+#endif
+#ifndef LM_RX_BUF_LEN
+#define LM_RX_BUF_LEN       64                      // Longest payload that can be received
+#endif
+#ifndef LM_TX_PACING
+#define LM_TX_PACING        FIVE_MILI_SECOND        // Minimum time between packets of a stream
+#endif
+#define LM_RX_TIMEOUT       HALF_SECOND             // Time allowed between packets before reassembly is abandoned
+#define LM_DATA_PER_PACKET  5
+
+// Long message reception status passed to longMessageReceived()
+#define LM_OK               0
+#define LM_CRC_ERROR        1
+#define LM_SEQ_ERROR        2
+#define LM_TIMEOUT          3
+#define LM_TOO_LONG         4
+
+// Diagnostic variables for long messages
+
+extern  WORD  lmTxPackets;
+extern  WORD  lmRxPackets;
+extern  BYTE  lmRxErrors;                           // Streams abandoned for any reason
+extern  BYTE  lmRxNoSlotCount;                      // Streams ignored because all reassembly slots were in use
+
+void lmInit(void);
+BOOL cbusLongSend(BYTE cbusNum, BYTE streamID, BYTE *data, WORD len);
+BOOL cbusLongRx(BYTE *msg);
+void cbusLongPoll(void);
+
+#endif  // CBUS_LONG_MESSAGE
+
+
 #endif
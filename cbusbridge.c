@@ -0,0 +1,336 @@
+/*
+
+ Bridge between two CBUS interfaces - part of CBUS libraries for PIC 18F
+ Forwards frames received on one interface to the other, so that a module can
+ join two CBUS segments, for example CAN and CBUS over TCP.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * CBUS bridge.
+ * 
+ * The application passes every frame it receives to bridgeFrame() along with the 
+ * interface it came in on, and calls bridgePoll() from its main loop. This keeps 
+ * the bridge independent of the application's own message processing, which can 
+ * continue as normal.
+ * 
+ * Each direction has its own filter and its own queue. A frame that passes the
+ * filter is copied into the queue for the other interface; bridgePoll() sends from 
+ * each queue until that interface refuses a frame, so a slow or blocked interface 
+ * only backs up its own queue and never holds up the other direction.
+ * 
+ * To stop frames circulating where the two segments are also joined some other way
+ * (a second bridge, or another route between CAN and the UART), or the far end 
+ * echoes what it is sent, a short cache of the frames recently forwarded is kept
+ * with the interface each arrived on. An identical frame arriving again on any
+ * interface within BRIDGE_DEDUP_TIME of being forwarded is dropped. This also 
+ * drops a node genuinely sending the same frame twice that quickly.
+ */
+
+#include <string.h>
+#include "devincs.h"
+#include "module.h"
+#include "cbus.h"
+#include "cbusbridge.h"
+#include "opcflags.h"
+#include "TickTime.h"
+
+#ifdef CBUS_BRIDGE
+
+#define BRIDGE_FRAME_LEN    8                   // Only d0 to d7 are stored in the queues
+
+typedef struct {
+    BYTE    frames[BRIDGE_QUEUE_LEN][BRIDGE_FRAME_LEN];
+    BYTE    indexNextFree;
+    BYTE    indexNextUsed;
+} BridgeQueue;
+
+typedef struct {
+    WORD    hash;
+    WORD    time;                               // Low word of tick count when received or sent
+    BYTE    cbusNum;                            // Interface it was received on, 0xFF if unused
+} BridgeDedup;
+
+BridgeFilter    bridgeFilter[2];
+BridgeQueue     bridgeQueue[2];
+BridgeDedup     bridgeDedup[BRIDGE_DEDUP_LEN];
+BYTE            bridgeDedupNext;
+
+WORD  bridgeFwdCount[2];
+WORD  bridgeFilteredCount[2];
+WORD  bridgeDupCount;
+BYTE  bridgeOflowCount[2];
+
+// Internal routine definitions
+
+BOOL bridgeFilterPass(BYTE direction, BYTE *msg);
+WORD bridgeHash(BYTE *msg);
+BridgeDedup *bridgeFindRecent(WORD hash);
+
+/**
+ * Initialise the bridge. 
+ * Both directions are set to forward everything.
+ */
+void bridgeInit(void)
+{
+    BYTE i;
+
+    for (i=0; i<2; i++)
+    {
+        bridgeSetFilter(i, BRC_ALL, 0, 0xFFFF);
+        bridgeFilter[i].numAllowed = 0;
+        bridgeQueue[i].indexNextFree = 0;
+        bridgeQueue[i].indexNextUsed = 0;
+        bridgeFwdCount[i] = 0;
+        bridgeFilteredCount[i] = 0;
+        bridgeOflowCount[i] = 0;
+    }
+    for (i=0; i<BRIDGE_DEDUP_LEN; i++)
+        bridgeDedup[i].cbusNum = 0xFF;
+    bridgeDedupNext = 0;
+    bridgeDupCount = 0;
+}
+
+/**
+ * Set the filter for one direction.
+ * 
+ * @param direction BRIDGE_A_TO_B or BRIDGE_B_TO_A
+ * @param classes the BRC_ opcode classes to be forwarded
+ * @param nnLow lowest long event node number forwarded
+ * @param nnHigh highest long event node number forwarded
+ */
+void bridgeSetFilter(BYTE direction, BYTE classes, WORD nnLow, WORD nnHigh)
+{
+    bridgeFilter[direction].classes = classes;
+    bridgeFilter[direction].nnLow = nnLow;
+    bridgeFilter[direction].nnHigh = nnHigh;
+}
+
+/**
+ * Add a long event to the allow list for one direction, so that it is forwarded
+ * even if its node number is outside the filter range.
+ * 
+ * @param direction BRIDGE_A_TO_B or BRIDGE_B_TO_A
+ * @param nn event node number
+ * @param en event number
+ * @return TRUE if added, FALSE if the allow list is full
+ */
+BOOL bridgeAllowEvent(BYTE direction, WORD nn, WORD en)
+{
+    BridgeFilter *f = &bridgeFilter[direction];
+
+    if (f->numAllowed >= BRIDGE_ALLOW_LEN)
+        return FALSE;
+    f->allowNN[f->numAllowed] = nn;
+    f->allowEN[f->numAllowed] = en;
+    f->numAllowed++;
+    return TRUE;
+}
+
+/**
+ * Offer a received frame to the bridge.
+ * If it passes the filter for its direction it is queued to be sent on the other 
+ * interface by bridgePoll().
+ * 
+ * @param cbusNum the interface the frame was received on
+ * @param msg the received CBUS message
+ * @return TRUE if the frame was queued to be forwarded
+ */
+BOOL bridgeFrame(BYTE cbusNum, BYTE *msg)
+{
+    BYTE        direction;
+    BridgeQueue *q;
+    BYTE        nextFree;
+    WORD        hash;
+    BridgeDedup *d;
+
+    if (cbusNum == BRIDGE_IF_A)
+        direction = BRIDGE_A_TO_B;
+    else if (cbusNum == BRIDGE_IF_B)
+        direction = BRIDGE_B_TO_A;
+    else
+        return FALSE;
+
+    hash = bridgeHash(msg);
+    if (bridgeFindRecent(hash) != NULL)
+    {
+        bridgeDupCount++;
+        return FALSE;
+    }
+    if (!bridgeFilterPass(direction, msg))
+    {
+        bridgeFilteredCount[direction]++;
+        return FALSE;
+    }
+
+    q = &bridgeQueue[direction];
+    nextFree = q->indexNextFree + 1;
+    if (nextFree >= BRIDGE_QUEUE_LEN)
+        nextFree = 0;
+    if (nextFree == q->indexNextUsed)
+    {
+        bridgeOflowCount[direction]++;
+        return FALSE;
+    }
+    memcpy(q->frames[q->indexNextFree], msg+d0, BRIDGE_FRAME_LEN);
+    q->indexNextFree = nextFree;
+
+    d = &bridgeDedup[bridgeDedupNext];
+    d->hash = hash;
+    d->time = (WORD)tickGet();
+    d->cbusNum = cbusNum;
+    if (++bridgeDedupNext >= BRIDGE_DEDUP_LEN)
+        bridgeDedupNext = 0;
+    return TRUE;
+}
+
+/**
+ * Send queued frames. Call regularly from the main loop.
+ * Each queue is drained until it is empty or its interface cannot take any more,
+ * in which case the frame is left at the head of the queue to be tried next time.
+ */
+void bridgePoll(void)
+{
+    BYTE        direction;
+    BYTE        cbusNum;
+    BridgeQueue *q;
+    BYTE        msg[CBUS_MSG_LEN];
+    BridgeDedup *d;
+
+    for (direction=0; direction<2; direction++)
+    {
+        q = &bridgeQueue[direction];
+        cbusNum = (direction == BRIDGE_A_TO_B) ? BRIDGE_IF_B : BRIDGE_IF_A;
+
+        while (q->indexNextUsed != q->indexNextFree)
+        {
+            memcpy(msg+d0, q->frames[q->indexNextUsed], BRIDGE_FRAME_LEN);
+            if (!cbusSendMsg(cbusNum, msg))
+                break;
+
+            // Time any loop from when it actually went out
+            d = bridgeFindRecent(bridgeHash(msg));
+            if (d != NULL)
+                d->time = (WORD)tickGet();
+
+            bridgeFwdCount[direction]++;
+            if (++q->indexNextUsed >= BRIDGE_QUEUE_LEN)
+                q->indexNextUsed = 0;
+        }
+    }
+}
+
+/**
+ * Check a frame against the filter for its direction.
+ * 
+ * @param direction BRIDGE_A_TO_B or BRIDGE_B_TO_A
+ * @param msg the CBUS message
+ * @return TRUE if the frame should be forwarded
+ */
+BOOL bridgeFilterPass(BYTE direction, BYTE *msg)
+{
+    BridgeFilter    *f = &bridgeFilter[direction];
+    BYTE            flags = getOpcFlags(msg[d0]);
+    WORD            nn, en;
+    BYTE            i;
+
+    if (flags & OPF_EVENT)
+    {
+        if (!(f->classes & BRC_EVENT))
+            return FALSE;
+        if (msg[d0] & EVENT_SHORT_MASK)
+            return TRUE;                        // Short events have no meaningful node number to filter on
+
+        nn = ((WORD)msg[d1] << 8) + msg[d2];
+        if ((nn >= f->nnLow) && (nn <= f->nnHigh))
+            return TRUE;
+
+        en = ((WORD)msg[d3] << 8) + msg[d4];
+        for (i=0; i<f->numAllowed; i++)
+        {
+            if ((f->allowNN[i] == nn) && (f->allowEN[i] == en))
+                return TRUE;
+        }
+        return FALSE;
+    }
+    if (flags & OPF_FLIM)
+        return (f->classes & BRC_NODE) != 0;
+    return (f->classes & BRC_OTHER) != 0;
+}
+
+/**
+ * Hash the opcode and data bytes of a frame for the loop detection cache.
+ * 
+ * @param msg the CBUS message
+ * @return 16 bit hash
+ */
+WORD bridgeHash(BYTE *msg)
+{
+    WORD    hash = 0;
+    BYTE    i;
+
+    for (i=0; i<=cbusDataLen(msg[d0]); i++)
+        hash = ((hash << 5) | (hash >> 11)) ^ msg[d0+i];
+    return hash;
+}
+
+/**
+ * Look for a frame forwarded within the last BRIDGE_DEDUP_TIME, whichever 
+ * interface it came from. A repeat of it arriving on any interface is an echo 
+ * or has come round a loop.
+ * 
+ * @param hash hash of the frame
+ * @return the cache entry, or NULL if it hasn't been forwarded recently
+ */
+BridgeDedup *bridgeFindRecent(WORD hash)
+{
+    WORD    now = (WORD)tickGet();
+    BYTE    i;
+
+    for (i=0; i<BRIDGE_DEDUP_LEN; i++)
+    {
+        if ((bridgeDedup[i].cbusNum != 0xFF) && (bridgeDedup[i].hash == hash)
+                && ((WORD)(now - bridgeDedup[i].time) < BRIDGE_DEDUP_TIME))
+            return &bridgeDedup[i];
+    }
+    return NULL;
+}
+
+#endif  // CBUS_BRIDGE
@@ -0,0 +1,114 @@
+#ifndef __CBUSBRIDGE_H
+#define __CBUSBRIDGE_H
+
+/*
+
+ cbusbridge.h - Definitions for forwarding frames between two CBUS interfaces - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "cbus.h"
+
+#ifdef CBUS_BRIDGE
+
+// The two interfaces joined by the bridge, as cbusNum values. The default is
+// the CAN and TCP interfaces of a CANEther type module.
+#ifndef BRIDGE_IF_A
+#define BRIDGE_IF_A         CBUS_OVER_CAN
+#endif
+#ifndef BRIDGE_IF_B
+#define BRIDGE_IF_B         CBUS_OVER_TCP
+#endif
+
+// Directions, used to index the filters, queues and counters
+#define BRIDGE_A_TO_B       0
+#define BRIDGE_B_TO_A       1
+
+#ifndef BRIDGE_QUEUE_LEN
+#define BRIDGE_QUEUE_LEN    8                   // Frames waiting to be sent in each direction
+#endif
+#ifndef BRIDGE_ALLOW_LEN
+#define BRIDGE_ALLOW_LEN    4                   // Entries in each direction's event allow list
+#endif
+#define BRIDGE_DEDUP_LEN    8                   // Recently forwarded frames remembered for loop detection
+#define BRIDGE_DEDUP_TIME   HUNDRED_MILI_SECOND // How long a forwarded frame is remembered
+
+// Opcode classes for the filters
+#define BRC_EVENT           0x01                // Accessory events
+#define BRC_NODE            0x02                // Node configuration commands handled by FLiM
+#define BRC_OTHER           0x04                // Everything else eg. DCC and responses
+#define BRC_ALL             (BRC_EVENT | BRC_NODE | BRC_OTHER)
+
+/*
+ * Filter for one direction. A frame is forwarded if its opcode class is in
+ * classes. Long events must also either have a node number within nnLow..nnHigh
+ * or match an entry in the allow list, so setting nnLow > nnHigh keeps all long
+ * events local apart from those in the allow list.
+ */
+typedef struct {
+    BYTE    classes;
+    WORD    nnLow;
+    WORD    nnHigh;
+    BYTE    numAllowed;
+    WORD    allowNN[BRIDGE_ALLOW_LEN];
+    WORD    allowEN[BRIDGE_ALLOW_LEN];
+} BridgeFilter;
+
+extern BridgeFilter bridgeFilter[2];
+
+// Diagnostic variables for bridge performance
+
+extern  WORD  bridgeFwdCount[2];                // Frames sent on, per direction
+extern  WORD  bridgeFilteredCount[2];           // Frames kept local by the filter
+extern  WORD  bridgeDupCount;                   // Frames dropped as loops
+extern  BYTE  bridgeOflowCount[2];              // Frames dropped because the queue was full
+
+void bridgeInit(void);
+void bridgeSetFilter(BYTE direction, BYTE classes, WORD nnLow, WORD nnHigh);
+BOOL bridgeAllowEvent(BYTE direction, WORD nn, WORD en);
+BOOL bridgeFrame(BYTE cbusNum, BYTE *msg);
+void bridgePoll(void);
+
+#endif  // CBUS_BRIDGE
+
+#endif	// __CBUSBRIDGE_H
@@ -62,6 +62,9 @@
 #elif defined(CANEther)
     #define CBUS_OVER_CAN    0
     #define CBUS_OVER_TCP    1
+#elif defined(CANSERIAL)
+    #define CBUS_OVER_CAN    0
+    #define CBUS_OVER_UART   1
 #else
     #define CBUS_OVER_CAN    0
 #endif
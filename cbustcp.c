@@ -0,0 +1,275 @@
+/*
+
+ CBUS over TCP transport - part of CBUS libraries for PIC 18F
+ Carries CBUS frames as GridConnect ASCII over a TCP connection, for use with CANEther
+ and similar Ethernet connected modules.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * CBUS over TCP.
+ * 
+ * Uses the Microchip MLA TCP/IP stack, which must have been initialised by the
+ * application before cbusInit() is called. The application must also call 
+ * StackTask() regularly from its main loop as usual.
+ * 
+ * Transmit: frames are converted to GridConnect text and appended to a batch buffer.
+ * Rather than send one TCP segment per frame, the batch is sent when it is full, 
+ * when the oldest frame in it has waited TCP_FLUSH_TIME, or when the main loop polls
+ * for received messages and nothing has been sent since the previous poll (ie. we are idle).
+ * 
+ * Receive: the byte stream is read in chunks and fed to the GridConnect decoder, so
+ * frames may be split across any number of TCP segments. Each frame is decoded directly
+ * into a slot of a small receive FIFO so nothing is allocated or copied per frame until
+ * cbusMsgReceived collects it.
+ */
+
+#include <string.h>
+#include "devincs.h"
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "cbus.h"
+#include "cbustcp.h"
+#include "gridconnect.h"
+#include "TCPIP Stack/TCPIP.h"
+
+#if defined(CBUS_OVER_TCP)
+
+#if defined(CBUS_OVER_CAN)
+extern BYTE canID;
+#define tcpCanId    canID
+#else
+#define tcpCanId    DEFAULT_CANID
+#endif
+
+TCP_SOCKET  tcpSocket;
+
+BYTE        tcpTxBatch[TCP_TX_BATCH_LEN];
+BYTE        tcpTxBatchLen;
+TickValue   tcpTxBatchTime;         // When the first frame was put into the batch
+BOOL        tcpTxSincePoll;         // Frames have been added since we last polled
+
+CanPacket   tcpRxFifo[TCP_RX_FIFO_LEN];
+BYTE        tcpRxIndexNextFree;
+BYTE        tcpRxIndexNextUsed;
+BYTE        tcpRxChunk[TCP_RX_CHUNK_LEN];
+GcDecoder   tcpDecoder;
+
+WORD  tcpTxFrames;
+WORD  tcpRxFrames;
+WORD  tcpTxSegments;
+BYTE  tcpRxOflowCount;
+
+// Internal routine definitions
+
+void tcpFrameDone(void);
+
+/**
+ * Initialise CBUS over TCP and open the listening socket.
+ */
+void tcpInit(void)
+{
+    tcpTxBatchLen = 0;
+    tcpTxSincePoll = FALSE;
+    tcpRxIndexNextFree = 0;
+    tcpRxIndexNextUsed = 0;
+    gcDecoderInit(&tcpDecoder);
+    tcpTxFrames = 0;
+    tcpRxFrames = 0;
+    tcpTxSegments = 0;
+    tcpRxOflowCount = 0;
+
+    tcpSocket = TCPOpen(0, TCP_OPEN_SERVER, CBUS_TCP_PORT, TCP_PURPOSE_GENERIC_TCP_SERVER);
+}
+
+
+/**
+ * Queue a CBUS message for sending over TCP.
+ * The message is converted to GridConnect and added to the transmit batch, which 
+ * is sent first if there is not room for another frame.
+ * 
+ * @param msg the CBUS message with data from d0
+ * @param msgLen number of data bytes
+ * @return TRUE if the message was accepted, FALSE if the socket cannot take any more yet
+ */
+BOOL tcpSend(BYTE *msg, BYTE msgLen)
+{
+    if ((tcpSocket == INVALID_SOCKET) || !TCPIsConnected(tcpSocket))
+    {
+        tcpTxBatchLen = 0;          // Nobody to send to, so discard anything pending
+        return TRUE;
+    }
+
+    if (tcpTxBatchLen > TCP_TX_BATCH_LEN - GC_MAX_FRAME_LEN)
+    {
+        tcpFlush();
+        if (tcpTxBatchLen != 0)
+            return FALSE;           // TCP stack has no room, caller can retry later
+    }
+
+    if (tcpTxBatchLen == 0)
+        tcpTxBatchTime.Val = tickGet();
+
+    msg[dlc] = msgLen;
+    msg[sidh] = 0b10110000 | ((tcpCanId & 0x78) >>3);
+    msg[sidl] = (tcpCanId & 0x07) << 5;
+
+    tcpTxBatchLen += gcEncodeFrame(tcpTxBatch + tcpTxBatchLen, (CanPacket *)msg);
+    tcpTxSincePoll = TRUE;
+    tcpTxFrames++;
+    return TRUE;
+}
+
+
+/**
+ * How many messages tcpSend() will certainly accept. If the batch is full it is
+ * sent first to make room.
+ * 
+ * @return number of messages, 0xFF if not connected as they are then discarded
+ */
+BYTE tcpTxFree(void)
+{
+    if ((tcpSocket == INVALID_SOCKET) || !TCPIsConnected(tcpSocket))
+        return 0xFF;
+
+    if (tcpTxBatchLen > TCP_TX_BATCH_LEN - GC_MAX_FRAME_LEN)
+        tcpFlush();
+
+    return (TCP_TX_BATCH_LEN - tcpTxBatchLen) / GC_MAX_FRAME_LEN;
+}
+
+
+/**
+ * Send the transmit batch as a single TCP segment, if the stack has room for it.
+ */
+void tcpFlush(void)
+{
+    if (tcpTxBatchLen == 0)
+        return;
+
+    if (TCPIsPutReady(tcpSocket) >= tcpTxBatchLen)
+    {
+        TCPPutArray(tcpSocket, tcpTxBatch, tcpTxBatchLen);
+        TCPFlush(tcpSocket);
+        tcpTxBatchLen = 0;
+        tcpTxSegments++;
+    }
+}
+
+
+/**
+ * Check for a CBUS message received over TCP. Called via cbusMsgReceived from the 
+ * main loop, this also sends the transmit batch if it is due.
+ * 
+ * @param msg buffer for the received message
+ * @return TRUE if a message has been placed in msg
+ */
+BOOL tcpRecv(CanPacket *msg)
+{
+    WORD    avail;
+    BYTE    i, used;
+
+    if (tcpSocket == INVALID_SOCKET)
+        return FALSE;
+
+    // Send any batched frames if they have waited long enough or we have gone idle
+
+    if ((tcpTxBatchLen != 0) && (!tcpTxSincePoll || (tickTimeSince(tcpTxBatchTime) > TCP_FLUSH_TIME)))
+        tcpFlush();
+
+    tcpTxSincePoll = FALSE;
+
+    // Only read more from the socket once we have delivered what we already have
+
+    if (tcpRxIndexNextUsed == tcpRxIndexNextFree)
+    {
+        avail = TCPIsGetReady(tcpSocket);
+        if (avail > TCP_RX_CHUNK_LEN)
+            avail = TCP_RX_CHUNK_LEN;
+
+        if (avail != 0)
+        {
+            avail = TCPGetArray(tcpSocket, tcpRxChunk, avail);
+            for (i=0; i<avail; i+=used)
+            {
+                if (gcDecode(&tcpDecoder, &tcpRxFifo[tcpRxIndexNextFree], tcpRxChunk+i, avail-i, &used) == GC_FRAME)
+                    tcpFrameDone();
+            }
+        }
+    }
+
+    if (tcpRxIndexNextUsed == tcpRxIndexNextFree)
+        return FALSE;
+
+    memcpy(msg->buffer, tcpRxFifo[tcpRxIndexNextUsed].buffer, tcpRxFifo[tcpRxIndexNextUsed].buffer[dlc] + 6);
+    if (++tcpRxIndexNextUsed >= TCP_RX_FIFO_LEN)
+        tcpRxIndexNextUsed = 0;
+    return TRUE;
+}
+
+
+/**
+ * A complete frame has been decoded into the next free slot of the receive FIFO,
+ * decide whether to keep it.
+ * Extended frames (bootloader), RTR and zero length frames are not CBUS messages.
+ */
+void tcpFrameDone(void)
+{
+    BYTE    *pkt = tcpRxFifo[tcpRxIndexNextFree].buffer;
+
+    if ((pkt[sidl] & GC_EXIDE) || (pkt[dlc] & 0x40) || ((pkt[dlc] & 0x0F) == 0))
+        return;
+
+    tcpRxFrames++;
+
+    if (++tcpRxIndexNextFree >= TCP_RX_FIFO_LEN)
+        tcpRxIndexNextFree = 0;
+
+    if (tcpRxIndexNextFree == tcpRxIndexNextUsed)
+    {
+        tcpRxOflowCount++;      // On overflow, received packets overwrite last received packet
+        if (tcpRxIndexNextFree == 0)
+            tcpRxIndexNextFree = TCP_RX_FIFO_LEN - 1;
+        else
+            tcpRxIndexNextFree--;
+    }
+}
+
+#endif  // CBUS_OVER_TCP
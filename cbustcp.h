@@ -0,0 +1,75 @@
+#ifndef __CBUSTCP_H
+#define __CBUSTCP_H
+
+/*
+
+ cbustcp.h - Definitions for CBUS over TCP (GridConnect) transport - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "can18.h"
+#include "TickTime.h"
+#include "gridconnect.h"
+
+// CBUS frames are carried over TCP as GridConnect ASCII, see gridconnect.h
+
+#define CBUS_TCP_PORT       5550                    // Port we listen on for GridConnect connections
+#define TCP_TX_BATCH_LEN    128                     // Bytes of GridConnect text coalesced into one TCP segment
+#define TCP_RX_CHUNK_LEN    32                      // Bytes read from the socket in one go
+#define TCP_RX_FIFO_LEN     8                       // Decoded frames waiting for cbusMsgReceived
+#define TCP_FLUSH_TIME      TWO_MILI_SECOND         // Maximum time a frame waits in the batch before being sent
+
+// Diagnostic variables for TCP performance
+
+extern  WORD  tcpTxFrames;
+extern  WORD  tcpRxFrames;
+extern  WORD  tcpTxSegments;
+extern  GcDecoder tcpDecoder;                       // tcpDecoder.errors counts malformed frames received
+extern  BYTE  tcpRxOflowCount;
+
+void tcpInit(void);
+BOOL tcpSend(BYTE *msg, BYTE msgLen);
+BYTE tcpTxFree(void);
+BOOL tcpRecv(CanPacket *msg);
+void tcpFlush(void);
+
+#endif	// __CBUSTCP_H
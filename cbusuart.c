@@ -0,0 +1,302 @@
+/*
+
+ CBUS over serial UART transport - part of CBUS libraries for PIC 18F
+ Carries CBUS frames as GridConnect ASCII over a serial link, for example to a PC.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * CBUS over UART.
+ * 
+ * Both directions are interrupt driven through ring buffers. The application's 
+ * interrupt routine must call uartInterruptHandler().
+ * 
+ * Transmit: uartSend() converts the frame to GridConnect and copies the text into 
+ * the transmit ring, which the interrupt routine empties one byte at a time. If CTS 
+ * is in use and the far end deasserts it, the transmit interrupt is turned off and 
+ * turned back on by the next uartSend() or uartRecv() once CTS is asserted again.
+ * 
+ * Receive: the interrupt routine only copies bytes into the receive ring. They are 
+ * decoded by uartRecv() in the main loop. A byte received with a framing error is 
+ * replaced by one the GridConnect decoder will reject, so the frame it was in is 
+ * discarded and the decoder resynchronises on the ':' of the next frame. The same
+ * byte is put where bytes were lost, through the receive ring being full or a 
+ * hardware overrun, so that the parts of two frames either side of the gap can't 
+ * be decoded as one. At most one frame is lost for each error.
+ */
+
+#include <string.h>
+#include "devincs.h"
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "hwsettings.h"
+#include "cbus.h"
+#include "cbusuart.h"
+#include "gridconnect.h"
+
+#if defined(CBUS_OVER_UART)
+
+#if defined(CBUS_OVER_CAN)
+extern BYTE canID;
+#define uartCanId   canID
+#else
+#define uartCanId   DEFAULT_CANID
+#endif
+
+#define UART_BAD_BYTE   0xFF                        // Put in place of a byte with a framing error, never valid GridConnect
+
+BYTE        uartTxBuf[UART_TX_BUF_LEN];
+volatile BYTE uartTxIndexNextFree;
+volatile BYTE uartTxIndexNextUsed;
+BYTE        uartRxBuf[UART_RX_BUF_LEN];
+volatile BYTE uartRxIndexNextFree;
+volatile BYTE uartRxIndexNextUsed;
+BOOL        uartRxLost;                             // Bytes have been lost since the last one put in the ring
+CanPacket   uartRxPkt;                              // Frame being decoded, may span several calls to uartRecv
+GcDecoder   uartDecoder;
+
+WORD  uartTxBytes;
+WORD  uartRxBytes;
+WORD  uartTxFrames;
+WORD  uartRxFrames;
+BYTE  uartFramingErrors;
+BYTE  uartOverrunCount;
+BYTE  uartRxOflowCount;
+
+// Internal routine definitions
+
+void uartStartTx(void);
+
+/**
+ * Initialise the UART for CBUS.
+ * 
+ * @param baud the baud rate
+ */
+void uartInit(DWORD baud)
+{
+    uartTxIndexNextFree = 0;
+    uartTxIndexNextUsed = 0;
+    uartRxIndexNextFree = 0;
+    uartRxIndexNextUsed = 0;
+    uartRxLost = FALSE;
+    gcDecoderInit(&uartDecoder);
+    uartTxBytes = 0;
+    uartRxBytes = 0;
+    uartTxFrames = 0;
+    uartRxFrames = 0;
+    uartFramingErrors = 0;
+    uartOverrunCount = 0;
+    uartRxOflowCount = 0;
+
+    // 16 bit baud rate generator, high speed: baud = Fosc / (4 * (n+1))
+    baud = ((DWORD)clkMHz * 250000 + baud/2) / baud - 1;
+    UART_BAUDCON = 0b00001000;      // BRG16
+    UART_SPBRGH = baud >> 8;
+    UART_SPBRG = baud & 0xFF;
+    UART_TXSTA = 0b00100100;        // TXEN, BRGH, async 8 bit
+    UART_RCSTA = 0b10010000;        // SPEN, CREN
+
+    UART_TXIE = 0;
+    UART_RCIE = 1;
+}
+
+/**
+ * Queue a CBUS message for sending over the UART.
+ * 
+ * @param msg the CBUS message with data from d0
+ * @param msgLen number of data bytes
+ * @return TRUE if the message was accepted, FALSE if there is not room for it yet
+ */
+BOOL uartSend(BYTE *msg, BYTE msgLen)
+{
+    BYTE    text[GC_MAX_FRAME_LEN];
+    BYTE    len, i, space;
+
+    msg[dlc] = msgLen;
+    msg[sidh] = 0b10110000 | ((uartCanId & 0x78) >>3);
+    msg[sidl] = (uartCanId & 0x07) << 5;
+    len = gcEncodeFrame(text, (CanPacket *)msg);
+
+    space = (uartTxIndexNextUsed - uartTxIndexNextFree - 1) & UART_TX_BUF_MASK;
+    if (space < len)
+    {
+        uartStartTx();              // Make sure it is draining
+        return FALSE;
+    }
+
+    for (i=0; i<len; i++)
+    {
+        uartTxBuf[uartTxIndexNextFree] = text[i];
+        uartTxIndexNextFree = (uartTxIndexNextFree + 1) & UART_TX_BUF_MASK;
+    }
+    uartTxFrames++;
+    uartStartTx();
+    return TRUE;
+}
+
+/**
+ * How many messages uartSend() will certainly accept, assuming each is as long
+ * as a GridConnect frame can be.
+ * 
+ * @return number of messages
+ */
+BYTE uartTxFree(void)
+{
+    return ((uartTxIndexNextUsed - uartTxIndexNextFree - 1) & UART_TX_BUF_MASK) / GC_MAX_FRAME_LEN;
+}
+
+/**
+ * Check for a CBUS message received over the UART.
+ * 
+ * @param msg where to put a received message
+ * @return TRUE if a message has been received
+ */
+BOOL uartRecv(CanPacket *msg)
+{
+    BYTE    c, used;
+    BYTE    *pkt = uartRxPkt.buffer;
+
+    uartStartTx();                  // In case CTS has been reasserted
+
+    while (uartRxIndexNextUsed != uartRxIndexNextFree)
+    {
+        c = uartRxBuf[uartRxIndexNextUsed];
+        uartRxIndexNextUsed = (uartRxIndexNextUsed + 1) & UART_RX_BUF_MASK;
+
+        if (gcDecode(&uartDecoder, &uartRxPkt, &c, 1, &used) == GC_FRAME)
+        {
+            if ((pkt[sidl] & GC_EXIDE) || (pkt[dlc] & 0x40) || ((pkt[dlc] & 0x0F) == 0))
+                continue;           // Not a CBUS message
+
+            uartRxFrames++;
+            memcpy(msg->buffer, pkt, pkt[dlc] + 6);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Enable the transmit interrupt if there is something to send and CTS allows.
+ */
+void uartStartTx(void)
+{
+    if (uartTxIndexNextUsed == uartTxIndexNextFree)
+        return;
+#ifdef UART_CTS
+    if (UART_CTS)
+        return;                     // CTS is active low
+#endif
+    UART_TXIE = 1;
+}
+
+/**
+ * Handle UART interrupts. Must be called from the application's interrupt routine.
+ */
+void uartInterruptHandler(void)
+{
+    BYTE    c, next;
+
+#ifdef UART_ISR_PIN
+    UART_ISR_PIN = 1;
+#endif
+
+    while (UART_RCIF)
+    {
+        if (UART_RCSTAbits.FERR)
+        {
+            c = UART_RCREG;
+            c = UART_BAD_BYTE;      // Make sure the decoder rejects the frame this was in
+            uartFramingErrors++;
+        }
+        else
+            c = UART_RCREG;
+
+        next = (uartRxIndexNextFree + 1) & UART_RX_BUF_MASK;
+        if (uartRxLost && (next != uartRxIndexNextUsed))
+        {   // Mark the gap so the frame it is in is discarded
+            uartRxBuf[uartRxIndexNextFree] = UART_BAD_BYTE;
+            uartRxIndexNextFree = next;
+            next = (next + 1) & UART_RX_BUF_MASK;
+            uartRxLost = FALSE;
+        }
+        if (next == uartRxIndexNextUsed)
+        {
+            uartRxOflowCount++;
+            uartRxLost = TRUE;
+        }
+        else
+        {
+            uartRxBuf[uartRxIndexNextFree] = c;
+            uartRxIndexNextFree = next;
+            uartRxBytes++;
+        }
+    }
+    if (UART_RCSTAbits.OERR)
+    {
+        UART_RCSTAbits.CREN = 0;    // Clear overrun
+        UART_RCSTAbits.CREN = 1;
+        uartOverrunCount++;
+        uartRxLost = TRUE;
+    }
+
+    if (UART_TXIE && UART_TXIF)
+    {
+#ifdef UART_CTS
+        if (UART_CTS)
+            UART_TXIE = 0;          // Far end not ready, uartStartTx turns us back on
+        else
+#endif
+        if (uartTxIndexNextUsed == uartTxIndexNextFree)
+            UART_TXIE = 0;
+        else
+        {
+            UART_TXREG = uartTxBuf[uartTxIndexNextUsed];
+            uartTxIndexNextUsed = (uartTxIndexNextUsed + 1) & UART_TX_BUF_MASK;
+            uartTxBytes++;
+        }
+    }
+
+#ifdef UART_ISR_PIN
+    UART_ISR_PIN = 0;
+#endif
+}
+
+#endif  // CBUS_OVER_UART
@@ -0,0 +1,113 @@
+#ifndef __CBUSUART_H
+#define __CBUSUART_H
+
+/*
+
+ cbusuart.h - Definitions for CBUS over a serial UART (GridConnect) transport - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "can18.h"
+#include "gridconnect.h"
+
+// CBUS frames are carried over the serial link as GridConnect ASCII, see gridconnect.h
+
+#ifndef UART_BAUD
+#define UART_BAUD           115200                  // Default baud rate, may be set in hwsettings.h
+#endif
+#define UART_TX_BUF_LEN     64                      // Bytes of GridConnect text waiting for the transmit interrupt
+#define UART_RX_BUF_LEN     64                      // Bytes received waiting for uartRecv, must be a power of 2
+#define UART_TX_BUF_MASK    (UART_TX_BUF_LEN-1)
+#define UART_RX_BUF_MASK    (UART_RX_BUF_LEN-1)
+
+// Hardware flow control: if hwsettings.h defines UART_CTS as the input pin connected 
+// to CTS then nothing is sent whilst it is high. If UART_ISR_PIN is defined as an output
+// pin it is set for the duration of the interrupt routine, to measure per byte cost on a scope.
+
+// Macros for chip family dependant register and bit locations
+
+#ifdef CPUF18K
+    #define UART_RCSTA      RCSTA1
+    #define UART_RCSTAbits  RCSTA1bits
+    #define UART_TXSTA      TXSTA1
+    #define UART_BAUDCON    BAUDCON1
+    #define UART_SPBRG      SPBRG1
+    #define UART_SPBRGH     SPBRGH1
+    #define UART_RCREG      RCREG1
+    #define UART_TXREG      TXREG1
+    #define UART_RCIF       PIR1bits.RC1IF
+    #define UART_TXIF       PIR1bits.TX1IF
+    #define UART_RCIE       PIE1bits.RC1IE
+    #define UART_TXIE       PIE1bits.TX1IE
+#else
+    #define UART_RCSTA      RCSTA
+    #define UART_RCSTAbits  RCSTAbits
+    #define UART_TXSTA      TXSTA
+    #define UART_BAUDCON    BAUDCON
+    #define UART_SPBRG      SPBRG
+    #define UART_SPBRGH     SPBRGH
+    #define UART_RCREG      RCREG
+    #define UART_TXREG      TXREG
+    #define UART_RCIF       PIR1bits.RCIF
+    #define UART_TXIF       PIR1bits.TXIF
+    #define UART_RCIE       PIE1bits.RCIE
+    #define UART_TXIE       PIE1bits.TXIE
+#endif
+
+// Diagnostic variables for UART performance
+
+extern  WORD  uartTxBytes;
+extern  WORD  uartRxBytes;
+extern  WORD  uartTxFrames;
+extern  WORD  uartRxFrames;
+extern  BYTE  uartFramingErrors;                    // Bytes received with a framing error
+extern  BYTE  uartOverrunCount;                     // Hardware receive overruns
+extern  BYTE  uartRxOflowCount;                     // Bytes lost because the receive buffer was full
+extern  GcDecoder uartDecoder;                      // uartDecoder.errors counts malformed frames received
+
+void uartInit(DWORD baud);
+BOOL uartSend(BYTE *msg, BYTE msgLen);
+BYTE uartTxFree(void);
+BOOL uartRecv(CanPacket *msg);
+void uartInterruptHandler(void);
+
+#endif	// __CBUSUART_H
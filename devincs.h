@@ -75,6 +75,15 @@ extern "C" {
     #define EE1024
 #endif
 
+// Define the amount of RAM available, in bytes
+#if defined(__18F2480) || defined(__18F2580) || defined(__18F4480) || defined(__18F4580)
+    #define RAM_SIZE    1536
+#elif defined(__18F2585) || defined(__18F2680) || defined(__18F4585) || defined(__18F4680)
+    #define RAM_SIZE    3328
+#else
+    #define RAM_SIZE    3648
+#endif
+
     
 // Set CPU code for CBUS parameter block
 
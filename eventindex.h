@@ -0,0 +1,71 @@
+#ifndef __EVENTINDEX_H
+#define __EVENTINDEX_H
+
+/*
+
+ eventindex.h - Definitions for indexes into the event table - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+
+/*
+ * Indexes into the eventTable are a byte when NUM_EVENTS is at most 255, as it
+ * is for most modules. Larger tables use 16 bit indexes, which adds a byte to 
+ * each eventTable row and to each entry of the RAM lookup tables. NO_INDEX is 
+ * never a valid row.
+ * Kept apart from events.h so that callbacks.h can use it without the rest of 
+ * the event definitions.
+ */
+#if NUM_EVENTS > 255
+#define EVENT_INDEX_T           WORD
+#define NO_INDEX                0xffff
+#define readFlashIndex(a)       ((WORD)readFlashBlock(a) | ((WORD)readFlashBlock((a)+1) << 8))
+#define setFlashIndex(a, i)     setFlashWord((WORD*)(a), i)
+#else
+#define EVENT_INDEX_T           BYTE
+#define NO_INDEX                0xff
+#define readFlashIndex(a)       readFlashBlock(a)
+#define setFlashIndex(a, i)     setFlashByte((BYTE*)(a), i)
+#endif
+
+#endif	// __EVENTINDEX_H
@@ -0,0 +1,410 @@
+/*
+
+ Flash resident perfect hash of events - part of CBUS libraries for PIC 18F
+ Gives constant time findEvent() without the RAM hash table.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Perfect hash of events.
+ * 
+ * The RAM hash table (HASH_TABLE) makes findEvent() fast but needs 
+ * HASH_LENGTH*CHAIN_LENGTH bytes of RAM, 640 on CANMIO. Without it findEvent() 
+ * searches the whole eventTable. Most nodes are taught once and then left alone
+ * for months, so when EVENT_MPH is defined a perfect hash of the taught events is 
+ * built into flash, next to the event table, as the node leaves learn mode.
+ * findEvent() then needs only a handful of flash reads and one byte of RAM, 
+ * though building the hash needs more, see below.
+ * 
+ * The hash is of the "hash and displace" type. Each event hashes to a bucket of 
+ * about four events and each bucket has a pair of displacements, found when the 
+ * hash is built, which move all its events to slots not already in use:
+ *    slot = (f(event) + disp0[bucket]*g(event) + disp1[bucket]) % numSlots
+ * There are normally exactly as many slots as events. Each slot holds the 
+ * eventTable index, which is checked against the NN/EN being looked for.
+ * 
+ * Any change to which events are in the eventTable (or a change of NN when 
+ * forceOwnNN events are present) marks the hash as invalid and findEvent() goes 
+ * back to searching until the hash is rebuilt at the end of the teach session. 
+ * Changes to EVs don't affect the hash. If no perfect hash can be found, which 
+ * is unlikely but possible, for example if the same event has been taught twice, 
+ * the search is used.
+ * 
+ * Building the hash works out the bucket of every event once for each seed tried
+ * and keeps them in RAM whilst trying to place the buckets, so the eventTable is 
+ * only read again for the events of the bucket being placed. This and the 
+ * displacements and slot bitmap take NUM_EVENTS+2*MPH_BUCKETS+MPH_USED_LEN bytes,
+ * 415 with 255 events, which are too much for the C18 stack so are kept in their 
+ * own section, large_event_mph, which needs to be in the linker script. 
+ * The build also uses about 70 bytes of stack.
+ */
+
+#include "devincs.h"
+#include "module.h"
+#include "events.h"
+#include "romops.h"
+#include "eventmph.h"
+
+#ifdef EVENT_MPH
+
+#ifdef __XC8
+const EventMph eventMph[1] @AT_EVENT_MPH;
+#else
+rom near EventMph * eventMph = (rom near EventMph*)AT_EVENT_MPH;
+#endif
+
+#define MPH_USED_LEN    ((NUM_EVENTS+7)/8)  // Bytes in the slot used bitmap
+#define MPH_SEED_F      0x3C                // Seed modifiers for the slot hashes
+#define MPH_SEED_G      0xC3
+
+BOOL eventMphValid;
+
+#pragma udata large_event_mph
+// Working storage for mphBuild()
+BYTE mphDisp0[MPH_BUCKETS];             // Multiplier displacement for each bucket
+BYTE mphDisp1[MPH_BUCKETS];             // Offset displacement for each bucket
+BYTE mphUsed[MPH_USED_LEN];             // Slot bitmap whilst placing, then the slots being written
+BYTE mphBucketOf[NUM_EVENTS];           // Bucket of each row for the seed being tried
+#pragma udata 
+
+WORD  mphBuildCount;
+WORD  mphFailCount;
+
+BYTE mphHash(WORD nn, WORD en, BYTE seed);
+BYTE mphSlot(WORD nn, WORD en, BYTE seed, BYTE disp0, BYTE disp1, BYTE numSlots);
+BOOL mphPlace(BYTE seed, BYTE numSlots, BYTE numBuckets);
+
+/**
+ * Find out whether the hash in flash can be used. Called from eventsInit().
+ */
+void mphInit(void) {
+    eventMphValid = (readFlashBlock((WORD)(&(eventMph->valid))) == MPH_VALID);
+    mphBuildCount = 0;
+    mphFailCount = 0;
+}
+
+/**
+ * Mark the hash as out of date. Called when an event is added or removed.
+ * Only writes to flash the first time after the hash has been built.
+ */
+void mphInvalidate(void) {
+    if (eventMphValid) {
+        eventMphValid = FALSE;
+        writeFlashByte((BYTE*)&(eventMph->valid), 0);
+    }
+}
+
+/**
+ * Hash an event to a byte. Different seeds give unrelated hashes.
+ * @param nn the event NN
+ * @param en the event EN
+ * @param seed the seed
+ * @return the hash
+ */
+BYTE mphHash(WORD nn, WORD en, BYTE seed) {
+    WORD h;
+    
+    h = nn ^ (((WORD)seed << 8) | seed);
+    h *= 0x2F6B;
+    h ^= h >> 7;
+    h ^= en;
+    h *= 0x2F6B;
+    h ^= h >> 8;
+    return (BYTE)h;
+}
+
+/**
+ * Work out the slot of an event given its bucket's displacements.
+ * @param nn the event NN
+ * @param en the event EN
+ * @param seed the seed the hash was built with
+ * @param disp0 the bucket's multiplier displacement
+ * @param disp1 the bucket's offset displacement
+ * @param numSlots the number of slots
+ * @return the slot
+ */
+BYTE mphSlot(WORD nn, WORD en, BYTE seed, BYTE disp0, BYTE disp1, BYTE numSlots) {
+    WORD slot;
+    
+    slot = mphHash(nn, en, seed ^ MPH_SEED_F);
+    slot += (WORD)disp0 * mphHash(nn, en, seed ^ MPH_SEED_G);
+    slot += disp1;
+    return slot % numSlots;
+}
+
+/**
+ * Find displacements which give every event its own slot. Buckets with the most
+ * events are placed first whilst there are plenty of free slots. The 
+ * displacements are left in mphDisp0 and mphDisp1, and the bucket of each 
+ * eventTable row in mphBucketOf, 0xFF if not the start of an event.
+ * 
+ * @param seed the seed to use
+ * @param numSlots the number of slots
+ * @param numBuckets the number of buckets
+ * @return TRUE if displacements were found for every bucket
+ */
+BOOL mphPlace(BYTE seed, BYTE numSlots, BYTE numBuckets) {
+    BYTE    f[MPH_MAX_BUCKET];
+    BYTE    g[MPH_MAX_BUCKET];
+    BYTE    slot[MPH_MAX_BUCKET];
+    BYTE    tableIndex;
+    BYTE    size;
+    BYTE    b;
+    BYTE    k;
+    BYTE    j;
+    BYTE    a;
+    BYTE    c;
+    BOOL    found;
+    
+    // mphDisp0 is the number of events in the bucket until it has been placed, mphDisp1 is 0xFF until then
+    for (b=0; b<numBuckets; b++) {
+        mphDisp0[b] = 0;
+        mphDisp1[b] = 0xFF;
+    }
+    for (j=0; j<MPH_USED_LEN; j++) {
+        mphUsed[j] = 0;
+    }
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        mphBucketOf[tableIndex] = 0xFF;
+        if (validStart(tableIndex)) {
+            b = mphHash(getNN(tableIndex), getEN(tableIndex), seed) % numBuckets;
+            mphBucketOf[tableIndex] = b;
+            if (++mphDisp0[b] > MPH_MAX_BUCKET) {
+                return FALSE;
+            }
+        }
+    }
+    for (size=MPH_MAX_BUCKET; size>0; size--) {
+        for (b=0; b<numBuckets; b++) {
+            if ((mphDisp1[b] != 0xFF) || (mphDisp0[b] != size)) {
+                continue;
+            }
+            // collect the events in this bucket
+            k = 0;
+            for (tableIndex=0; (tableIndex<NUM_EVENTS) && (k<size); tableIndex++) {
+                if (mphBucketOf[tableIndex] == b) {
+                    WORD nn = getNN(tableIndex);
+                    WORD en = getEN(tableIndex);
+                    f[k] = mphHash(nn, en, seed ^ MPH_SEED_F);
+                    g[k] = mphHash(nn, en, seed ^ MPH_SEED_G);
+                    k++;
+                }
+            }
+            // try displacements until all of them land in free slots
+            found = FALSE;
+            a = 0;
+            do {
+                for (c=0; (c<numSlots) && !found; c++) {
+                    for (j=0; j<k; j++) {
+                        slot[j] = ((WORD)f[j] + (WORD)a*g[j] + c) % numSlots;
+                        if (mphUsed[slot[j]>>3] & (1 << (slot[j]&7))) {
+                            break;
+                        }
+                        mphUsed[slot[j]>>3] |= (1 << (slot[j]&7));
+                    }
+                    if (j == k) {
+                        mphDisp0[b] = a;
+                        mphDisp1[b] = c;
+                        found = TRUE;
+                    } else {
+                        // free the slots taken by this attempt
+                        while (j-- > 0) {
+                            mphUsed[slot[j]>>3] &= ~(1 << (slot[j]&7));
+                        }
+                    }
+                }
+            } while (!found && (++a != 0));
+            if (!found) {
+                return FALSE;
+            }
+        }
+    }
+    for (b=0; b<numBuckets; b++) {
+        if (mphDisp1[b] == 0xFF) {
+            // empty bucket
+            mphDisp0[b] = 0;
+            mphDisp1[b] = 0;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Build the hash from the current eventTable and write it to flash. Called as the 
+ * node leaves learn mode, does nothing if the hash is already up to date.
+ * The application may also call this after changing events itself, for example 
+ * after setting up default events.
+ */
+void mphBuild(void) {
+    BYTE    numEvents;
+    BYTE    numSlots;
+    BYTE    numBuckets;
+    BYTE    seed;
+    BYTE    step;
+    BYTE    tableIndex;
+    BYTE    b;
+    BYTE    i;
+    WORD    start;
+    BOOL    found;
+    
+    if (eventMphValid) {
+        return;
+    }
+    mphBuildCount++;
+    numEvents = 0;
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        if (validStart(tableIndex)) {
+            numEvents++;
+        }
+    }
+    numBuckets = (numEvents+3)/4;
+    if (numBuckets == 0) {
+        numBuckets = 1;
+    }
+    // Try a minimal hash first, allowing a few spare slots if that can't be done
+    step = numEvents/16;
+    if (step == 0) {
+        step = 1;
+    }
+    found = (numEvents == 0);
+    seed = 0;
+    for (numSlots=numEvents; !found && (numSlots<=NUM_EVENTS) && (numSlots>=numEvents); numSlots+=step) {
+        for (i=0; (i<MPH_SEEDS) && !found; i++) {
+            seed = i*37;
+            found = mphPlace(seed, numSlots, numBuckets);
+        }
+        if (found) {
+            break;
+        }
+    }
+    if (!found) {
+        mphFailCount++;
+        return;
+    }
+    
+    // write the displacements
+    for (b=0; b<numBuckets; b++) {
+        writeFlashImage((BYTE*)&(eventMph->disp0[b]), mphDisp0[b]);
+    }
+    for (b=0; b<numBuckets; b++) {
+        writeFlashImage((BYTE*)&(eventMph->disp1[b]), mphDisp1[b]);
+    }
+    // write the slots a chunk at a time as finding them means reading the eventTable
+    for (start=0; start<numSlots; start+=MPH_USED_LEN) {
+        for (i=0; i<MPH_USED_LEN; i++) {
+            mphUsed[i] = NO_INDEX;
+        }
+        for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+            b = mphBucketOf[tableIndex];
+            if (b != 0xFF) {
+                WORD nn = getNN(tableIndex);
+                WORD en = getEN(tableIndex);
+                BYTE slot;
+                slot = mphSlot(nn, en, seed, mphDisp0[b], mphDisp1[b], numSlots);
+                if ((slot >= start) && (slot < start+MPH_USED_LEN)) {
+                    mphUsed[slot-start] = tableIndex;
+                }
+            }
+        }
+        for (i=0; (i<MPH_USED_LEN) && (start+i < numSlots); i++) {
+            writeFlashImage((BYTE*)&(eventMph->slot[start+i]), mphUsed[i]);
+        }
+    }
+    // and finally the header, so a partly written hash is never used
+    writeFlashImage((BYTE*)&(eventMph->seed), seed);
+    writeFlashImage((BYTE*)&(eventMph->numSlots), numSlots);
+    writeFlashImage((BYTE*)&(eventMph->numBuckets), numBuckets);
+    writeFlashImage((BYTE*)&(eventMph->valid), MPH_VALID);
+    flushFlashImage();
+    eventMphValid = TRUE;
+}
+
+/**
+ * Find an event using the hash. Must only be called when eventMphValid is TRUE.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @return index into eventTable or NO_INDEX if not present
+ */
+BYTE mphFindEvent(WORD nodeNumber, WORD eventNumber) {
+    BYTE    numSlots;
+    BYTE    seed;
+    BYTE    b;
+    BYTE    tableIndex;
+    
+    numSlots = readFlashBlock((WORD)(&(eventMph->numSlots)));
+    if (numSlots == 0) {
+        return NO_INDEX;
+    }
+    seed = readFlashBlock((WORD)(&(eventMph->seed)));
+    b = mphHash(nodeNumber, eventNumber, seed) % readFlashBlock((WORD)(&(eventMph->numBuckets)));
+    tableIndex = readFlashBlock((WORD)(&(eventMph->slot[mphSlot(nodeNumber, eventNumber, seed, 
+            readFlashBlock((WORD)(&(eventMph->disp0[b]))), 
+            readFlashBlock((WORD)(&(eventMph->disp1[b]))), numSlots)])));
+    // the slot may belong to a different event
+    if ((tableIndex < NUM_EVENTS) && validStart(tableIndex) 
+            && (getNN(tableIndex) == nodeNumber) && (getEN(tableIndex) == eventNumber)) {
+        return tableIndex;
+    }
+    return NO_INDEX;
+}
+
+#ifdef EVENT_COMPACT
+/**
+ * Change the eventTable index held in the slot of an event whose start row 
+ * has been moved, so the hash stays valid.
+ * @param from the old index
+ * @param to the new index
+ */
+void mphMoveRow(BYTE from, BYTE to) {
+    BYTE    numSlots;
+    BYTE    i;
+    
+    numSlots = readFlashBlock((WORD)(&(eventMph->numSlots)));
+    for (i=0; i<numSlots; i++) {
+        if (readFlashBlock((WORD)(&(eventMph->slot[i]))) == from) {
+            writeFlashByte((BYTE*)&(eventMph->slot[i]), to);
+            return;
+        }
+    }
+}
+#endif
+
+#endif  // EVENT_MPH
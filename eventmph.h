@@ -0,0 +1,100 @@
+#ifndef __EVENTMPH_H
+#define __EVENTMPH_H
+
+/*
+
+ eventmph.h - Definitions for the flash resident perfect hash of events - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+
+#ifdef EVENT_MPH
+
+#ifdef HASH_TABLE
+#error "EVENT_MPH is an alternative to HASH_TABLE, define only one of them"
+#endif
+
+#if NUM_EVENTS > 255
+#error "EVENT_MPH slots and hashes are bytes, use KEY_INDEX or HASH_TABLE for more than 255 events"
+#endif
+
+// AT_EVENT_MPH must be defined in module.h, within the writeable flash area and
+// not overlapping the event table or NVs. sizeof(EventMph) bytes are needed.
+
+#define MPH_BUCKETS         ((NUM_EVENTS+3)/4)  // Average of 4 events per bucket
+#define MPH_MAX_BUCKET      12                  // Larger buckets are tried with another seed
+#define MPH_SEEDS           16                  // Number of seeds tried for each table size
+#define MPH_VALID           0xA5                // Header value when the hash matches the eventTable
+
+/*
+ * The perfect hash held in flash. An event is first hashed to a bucket, the bucket's
+ * displacements then give its slot, which holds the eventTable index.
+ */
+typedef struct {
+    BYTE    valid;                      // MPH_VALID when built from the current eventTable
+    BYTE    seed;                       // Seed used for all three hashes
+    BYTE    numSlots;                   // Size of slot[], normally the number of events
+    BYTE    numBuckets;                 // Buckets in use
+    BYTE    disp0[MPH_BUCKETS];         // Multiplier displacement for each bucket
+    BYTE    disp1[MPH_BUCKETS];         // Offset displacement for each bucket
+    BYTE    slot[NUM_EVENTS];           // eventTable index for each hash value
+} EventMph;
+
+extern BOOL eventMphValid;              // TRUE when findEvent can use the perfect hash
+
+// Diagnostic variables for the perfect hash
+
+extern  WORD  mphBuildCount;            // Times the hash has been built
+extern  WORD  mphFailCount;             // Builds which could not find a perfect hash, findEvent then searches
+
+void mphInit(void);
+void mphInvalidate(void);
+void mphBuild(void);
+BYTE mphFindEvent(WORD nodeNumber, WORD eventNumber);
+#ifdef EVENT_COMPACT
+void mphMoveRow(BYTE from, BYTE to);
+#endif
+
+#endif  // EVENT_MPH
+
+#endif	// __EVENTMPH_H
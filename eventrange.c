@@ -0,0 +1,269 @@
+/*
+
+ Event ranges - part of CBUS libraries for PIC 18F
+ Lets one taught event stand for a range of ENs, or for an EN from any node.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Event ranges.
+ * 
+ * Normally each consumed event needs its own row in the eventTable, so a module
+ * consuming 64 consecutive ENs from a panel needs 64 rows and 64 EVLRNs. When 
+ * EVENT_RANGES is defined an event which has been taught in the usual way can be
+ * made to stand for the ENs from its own up to a last EN, and/or for the same 
+ * EN(s) from any NN. All events in the range share the EVs of the taught event;
+ * processEvent() is passed its table index and can use eventOffset() to find 
+ * how far into the range the received event was.
+ * 
+ * An exact match is always used in preference to a range. Only when findEvent()
+ * doesn't find the event is the range index searched, so the cost of a lookup 
+ * is bounded by the number of ranges. The index is a copy in RAM of the ranges
+ * kept in flash, sorted by first EN so the search can stop at the first range
+ * starting after the EN being looked for.
+ * 
+ * Ranges are only used for consumed events. Teaching an EN within a range 
+ * creates a separate event in the usual way which then takes precedence.
+ * Ranges are set up by the module, for example from an NV or a module specific
+ * opcode, using addEventRange(). Removing the taught event removes its range.
+ */
+
+#include "devincs.h"
+#include "module.h"
+#include "events.h"
+#include "cbus.h"
+#include "romops.h"
+#include "eventrange.h"
+
+#ifdef EVENT_RANGES
+
+#ifdef __XC8
+const EventRange eventRanges[NUM_EVENT_RANGES] @AT_EVENT_RANGES;
+#else
+rom near EventRange * eventRanges = (rom near EventRange*)AT_EVENT_RANGES;
+#endif
+
+RangeIndexEntry rangeIndex[NUM_EVENT_RANGES];
+BYTE            rangeCount;
+
+/**
+ * Build the RAM index from the ranges in flash. Ranges whose event is no 
+ * longer in the eventTable are freed. Called from eventsInit() and when the NN
+ * changes, as that moves any forceOwnNN events.
+ */
+void rangeInit(void) {
+    BYTE    i, j;
+    EVENT_INDEX_T tableIndex;
+    RangeIndexEntry r;
+    
+    rangeCount = 0;
+    for (i=0; i<NUM_EVENT_RANGES; i++) {
+        tableIndex = readFlashIndex((WORD)(&(eventRanges[i].tableIndex)));
+        if (tableIndex == NO_INDEX) continue;
+        if ( ! validStart(tableIndex)) {
+            // the event was removed without its range, e.g. power lost part way through
+            setFlashIndex(&(eventRanges[i].tableIndex), NO_INDEX);
+            flushFlashImage();
+            continue;
+        }
+        r.tableIndex = tableIndex;
+        r.flags = readFlashBlock((WORD)(&(eventRanges[i].flags)));
+        r.lastEN = readFlashBlock((WORD)(&(eventRanges[i].lastEN))+1);
+        r.lastEN = (r.lastEN << 8) | readFlashBlock((WORD)(&(eventRanges[i].lastEN)));
+        r.nn = getNN(tableIndex);
+        r.firstEN = getEN(tableIndex);
+        // insert in order of first EN
+        for (j=rangeCount; (j > 0) && (rangeIndex[j-1].firstEN > r.firstEN); j--) {
+            rangeIndex[j] = rangeIndex[j-1];
+        }
+        rangeIndex[j] = r;
+        rangeCount++;
+    }
+}
+
+/**
+ * Remove all ranges. Called from clearAllEvents().
+ */
+void rangeClear(void) {
+    BYTE    i;
+    
+    for (i=0; i<NUM_EVENT_RANGES; i++) {
+        setFlashIndex(&(eventRanges[i].tableIndex), NO_INDEX);
+    }
+    flushFlashImage();
+    rangeCount = 0;
+}
+
+/**
+ * Remove the range, if any, of an event. Called from removeTableEntry() whilst
+ * the event is still in the eventTable.
+ * 
+ * @param tableIndex the eventTable index of the event
+ */
+void rangeRemoveRow(EVENT_INDEX_T tableIndex) {
+    BYTE    i;
+    
+    for (i=0; i<rangeCount; i++) {
+        if (rangeIndex[i].tableIndex == tableIndex) break;
+    }
+    if (i >= rangeCount) return;
+    rangeCount--;
+    for (; i<rangeCount; i++) {
+        rangeIndex[i] = rangeIndex[i+1];
+    }
+    for (i=0; i<NUM_EVENT_RANGES; i++) {
+        if (readFlashIndex((WORD)(&(eventRanges[i].tableIndex))) == tableIndex) {
+            setFlashIndex(&(eventRanges[i].tableIndex), NO_INDEX);
+            flushFlashImage();
+        }
+    }
+}
+
+/**
+ * Find the range containing an event.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @return index into eventTable of the event with the range or NO_INDEX if none
+ */
+EVENT_INDEX_T rangeFindEvent(WORD nodeNumber, WORD eventNumber) {
+    BYTE    i;
+    RangeIndexEntry * r;
+    
+    for (i=0; i<rangeCount; i++) {
+        r = &rangeIndex[i];
+        if (eventNumber < r->firstEN) break;
+        if ((eventNumber <= r->lastEN) && ((r->flags & RANGE_ANY_NN) || (r->nn == nodeNumber))) {
+            return r->tableIndex;
+        }
+    }
+    return NO_INDEX;
+}
+
+/**
+ * Make a taught event stand for a range of events, or change its range.
+ * 
+ * @param nodeNumber NN of the taught event
+ * @param firstEN EN of the taught event
+ * @param lastEN last EN of the range, firstEN for a single EN from any NN
+ * @param flags RANGE_ANY_NN to match the ENs from any node
+ * @return error number or 0 for success
+ */
+BYTE addEventRange(WORD nodeNumber, WORD firstEN, WORD lastEN, BYTE flags) {
+    EVENT_INDEX_T tableIndex;
+    BYTE    i;
+    EVENT_INDEX_T t;
+    EVENT_INDEX_T slot = NO_INDEX;
+    
+    if (lastEN < firstEN) return CMDERR_INV_EV_VALUE;
+    tableIndex = findEvent(nodeNumber, firstEN);
+    if (tableIndex == NO_INDEX) return CMDERR_INVALID_EVENT;
+    for (i=0; i<NUM_EVENT_RANGES; i++) {
+        t = readFlashIndex((WORD)(&(eventRanges[i].tableIndex)));
+        if (t == tableIndex) {
+            slot = i;
+            break;
+        }
+        if ((t == NO_INDEX) && (slot == NO_INDEX)) {
+            slot = i;
+        }
+    }
+    if (slot == NO_INDEX) return CMDERR_TOO_MANY_EVENTS;
+    setFlashIndex(&(eventRanges[slot].tableIndex), tableIndex);
+    setFlashByte((BYTE*)&(eventRanges[slot].flags), flags);
+    setFlashWord((WORD*)&(eventRanges[slot].lastEN), lastEN);
+    flushFlashImage();
+    rangeInit();
+    return 0;
+}
+
+/**
+ * Stop a taught event standing for a range. The event itself remains.
+ * 
+ * @param nodeNumber NN of the taught event
+ * @param firstEN EN of the taught event
+ * @return error number or 0 for success
+ */
+BYTE removeEventRange(WORD nodeNumber, WORD firstEN) {
+    EVENT_INDEX_T tableIndex = findEvent(nodeNumber, firstEN);
+    
+    if (tableIndex == NO_INDEX) return CMDERR_INVALID_EVENT;
+    rangeRemoveRow(tableIndex);
+    return 0;
+}
+
+/**
+ * How far into its range an event is, for use by processEvent().
+ * 
+ * @param tableIndex the index passed to processEvent()
+ * @param msg the event message passed to processEvent()
+ * @return EN of the message less the EN of the taught event, 0 for an exact match
+ */
+WORD eventOffset(EVENT_INDEX_T tableIndex, BYTE *msg) {
+    WORD    eventNumber = ((WORD)msg[d3] << 8) | msg[d4];
+    
+    return eventNumber - getEN(tableIndex);
+}
+
+#ifdef EVENT_COMPACT
+/**
+ * Change the eventTable index of a range whose event's start row has been 
+ * moved.
+ * @param from the old index
+ * @param to the new index
+ */
+void rangeMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to) {
+    BYTE    i;
+    
+    for (i=0; i<rangeCount; i++) {
+        if (rangeIndex[i].tableIndex == from) {
+            rangeIndex[i].tableIndex = to;
+        }
+    }
+    for (i=0; i<NUM_EVENT_RANGES; i++) {
+        if (readFlashIndex((WORD)(&(eventRanges[i].tableIndex))) == from) {
+            setFlashIndex(&(eventRanges[i].tableIndex), to);
+            flushFlashImage();
+        }
+    }
+}
+#endif
+
+#endif  // EVENT_RANGES
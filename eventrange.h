@@ -0,0 +1,102 @@
+#ifndef __EVENTRANGE_H
+#define __EVENTRANGE_H
+
+/*
+
+ Event ranges - part of CBUS libraries for PIC 18F
+ Lets one taught event stand for a range of ENs, or for an EN from any node.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "events.h"
+
+#ifdef EVENT_RANGES
+
+#ifndef NUM_EVENT_RANGES
+#define NUM_EVENT_RANGES    8           // May be set in module.h
+#endif
+
+// AT_EVENT_RANGES must be defined in module.h, within the writeable flash area 
+// and not overlapping the event table or NVs. 
+// sizeof(EventRange)*NUM_EVENT_RANGES bytes are needed.
+
+#define RANGE_ANY_NN        0x01        // Match the EN(s) from any NN, including short events
+
+/*
+ * A range in flash. The eventTable row holds the NN, the first EN and the EVs
+ * shared by the whole range.
+ */
+typedef struct {
+    EVENT_INDEX_T tableIndex;           // eventTable row, NO_INDEX if unused
+    BYTE    flags;
+    WORD    lastEN;
+} EventRange;
+
+/*
+ * The ranges in RAM, sorted by first EN, searched when there is no exact match.
+ */
+typedef struct {
+    WORD    nn;
+    WORD    firstEN;
+    WORD    lastEN;
+    EVENT_INDEX_T tableIndex;
+    BYTE    flags;
+} RangeIndexEntry;
+
+extern RangeIndexEntry  rangeIndex[NUM_EVENT_RANGES];
+extern BYTE             rangeCount;
+
+void rangeInit(void);
+void rangeClear(void);
+void rangeRemoveRow(EVENT_INDEX_T tableIndex);
+EVENT_INDEX_T rangeFindEvent(WORD nodeNumber, WORD eventNumber);
+BYTE addEventRange(WORD nodeNumber, WORD firstEN, WORD lastEN, BYTE flags);
+BYTE removeEventRange(WORD nodeNumber, WORD firstEN);
+WORD eventOffset(EVENT_INDEX_T tableIndex, BYTE *msg);
+#ifdef EVENT_COMPACT
+void rangeMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to);
+#endif
+
+#endif  // EVENT_RANGES
+
+#endif	// __EVENTRANGE_H
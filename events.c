@@ -67,6 +67,15 @@
 #include "events.h"
 #include "cbus.h"
 #include "romops.h"
+#ifdef EVENT_MPH
+#include "eventmph.h"
+#endif
+#ifdef KEY_INDEX
+#include "keyindex.h"
+#endif
+#ifdef EVENT_RANGES
+#include "eventrange.h"
+#endif
 #ifdef TIMED_RESPONSE
 #include "timedResponse.h"
 #endif
@@ -75,22 +84,67 @@
 // forward references
 void rebuildHashtable(void);
 unsigned char getHash(WORD nn, WORD en);
-BYTE tableIndexToEvtIdx(BYTE tableIndex);
-BYTE evtIdxToTableIndex(BYTE evtIdx);
-void checkRemoveTableEntry(unsigned char tableIndex);
-unsigned char removeTableEntry(unsigned char tableIndex);
-unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal);
-WORD getNN(unsigned char tableIndex);
-WORD getEN(unsigned char tableIndex);
+EVENT_INDEX_T findEventLinear(WORD nodeNumber, WORD eventNumber);
+EVENT_INDEX_T findFreeRow(void);
+#ifdef FREE_ROW_BITMAP
+void freeRowsInit(void);
+void freeRowSet(EVENT_INDEX_T tableIndex, BOOL isFree);
+BYTE lowestBit(BYTE b);
+#endif
+#if defined(EVENT_BLOOM) || defined(EVENT_CACHE)
+EVENT_INDEX_T findEventIndexed(WORD nodeNumber, WORD eventNumber);
+#endif
+#ifdef EVENT_CACHE
+void eventCachePut(WORD nodeNumber, WORD eventNumber, EVENT_INDEX_T tableIndex);
+void eventCacheDrop(unsigned char i);
+void eventCacheRemoveRow(EVENT_INDEX_T tableIndex);
+void eventCacheRemoveMisses(WORD eventNumber);
+#endif
+#ifdef EVENT_BLOOM
+void bloomClear(void);
+void bloomAdd(WORD nodeNumber, WORD eventNumber);
+BOOL bloomMayContain(WORD nodeNumber, WORD eventNumber);
+void bloomRemoved(void);
+void bloomIndexes(WORD nodeNumber, WORD eventNumber, WORD * idx);
+#endif
+void evIterRow(EvIterator * it);
+#ifdef EVENT_COMPACT
+BOOL compactRow(EVENT_INDEX_T tableIndex);
+EVENT_INDEX_T compactFindRun(unsigned char rows);
+BOOL compactRecover(void);
+BOOL compactSameRow(EVENT_INDEX_T a, EVENT_INDEX_T b);
+void compactMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to, EVENT_INDEX_T prev);
+#endif
+#ifdef HASH_TABLE
+void hashClear(void);
+void hashInsert(EVENT_INDEX_T tableIndex);
+BOOL hashRemove(EVENT_INDEX_T tableIndex);
+BOOL hashChainRemove(unsigned char hash, EVENT_INDEX_T tableIndex);
+#ifdef EVENT_COMPACT
+void hashMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to);
+#endif
+#ifdef PRODUCED_EVENTS
+void happeningMap(EVENT_INDEX_T tableIndex, BYTE happening);
+void happeningUnmap(EVENT_INDEX_T tableIndex);
+EVENT_INDEX_T happeningRescan(BYTE happening, EVENT_INDEX_T skip);
+#endif
+#endif
+BYTE tableIndexToEvtIdx(EVENT_INDEX_T tableIndex);
+EVENT_INDEX_T evtIdxToTableIndex(BYTE evtIdx);
+void checkRemoveTableEntry(EVENT_INDEX_T tableIndex);
+unsigned char removeTableEntry(EVENT_INDEX_T tableIndex);
+unsigned char writeEv(EVENT_INDEX_T tableIndex, BYTE evNum, BYTE evVal);
+WORD getNN(EVENT_INDEX_T tableIndex);
+WORD getEN(EVENT_INDEX_T tableIndex);
 
-extern void processEvent(unsigned char action, BYTE * msg);
+extern void processEvent(EVENT_INDEX_T action, BYTE * msg);
 
 //Events are stored in Flash just below NVs
 
 /** Event handling.
  *
  * The events are stored as a hash table in flash (flash is faster to read than EEPROM)
- * There can be up to 255 events. Since the address in the hash table will be 16 bits, and the
+ * There can be up to 255 events, or more with 16 bit indexes. Since the address in the hash table will be 16 bits, and the
  * address of the whole event table can also be covered by a 16 bit address, there is no
  * advantage in having a separate hashed index table pointing to the actual event table.
  * Therefore the hashing algorithm produces the index into the actual event table, which
@@ -100,9 +154,10 @@ extern void processEvent(unsigned char action, BYTE * msg);
  * This generic FLiM code needs no knowledge of specific EV usage except that EV#1 is 
  * to define the Produced events (if the PRODUCED_EVENTS definition is defined).
  *
- * BEWARE must set NUM_EVENTS to a maximum of 255!
- * If set to 256 then the for (unsigned char i=0; i<NUM_EVENTS; i++) loops will never end
- * as they use an unsigned char instead of int for space/performance reasons.
+ * Indexes into the eventTable are EVENT_INDEX_T, which is a byte when NUM_EVENTS 
+ * is at most 255 and a WORD for larger tables. Loops over the table must use 
+ * EVENT_INDEX_T, rather than unsigned char, so that they end for either size. 
+ * NO_INDEX is all ones in either size so is never a valid row.
  *
  * BEWARE Concurrency: The functions which use the eventTable and hash/lookup must not be used
  * whilst there is a chance of the functions which modify the eventTable of RAM based 
@@ -118,7 +173,7 @@ extern void processEvent(unsigned char action, BYTE * msg);
  * Events are stored in the EventTable which consists of rows containing the following 
  * fields:
  * * EventTableFlags flags         1 byte
- * * BYTE next                     1 byte
+ * * EVENT_INDEX_T next            1 byte, 2 bytes if NUM_EVENTS > 255
  * * Event event                   4 bytes
  * * BYTE evs[EVENT_TABLE_WIDTH]   EVENT_TABLE_WIDTH bytes
  * 
@@ -199,7 +254,7 @@ extern void processEvent(unsigned char action, BYTE * msg);
  * 
  * To perform the speedy lookup of EVs given an Event a hash table can be used by 
  * defining HASH_TABLE. The hash table is stored in 
- * BYTE eventChains[HASH_LENGTH][CHAIN_LENGTH];
+ * EVENT_INDEX_T eventChains[HASH_LENGTH][CHAIN_LENGTH];
  * 
  * An event hashing function is provided BYTE getHash(nn, en) which should give 
  * a reasonable distribution of hash values given the typical events used.
@@ -210,6 +265,19 @@ extern void processEvent(unsigned char action, BYTE * msg);
  * and the index in the EventTable is then stored in the eventChains at the next 
  * available bucket position.
  * 
+ * After power up the tables are maintained incrementally as events are taught and 
+ * removed: hashInsert() and hashRemove() touch only the one chain affected and 
+ * writeEv() keeps the Happening lookup in step whenever EV#1 changes. The full 
+ * rebuild is only needed at power up or to recover from an inconsistency.
+ * 
+ * An event whose chain is already full is put in the small hashOverflow[] region
+ * along with its hash, which findEvent() checks after the chain, so a lookup never
+ * compares more than CHAIN_LENGTH+HASH_OVERFLOW_LENGTH entries. Should that also 
+ * be full the event is counted in hashSpilled and findEvent() falls back to a 
+ * linear search of the eventTable, so a taught event can always be found. 
+ * When a chain entry is removed an overflow entry with the same hash is moved 
+ * back into the chain.
+ * 
  * When an Event is received from CBUS and we need to find its index within the 
  * EventTable it is firstly hashed using getHash(nn,en), trimmed to HASH_LENGTH 
  * and this is used as the first index into eventChains[][]. We then step through 
@@ -250,7 +318,7 @@ rom near EventTable * eventTable = (rom near EventTable*)AT_EVENTS;
 #ifdef PRODUCED_EVENTS
 #pragma udata large_event_hash
 // the lookup table to find an EventTable entry by Happening
-BYTE happening2Event[NUM_HAPPENINGS];    // MIO: 64+8 bytes
+EVENT_INDEX_T happening2Event[NUM_HAPPENINGS];    // MIO: 64+8 bytes
 #endif
 // The hashtable to find the EventTable entry by Event.
 // This RAM hash table will probably be more than 256 bytes. With C18 this leads to
@@ -258,20 +326,173 @@ BYTE happening2Event[NUM_HAPPENINGS];    // MIO: 64+8 bytes
 //Error - section '.udata_events.o' can not fit the section. Section '.udata_events.o' length=0x000002c2
 //
 
-BYTE eventChains[HASH_LENGTH][CHAIN_LENGTH];    // MIO: 32*20 bytes = 640
+EVENT_INDEX_T eventChains[HASH_LENGTH][CHAIN_LENGTH];    // MIO: 32*20 bytes = 640
+#pragma udata 
+
+// Events which did not fit into their chain, kept packed from the start
+EVENT_INDEX_T hashOverflow[HASH_OVERFLOW_LENGTH];
+BYTE hashOverflowHash[HASH_OVERFLOW_LENGTH];
+
+WORD hashRebuildCount;      // Number of full rebuilds from flash, expected to stay at 1 after power up
+BYTE hashOverflowUsed;
+EVENT_INDEX_T hashSpilled;
+BYTE hashMaxProbe;
+WORD hashLinearCount;
+EVENT_INDEX_T hashEntries;
+BYTE hashChainsUsed;
+BYTE hashLongestChain;
+#endif
+
+#ifdef EVENT_BLOOM
+/*
+ * Bloom filter over the NN/EN of the taught events. Most events on the bus
+ * aren't taught so findEvent() checks this first and only looks in the 
+ * eventTable if both bits for the event are set. Bits can't be cleared when an
+ * event is removed as other events may share them, so removed events are 
+ * counted and the filter rebuilt once BLOOM_STALE_LIMIT have been removed.
+ */
+BYTE bloomBits[BLOOM_BYTES];
+BYTE bloomStale;            // Events removed since the last rebuild
+WORD bloomRejectCount;
+WORD bloomFalseCount;
+WORD bloomRebuildCount;
+#endif
+
+#ifdef EVENT_RAM_MIRROR
+/*
+ * A copy of the whole eventTable in RAM, for processors with RAM to spare. 
+ * All reads of the eventTable are served from here by readFlashBlock() so the
+ * single flash buffer isn't reloaded when an event's rows are in different 
+ * blocks or a write is pending. NUM_EVENTS*sizeof(EventTable) bytes are needed,
+ * with C18 this needs a large section in the linker script. The build fails if
+ * that is more than EVENT_MIRROR_MAX_RAM, which by default leaves 1K of the 
+ * processor's RAM for everything else.
+ */
+#ifndef EVENT_MIRROR_MAX_RAM
+#define EVENT_MIRROR_MAX_RAM    (RAM_SIZE - 1024)
+#endif
+// sizeof(EventTable), which the preprocessor can't evaluate
+#if NUM_EVENTS > 255
+#define EVENT_ROW_BYTES         (EVENT_TABLE_WIDTH + 6)
+#else
+#define EVENT_ROW_BYTES         (EVENT_TABLE_WIDTH + 5)
+#endif
+#if (NUM_EVENTS * EVENT_ROW_BYTES) > EVENT_MIRROR_MAX_RAM
+#error "EVENT_RAM_MIRROR needs more RAM than EVENT_MIRROR_MAX_RAM, reduce NUM_EVENTS or EVENT_TABLE_WIDTH"
+#endif
+#pragma udata large_event_mirror
+EventTable eventMirror[NUM_EVENTS];
 #pragma udata 
 #endif
 
+#ifdef EVENT_CACHE
+/*
+ * The results of the most recent lookups, including those which found nothing.
+ * Layout traffic repeats the same few events so findEvent() checks here 
+ * before anything else. Entries in use are kept packed from the start and are
+ * replaced in turn once all are used. Entries are removed when the event is
+ * added or removed so the cache never gives a stale answer.
+ */
+typedef struct {
+    WORD            nn;
+    WORD            en;
+    EVENT_INDEX_T   tableIndex;         // NO_INDEX if the event isn't taught
+} EventCacheEntry;
+
+EventCacheEntry eventCache[EVENT_CACHE_LEN];
+BYTE eventCacheUsed;
+BYTE eventCacheNext;        // Entry to be replaced next when full
+WORD eventCacheHitCount;
+WORD eventCacheMissCount;
+#endif
+
+#ifdef FREE_ROW_BITMAP
+/*
+ * One bit per eventTable row, set when the row is free. Lets a free row be
+ * found without reading the flags of every row from flash and gives the
+ * number of free rows for NNEVN directly. freeRowBytes has one bit per byte 
+ * of freeRows, set when that byte has a free row, so the lowest free row is
+ * found by looking at a few summary bytes rather than all of freeRows.
+ */
+BYTE freeRows[(NUM_EVENTS+7)/8];
+BYTE freeRowBytes[(sizeof(freeRows)+7)/8];
+EVENT_INDEX_T freeRowCount;
+
+// index of the lowest set bit in a nibble, 4 if none are set
+#ifdef __XC8__
+const BYTE ffsNibble[16] = {4,0,1,0,2,0,1,0,3,0,1,0,2,0,1,0};
+#else
+rom BYTE ffsNibble[16] = {4,0,1,0,2,0,1,0,3,0,1,0,2,0,1,0};
+#endif
+#endif
+
+#ifdef EVENT_COMPACT
+/*
+ * Compaction moves rows so that each row of an event is followed by the next 
+ * row of its chain, ideally all within one flash block, undoing the scatter 
+ * left by writeEv() adding continuation rows wherever there is space. 
+ * Moving a start row changes the event's index so the lookup tables are 
+ * updated and compaction is only done whilst not in learn mode.
+ */
+#define ROW_BLOCK(i)        (((WORD)(&(eventTable[i]))) & 0xFFC0)   // flash block holding the start of a row
+#define ROW_END_BLOCK(i)    (((WORD)(&(eventTable[i])) + sizeof(EventTable) - 1) & 0xFFC0)
+
+EventTable compactBuffer;   // row being moved
+EVENT_INDEX_T compactCursor; // next row to be examined
+BOOL compactNeeded;         // a row may be out of place
+BOOL compactClean;          // nothing has moved or changed since the cursor wrapped
+WORD compactMoveCount;
+#endif
+
 /**
  * eventsInit called during initialisation - initialises event support.
  * Called after power up to initialise RAM.
  */
 void eventsInit( void ) {
+#ifdef EVENT_COMPACT
+    BOOL recovered;
+#endif
+#ifdef EVENT_RAM_MIRROR
+    // first so that building the other indexes reads from RAM
+    setFlashMirror((BYTE*)eventMirror, (WORD)eventTable, NUM_EVENTS*sizeof(EventTable));
+#endif
+#ifdef EVENT_COMPACT
+    // before the indexes are built from the table
+    recovered = compactRecover();
+#endif
 #ifdef HASH_TABLE
     // nodeId must already to have been initialised. 
     // Therefore make sure cbusInit has already been called
     rebuildHashtable();
 #endif
+#ifdef EVENT_MPH
+    mphInit();
+#ifdef EVENT_COMPACT
+    if (recovered) {
+        mphInvalidate();    // the hash may refer to a row which has been freed
+    }
+#endif
+#endif
+#ifdef KEY_INDEX
+    keyIndexInit();
+#endif
+#ifdef FREE_ROW_BITMAP
+    freeRowsInit();
+#endif
+#ifdef EVENT_RANGES
+    rangeInit();
+#endif
+#ifdef EVENT_BLOOM
+    bloomRebuild();
+#endif
+#ifdef EVENT_CACHE
+    eventCacheClear();
+#endif
+#ifdef EVENT_COMPACT
+    compactCursor = 0;
+    compactNeeded = TRUE;
+    compactClean = FALSE;
+#endif
 } //eventsInit
 
 /**
@@ -280,7 +501,7 @@ void eventsInit( void ) {
  * @param tableIndex the index into eventtable to check
  * @return true if the specified index is the start of a linked set
  */
-BOOL validStart(unsigned char tableIndex) {
+BOOL validStart(EVENT_INDEX_T tableIndex) {
     EventTableFlags f;
 #ifdef SAFETY
     if (tableIndex >= NUM_EVENTS) return FALSE;
@@ -297,14 +518,32 @@ BOOL validStart(unsigned char tableIndex) {
  * Removes all events including default events.
  */
 void clearAllEvents(void) {
-    unsigned char tableIndex;
+    EVENT_INDEX_T tableIndex;
     for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
         // set the free flag
         writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), 0xff);
+#ifdef FREE_ROW_BITMAP
+        freeRowSet(tableIndex, TRUE);
+#endif
     }
     flushFlashImage();
 #ifdef HASH_TABLE
-    rebuildHashtable();
+    hashClear();
+#endif
+#ifdef EVENT_MPH
+    mphInvalidate();
+#endif
+#ifdef KEY_INDEX
+    keyIndexClear();
+#endif
+#ifdef EVENT_RANGES
+    rangeClear();
+#endif
+#ifdef EVENT_BLOOM
+    bloomClear();
+#endif
+#ifdef EVENT_CACHE
+    eventCacheClear();
 #endif
 }
 
@@ -315,8 +554,13 @@ void clearAllEvents(void) {
 void doNnevn(void) {
     //Pete's original code kept a counter in EEPROM but here I count the number
     // of unused slots.
-    unsigned char count = 0;
-    unsigned char i;
+    EVENT_INDEX_T count = 0;
+    BYTE msg[CBUS_MSG_LEN];
+    BYTE space;
+#ifdef FREE_ROW_BITMAP
+    count = freeRowCount;
+#else
+    EVENT_INDEX_T i;
     for (i=0; i<NUM_EVENTS; i++) {
         EventTableFlags f;
         f.asByte = readFlashBlock((WORD)(& (eventTable[i].flags.asByte)));
@@ -324,8 +568,13 @@ void doNnevn(void) {
             count++;
         }
     }
-    cbusMsg[d3] = count;
-    cbusSendOpcMyNN( 0, OPC_EVNLF, cbusMsg );
+#endif
+#if NUM_EVENTS > 255
+    space = (count > 255) ? 255 : count;    // the response only has room for a byte
+#else
+    space = count;
+#endif
+    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_EVNLF, MY_NN, &space));
 } // doNnevn
 
 #ifdef TIMED_RESPONSE
@@ -338,27 +587,37 @@ void doNerd(void) {
     timedResponseStep = 0;
 }
 #else
+#define NERD_BATCH_LEN  4   // Responses queued for sending together
+
 /**
  * Handle a NERD request by returning a response for each event.
- * 
+ * Responses are sent in batches so the transmit queue is only taken once per batch.
  */
 void doNerd(void) {
-    unsigned char tableIndex;
-    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
-        // if its not free and not a continuation then it is start of an event
-        if (validStart(tableIndex)) {
-            WORD n = getNN(tableIndex);
-            cbusMsg[d3] = n >> 8;
-            cbusMsg[d4] = n & 0xFF;
+    EVENT_INDEX_T tableIndex = 0;
+    CanPacket msgs[NERD_BATCH_LEN];
+    BYTE count, sent;
+    while (tableIndex<NUM_EVENTS) {
+        count = 0;
+        for ( ; (tableIndex<NUM_EVENTS) && (count<NERD_BATCH_LEN); tableIndex++) {
+            // if its not free and not a continuation then it is start of an event
+            if (validStart(tableIndex)) {
+                BYTE *msg = msgs[count++].buffer;
+                WORD n = getNN(tableIndex);
+                msg[d3] = n >> 8;
+                msg[d4] = n & 0xFF;
             
-            n = getEN(tableIndex);
-            cbusMsg[d5] = n >> 8;
-            cbusMsg[d6] = n & 0xFF;
+                n = getEN(tableIndex);
+                msg[d5] = n >> 8;
+                msg[d6] = n & 0xFF;
             
-            cbusMsg[d7] = tableIndexToEvtIdx(tableIndex); 
-            while ( !cbusSendOpcMyNN( 0, OPC_ENRSP, cbusMsg ))
-                ;   // Busy wait trying to send
-        }   
+                msg[d7] = tableIndexToEvtIdx(tableIndex); 
+                cbusMakeMsgNN(msg, OPC_ENRSP, MY_NN, NULL);
+            }   
+        }
+        sent = 0;
+        while (sent < count)
+            sent += cbusSendBatch( 0, msgs+sent, count-sent);   // Busy wait until the whole batch is queued
     }
 } // doNerd
 #endif
@@ -369,8 +628,9 @@ void doNerd(void) {
  * @param index index into event table
  */
 void doNenrd(unsigned char index) {
-    unsigned char tableIndex;
+    EVENT_INDEX_T tableIndex;
     WORD n;
+    BYTE msg[CBUS_MSG_LEN];
     
     tableIndex = evtIdxToTableIndex(index);
     // check this is a valid index
@@ -382,15 +642,15 @@ void doNenrd(unsigned char index) {
         return;
     }
     n = getNN(tableIndex);
-    cbusMsg[d3] = n >> 8;
-    cbusMsg[d4] = n & 0xFF;
+    msg[d3] = n >> 8;
+    msg[d4] = n & 0xFF;
             
     n = getEN(tableIndex);
-    cbusMsg[d5] = n >> 8;
-    cbusMsg[d6] = n & 0xFF;
+    msg[d5] = n >> 8;
+    msg[d6] = n & 0xFF;
             
-    cbusMsg[d7] = index; 
-    cbusSendOpcMyNN( 0, OPC_ENRSP, cbusMsg );
+    msg[d7] = index; 
+    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_ENRSP, MY_NN, NULL));
 
 } // doNenrd
 
@@ -402,15 +662,21 @@ void doNenrd(unsigned char index) {
 void doRqevn(void) {
     //Pete's original code kept a counter in EEPROM but here I count the number
     // of used slots.
-    unsigned char count = 0;
-    unsigned char i;
+    EVENT_INDEX_T count = 0;
+    EVENT_INDEX_T i;
+    BYTE msg[CBUS_MSG_LEN];
+    BYTE events;
     for (i=0; i<NUM_EVENTS; i++) {
         if (validStart(i)) {
             count++;    
         }
     }
-    cbusMsg[d3] = count;
-    cbusSendOpcMyNN( 0, OPC_NUMEV, cbusMsg );
+#if NUM_EVENTS > 255
+    events = (count > 255) ? 255 : count;   // the response only has room for a byte
+#else
+    events = count;
+#endif
+    cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_NUMEV, MY_NN, &events));
 } // doRqevn
 
 
@@ -424,25 +690,45 @@ void doRqevn(void) {
  */
 unsigned char removeEvent(WORD nodeNumber, WORD eventNumber) {
     // need to delete this action from the Event table. 
-    unsigned char tableIndex = findEvent(nodeNumber, eventNumber);
+    EVENT_INDEX_T tableIndex = findEvent(nodeNumber, eventNumber);
     if (tableIndex == NO_INDEX) return CMDERR_INV_EV_IDX; // not found
     // found the event to delete
     return removeTableEntry(tableIndex);
 }
 
-unsigned char removeTableEntry(unsigned char tableIndex) {
+unsigned char removeTableEntry(EVENT_INDEX_T tableIndex) {
     EventTableFlags f;
 
 #ifdef SAFETY
     if (tableIndex >= NUM_EVENTS) return CMDERR_INV_EV_IDX;
 #endif
     if (validStart(tableIndex)) {
+#ifdef HASH_TABLE
+        // must be done whilst the NN/EN of the entry can still be read
+        BOOL reindex = hashRemove(tableIndex) && hashSpilled;
+#endif
+#ifdef EVENT_MPH
+        mphInvalidate();
+#endif
+#ifdef KEY_INDEX
+        keyIndexRemove(tableIndex);
+#endif
+#ifdef EVENT_RANGES
+        rangeRemoveRow(tableIndex);
+#endif
+#ifdef EVENT_CACHE
+        eventCacheRemoveRow(tableIndex);
+#endif
+        // read the flags before they are overwritten by the free flag
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
         // set the free flag
         writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), 0xff);
+#ifdef FREE_ROW_BITMAP
+        freeRowSet(tableIndex, TRUE);
+#endif
         // Now follow the next pointer
-        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
         while (f.continued) {
-            tableIndex = readFlashBlock((WORD)(& eventTable[tableIndex].next));
+            tableIndex = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
             f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
         
             if (tableIndex >= NUM_EVENTS) return CMDERR_INV_EV_IDX; // shouldn't be necessary
@@ -452,12 +738,25 @@ unsigned char removeTableEntry(unsigned char tableIndex) {
                     
             // set the free flag
             writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), 0xff);
+#ifdef FREE_ROW_BITMAP
+            freeRowSet(tableIndex, TRUE);
+#endif
         
         }
         flushFlashImage();
+#ifdef EVENT_COMPACT
+        // the freed rows may let other chains be closed up
+        compactNeeded = TRUE;
+        compactClean = FALSE;
+#endif
 #ifdef HASH_TABLE
-        // easier to rebuild from scratch
-        rebuildHashtable();
+        if (reindex) {
+            // room has been made for an event which didn't fit
+            rebuildHashtable();
+        }
+#endif
+#ifdef EVENT_BLOOM
+        bloomRemoved();
 #endif
     }
     return 0;
@@ -477,8 +776,7 @@ unsigned char removeTableEntry(unsigned char tableIndex) {
  * @return error number or 0 for success
  */
 unsigned char addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal, BOOL forceOwnNN) {
-    unsigned char tableIndex;
-    unsigned char error;
+    EVENT_INDEX_T tableIndex;
     // do we currently have an event
     tableIndex = findEvent(nodeNumber, eventNumber);
     if (tableIndex == NO_INDEX) {
@@ -490,34 +788,46 @@ unsigned char addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal
         if (evVal == EV_FILL) {
             return 0;
         }
-        error = 1;
+#ifdef KEY_INDEX
+        // the key index uses 0xFFFF:0xFFFF to mark its unused entries
+        if ((nodeNumber == 0xFFFF) && (eventNumber == 0xFFFF)) {
+            return CMDERR_INVALID_EVENT;
+        }
+#endif
         // didn't find the event so find an empty slot and create one
-        for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        tableIndex = findFreeRow();
+        if (tableIndex == NO_INDEX) {
+            return CMDERR_TOO_MANY_EVENTS;
+        } else {
             EventTableFlags f;
-            f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
-            if (f.freeEntry) {
-                unsigned char e;
-                // found a free slot, initialise it
-                setFlashWord((WORD*)&(eventTable[tableIndex].event.NN), nodeNumber);
-                setFlashWord((WORD*)&(eventTable[tableIndex].event.EN), eventNumber);
+            unsigned char e;
+#ifdef EVENT_MPH
+            mphInvalidate();
+#endif
+            // found a free slot, initialise it
+            setFlashWord((WORD*)&(eventTable[tableIndex].event.NN), nodeNumber);
+            setFlashWord((WORD*)&(eventTable[tableIndex].event.EN), eventNumber);
             
-                f.asByte = 0;
-                f.forceOwnNN = forceOwnNN;
-                writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), f.asByte);
+            f.asByte = 0;
+            f.forceOwnNN = forceOwnNN;
+            writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), f.asByte);
             
-                for (e = 0; e < EVENT_TABLE_WIDTH; e++) {
-                    writeFlashByte((BYTE*)&(eventTable[tableIndex].evs[e]), EV_FILL);
-                }
-                flushFlashImage();
+            for (e = 0; e < EVENT_TABLE_WIDTH; e++) {
+                writeFlashByte((BYTE*)&(eventTable[tableIndex].evs[e]), EV_FILL);
+            }
+            flushFlashImage();
 #ifdef HASH_TABLE
-                rebuildHashtable();
+            hashInsert(tableIndex);
+#endif
+#ifdef KEY_INDEX
+            keyIndexInsert(tableIndex);
+#endif
+#ifdef EVENT_BLOOM
+            bloomAdd(getNN(tableIndex), eventNumber);
+#endif
+#ifdef EVENT_CACHE
+            eventCacheRemoveMisses(eventNumber);
 #endif
-                error = 0;
-                break;
-            }
-        }
-        if (error) {
-            return CMDERR_TOO_MANY_EVENTS;
         }
     }
  
@@ -527,9 +837,6 @@ unsigned char addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal
     }
     // success
     flushFlashImage();
-#ifdef HASH_TABLE
-    rebuildHashtable();
-#endif
     return 0;
 }
 
@@ -540,22 +847,107 @@ unsigned char addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal
  * @param eventNumber
  * @return index into eventTable or NO_INDEX if not present
  */
-unsigned char findEvent(WORD nodeNumber, WORD eventNumber) {
+EVENT_INDEX_T findEvent(WORD nodeNumber, WORD eventNumber) {
+#if defined(EVENT_BLOOM) || defined(EVENT_CACHE)
+    EVENT_INDEX_T tableIndex;
+#ifdef EVENT_CACHE
+    unsigned char i;
+    
+    for (i=0; i<eventCacheUsed; i++) {
+        if ((eventCache[i].en == eventNumber) && (eventCache[i].nn == nodeNumber)) {
+            eventCacheHitCount++;
+            return eventCache[i].tableIndex;
+        }
+    }
+    eventCacheMissCount++;
+#endif
+#ifdef EVENT_BLOOM
+    if ( ! bloomMayContain(nodeNumber, eventNumber)) {
+        // as cheap as the cache so don't use a cache entry for it
+        bloomRejectCount++;
+        return NO_INDEX;
+    }
+    tableIndex = findEventIndexed(nodeNumber, eventNumber);
+    if (tableIndex == NO_INDEX) {
+        bloomFalseCount++;
+    }
+#else
+    tableIndex = findEventIndexed(nodeNumber, eventNumber);
+#endif
+#ifdef EVENT_CACHE
+    eventCachePut(nodeNumber, eventNumber, tableIndex);
+#endif
+    return tableIndex;
+}
+
+/**
+ * Find an event using whichever index is configured, once the lookup cache 
+ * and Bloom filter have been checked.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @return index into eventTable or NO_INDEX if not present
+ */
+EVENT_INDEX_T findEventIndexed(WORD nodeNumber, WORD eventNumber) {
+#endif
 #ifdef HASH_TABLE
     unsigned char hash = getHash(nodeNumber, eventNumber);
     unsigned char chainIdx;
+    EVENT_INDEX_T tableIndex;
+    BYTE probes = 0;
+    
     for (chainIdx=0; chainIdx<CHAIN_LENGTH; chainIdx++) {
-        unsigned char tableIndex = eventChains[hash][chainIdx];
-        WORD nn, en;
-        if (tableIndex == NO_INDEX) return NO_INDEX;
-        nn = getNN(tableIndex);
-        en = getEN(tableIndex);
-        if ((nn == nodeNumber) && (en == eventNumber)) {
-            return tableIndex;
+        tableIndex = eventChains[hash][chainIdx];
+        if (tableIndex == NO_INDEX) break;
+        probes++;
+        if ((getNN(tableIndex) == nodeNumber) && (getEN(tableIndex) == eventNumber)) {
+            break;
+        }
+    }
+    if ((tableIndex == NO_INDEX) || (chainIdx >= CHAIN_LENGTH)) {
+        // not in the chain, try the overflow region
+        tableIndex = NO_INDEX;
+        for (chainIdx=0; (chainIdx<HASH_OVERFLOW_LENGTH) && (hashOverflow[chainIdx] != NO_INDEX); chainIdx++) {
+            if (hashOverflowHash[chainIdx] == hash) {
+                probes++;
+                if ((getNN(hashOverflow[chainIdx]) == nodeNumber) && (getEN(hashOverflow[chainIdx]) == eventNumber)) {
+                    tableIndex = hashOverflow[chainIdx];
+                    break;
+                }
+            }
         }
     }
+    if (probes > hashMaxProbe) {
+        hashMaxProbe = probes;
+    }
+    if ((tableIndex == NO_INDEX) && hashSpilled) {
+        hashLinearCount++;
+        tableIndex = findEventLinear(nodeNumber, eventNumber);
+    }
+    return tableIndex;
+#else
+#ifdef EVENT_MPH
+    if (eventMphValid) {
+        return mphFindEvent(nodeNumber, eventNumber);
+    }
+#endif
+#ifdef KEY_INDEX
+    return keyIndexFind(nodeNumber, eventNumber);
 #else
-    unsigned char tableIndex;
+    return findEventLinear(nodeNumber, eventNumber);
+#endif
+#endif
+}
+
+/**
+ * Find an event by searching the whole eventTable.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @return index into eventTable or NO_INDEX if not present
+ */
+EVENT_INDEX_T findEventLinear(WORD nodeNumber, WORD eventNumber) {
+    EVENT_INDEX_T tableIndex;
     for (tableIndex=0; tableIndex < NUM_EVENTS; tableIndex++) {
         EventTableFlags f;
         f.asByte = readFlashBlock((WORD)(& eventTable[tableIndex].flags));
@@ -568,10 +960,125 @@ unsigned char findEvent(WORD nodeNumber, WORD eventNumber) {
             }
         }
     }
+    return NO_INDEX;
+}
+
+/**
+ * Find a free row in the eventTable and, if the free row bitmap is in use,
+ * mark it as used. The caller must initialise the row.
+ * With the bitmap a row within the flash block currently held in the write 
+ * buffer is preferred so that extending an event does not cause another 
+ * block to be erased and written.
+ * 
+ * @return index into eventTable or NO_INDEX if the table is full
+ */
+EVENT_INDEX_T findFreeRow(void) {
+    EVENT_INDEX_T tableIndex;
+#ifdef FREE_ROW_BITMAP
+    EVENT_INDEX_T i;
+    BYTE b;
+    WORD base;
+    
+    if (freeRowCount == 0) return NO_INDEX;
+    // try the rows in the currently loaded flash block first
+    base = (WORD)eventTable;
+    if ((flashblock < base + NUM_EVENTS*sizeof(EventTable)) && (flashblock + 64 > base)) {
+        EVENT_INDEX_T last;
+        tableIndex = (flashblock > base) ? (flashblock - base)/sizeof(EventTable) : 0;
+        last = (flashblock + 63 - base)/sizeof(EventTable);
+        if (last >= NUM_EVENTS) last = NUM_EVENTS-1;
+        for (; tableIndex <= last; tableIndex++) {
+            if (freeRows[tableIndex>>3] & (1 << (tableIndex & 7))) {
+                freeRowSet(tableIndex, FALSE);
+                return tableIndex;
+            }
+        }
+    }
+    // otherwise the lowest free row, through the summary of non-empty bytes
+    for (i=0; i<sizeof(freeRowBytes); i++) {
+        b = freeRowBytes[i];
+        if (b) {
+            i = (i<<3) + lowestBit(b);      // the first byte of freeRows with a free row
+            tableIndex = (i<<3) + lowestBit(freeRows[i]);
+            freeRowSet(tableIndex, FALSE);
+            return tableIndex;
+        }
+    }
+#else
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        EventTableFlags f;
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if (f.freeEntry) {
+            return tableIndex;
+        }
+    }
 #endif
     return NO_INDEX;
 }
 
+#ifdef FREE_ROW_BITMAP
+/**
+ * Build the free row bitmap from the flags in the eventTable.
+ */
+void freeRowsInit(void) {
+    EVENT_INDEX_T tableIndex;
+    for (tableIndex=0; tableIndex<sizeof(freeRows); tableIndex++) {
+        freeRows[tableIndex] = 0;
+    }
+    for (tableIndex=0; tableIndex<sizeof(freeRowBytes); tableIndex++) {
+        freeRowBytes[tableIndex] = 0;
+    }
+    freeRowCount = 0;
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        EventTableFlags f;
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if (f.freeEntry) {
+            freeRowSet(tableIndex, TRUE);
+        }
+    }
+}
+
+/**
+ * Mark a row as free or used in the free row bitmap, keeping the count of 
+ * free rows and the summary of bytes with a free row.
+ * 
+ * @param tableIndex the index into the eventTable
+ * @param isFree TRUE if the row is now free
+ */
+void freeRowSet(EVENT_INDEX_T tableIndex, BOOL isFree) {
+    BYTE mask = 1 << (tableIndex & 7);
+    BYTE * p = &freeRows[tableIndex>>3];
+    BYTE byteMask = 1 << ((tableIndex>>3) & 7);
+    BYTE * s = &freeRowBytes[tableIndex>>6];
+    if (isFree) {
+        if ( ! (*p & mask)) {
+            *p |= mask;
+            *s |= byteMask;
+            freeRowCount++;
+        }
+    } else {
+        if (*p & mask) {
+            *p &= ~mask;
+            if ( ! *p) {
+                *s &= ~byteMask;
+            }
+            freeRowCount--;
+        }
+    }
+}
+
+/**
+ * @param b a byte with at least one bit set
+ * @return the index of the lowest set bit
+ */
+BYTE lowestBit(BYTE b) {
+    if (b & 0x0F) {
+        return ffsNibble[b & 0x0F];
+    }
+    return 4 + ffsNibble[b >> 4];
+}
+#endif
+
 /**
  * Write an EV value to an event.
  * 
@@ -580,21 +1087,24 @@ unsigned char findEvent(WORD nodeNumber, WORD eventNumber) {
  * @param evVal
  * @return 0 if success otherwise the error
  */
-unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal) {
+unsigned char writeEv(EVENT_INDEX_T tableIndex, BYTE evNum, BYTE evVal) {
     EventTableFlags f;
-    unsigned char startIndex = tableIndex;
+    EVENT_INDEX_T startIndex = tableIndex;
+#if defined(HASH_TABLE) && defined(PRODUCED_EVENTS)
+    BYTE startEvNum = evNum;
+#endif
     if (evNum >= EVperEVT) {
         return CMDERR_INV_EV_IDX;
     }
     while (evNum >= EVENT_TABLE_WIDTH) {
-        unsigned char nextIdx;
+        EVENT_INDEX_T nextIdx;
         
         // skip forward looking for the right chained table entry
         evNum -= EVENT_TABLE_WIDTH;
         f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
         
         if (f.continued) {
-            tableIndex = readFlashBlock((WORD)(&(eventTable[tableIndex].next)));
+            tableIndex = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
             if (tableIndex == NO_INDEX) {
                 return CMDERR_INVALID_EVENT;
             }
@@ -609,30 +1119,31 @@ unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal) {
                 return 0;
             }
             // find the next free entry
-            for (nextIdx = tableIndex+1 ; nextIdx < NUM_EVENTS; nextIdx++) {
-                EventTableFlags nextF;
-                nextF.asByte = readFlashBlock((WORD)(&(eventTable[nextIdx].flags.asByte)));
-                if (nextF.freeEntry) {
-                    unsigned char e;
-                     // found a free slot, initialise it
-                    setFlashWord((WORD*)&(eventTable[nextIdx].event.NN), 0xffff); // this field not used
-                    setFlashWord((WORD*)&(eventTable[nextIdx].event.EN), 0xffff); // this field not used
-                    writeFlashByte((BYTE*)&(eventTable[nextIdx].flags.asByte), 0x20);    // set continuation flag, clear free and numEV to 0
-                    for (e = 0; e < EVENT_TABLE_WIDTH; e++) {
-                        writeFlashByte((BYTE*)&(eventTable[nextIdx].evs[e]), EV_FILL); // clear the EVs
-                    }
-                    // set the next of the previous in chain
-                    writeFlashByte((BYTE*)&(eventTable[tableIndex].next), nextIdx);
-                    // set the continued flag
-                    f.continued = 1;
-                    writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), f.asByte);
-                    tableIndex = nextIdx;
-                    break;
-                }
-            }
+            nextIdx = findFreeRow();
             if (nextIdx >= NUM_EVENTS) {
                 // ran out of table entries
                 return CMDERR_TOO_MANY_EVENTS;
+            } else {
+                unsigned char e;
+                 // found a free slot, initialise it
+                setFlashWord((WORD*)&(eventTable[nextIdx].event.NN), 0xffff); // this field not used
+                setFlashWord((WORD*)&(eventTable[nextIdx].event.EN), 0xffff); // this field not used
+                writeFlashByte((BYTE*)&(eventTable[nextIdx].flags.asByte), 0x20);    // set continuation flag, clear free and numEV to 0
+                for (e = 0; e < EVENT_TABLE_WIDTH; e++) {
+                    writeFlashByte((BYTE*)&(eventTable[nextIdx].evs[e]), EV_FILL); // clear the EVs
+                }
+                // set the next of the previous in chain
+                setFlashIndex(&(eventTable[tableIndex].next), nextIdx);
+                // set the continued flag
+                f.continued = 1;
+                writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), f.asByte);
+#ifdef EVENT_COMPACT
+                if (nextIdx != tableIndex+1) {
+                    compactNeeded = TRUE;
+                    compactClean = FALSE;
+                }
+#endif
+                tableIndex = nextIdx;
             }
         } 
     }
@@ -644,6 +1155,12 @@ unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal) {
         f.eVsUsed = evNum+1;
         writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), f.asByte);
     }
+#if defined(HASH_TABLE) && defined(PRODUCED_EVENTS)
+    if (startEvNum == 0) {
+        // EV#1 is the produced Happening
+        happeningMap(startIndex, evVal);
+    }
+#endif
     // If we are deleting then see if we can remove all
     if (evVal == EV_FILL) {
         checkRemoveTableEntry(startIndex);
@@ -658,7 +1175,7 @@ unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal) {
  * @param evNum ev number starts at 0 (produced)
  * @return the ev value or -error code if error
  */
-int getEv(unsigned char tableIndex, unsigned char evNum) {
+int getEv(EVENT_INDEX_T tableIndex, unsigned char evNum) {
     EventTableFlags f;
     if ( ! validStart(tableIndex)) {
         // not a valid start
@@ -673,7 +1190,7 @@ int getEv(unsigned char tableIndex, unsigned char evNum) {
         if (! f.continued) {
             return -CMDERR_NO_EV;
         }
-        tableIndex = readFlashBlock((WORD)(&(eventTable[tableIndex].next)));
+        tableIndex = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
         if (tableIndex == NO_INDEX) {
             return -CMDERR_INVALID_EVENT;
         }
@@ -693,7 +1210,7 @@ int getEv(unsigned char tableIndex, unsigned char evNum) {
  * @param tableIndex the index of the start of an event
  * @return the number of EVs
  */
-BYTE numEv(unsigned char tableIndex) {
+BYTE numEv(EVENT_INDEX_T tableIndex) {
     EventTableFlags f;
     BYTE num=0;
     if ( ! validStart(tableIndex)) {
@@ -702,7 +1219,7 @@ BYTE numEv(unsigned char tableIndex) {
     }
     f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
     while (f.continued) {
-        tableIndex = readFlashBlock((WORD)(&(eventTable[tableIndex].next)));
+        tableIndex = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
         if (tableIndex == NO_INDEX) {
             return 0;
         }
@@ -715,12 +1232,14 @@ BYTE numEv(unsigned char tableIndex) {
 
 /**
  * Return all the EV values for an event. EVs are put into the global evs array.
+ * This reads every EV, padding with EV_FILL, so evIterStart()/evIterNext() are 
+ * quicker where the EVs can be looked at one at a time.
  * 
  * @param tableIndex the index of the start of an event
  * @return the error code or 0 for no error
  */
 BYTE evs[EVperEVT];
-BYTE getEVs(unsigned char tableIndex) {
+BYTE getEVs(EVENT_INDEX_T tableIndex) {
     EventTableFlags f;
     unsigned char evNum;
     
@@ -741,7 +1260,7 @@ BYTE getEVs(unsigned char tableIndex) {
             }
             return 0;
         }
-        tableIndex = readFlashBlock((WORD)(&(eventTable[tableIndex].next)));
+        tableIndex = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
         if (tableIndex == NO_INDEX) {
             return CMDERR_INVALID_EVENT;
         }
@@ -750,55 +1269,221 @@ BYTE getEVs(unsigned char tableIndex) {
 }
 
 /**
- * Return the NN for an event.
- * Getter so that the application code can obtain information about the event.
- * 
- * @param tableIndex the index of the start of an event
- * @return the Node Number
+ * Read the flags of the row an EV iterator has moved to.
+ * @param it the iterator
  */
-WORD getNN(unsigned char tableIndex) {
-    WORD hi;
-    WORD lo;
+void evIterRow(EvIterator * it) {
     EventTableFlags f;
     
-    f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
-    if (f.forceOwnNN) {
-        return nodeID;
+    f.asByte = readFlashBlock((WORD)(&(eventTable[it->tableIndex].flags.asByte)));
+    it->pos = 0;
+    if (f.continued) {
+        it->used = EVENT_TABLE_WIDTH;
+        it->next = readFlashIndex((WORD)(&(eventTable[it->tableIndex].next)));
+    } else {
+        it->used = f.eVsUsed;
+        it->next = NO_INDEX;
     }
-    lo=readFlashBlock((WORD)(&(eventTable[tableIndex].event.NN)));
-    hi = readFlashBlock((WORD)(&(eventTable[tableIndex].event.NN))+1);
-    return lo | (hi << 8);
 }
 
 /**
- * Return the EN for an event.
- * Getter so that the application code can obtain information about the event.
+ * Start working through the EVs of an event in place, without copying them 
+ * to evs[]. Only the EVs up to the last one used are returned so the caller
+ * can stop as soon as it has what it needs:
  * 
+ *     EvIterator it;
+ *     int ev;
+ *     if (evIterStart(&it, tableIndex)) {
+ *         while ((ev = evIterNext(&it)) >= 0) {
+ *             ... EV number it.evNum has value ev
+ *         }
+ *     }
+ * 
+ * @param it the iterator to set up
  * @param tableIndex the index of the start of an event
- * @return the Event Number
+ * @return FALSE if tableIndex is not the start of an event
  */
-WORD getEN(unsigned char tableIndex) {
-    WORD hi;
-    WORD lo;
-    
-    lo=readFlashBlock((WORD)(&(eventTable[tableIndex].event.EN)));
-    hi = readFlashBlock((WORD)(&(eventTable[tableIndex].event.EN))+1);
-    return lo | (hi << 8);
-
+BOOL evIterStart(EvIterator * it, EVENT_INDEX_T tableIndex) {
+    if ( ! validStart(tableIndex)) {
+        return FALSE;
+    }
+    it->tableIndex = tableIndex;
+    it->evNum = 0xFF;
+    evIterRow(it);
+    return TRUE;
 }
 
 /**
- * This Consumes a CBUS event if it has been provisioned.
+ * Get the next EV of an event. EVs within the used range which have not been
+ * set are returned as EV_FILL.
  * 
- * @param msg
- * @return 
+ * @param it the iterator
+ * @return the EV value, with its number in it->evNum, or -1 if there are no more
  */
-BOOL parseCbusEvent(BYTE * msg) {
-    WORD nodeNumber;
-    WORD eventNumber;
-    unsigned char tableIndex;
-    
-    if (msg[d0] & EVENT_SHORT_MASK) {
+int evIterNext(EvIterator * it) {
+    while (it->pos >= it->used) {
+        if (it->next >= NUM_EVENTS) {
+            return -1;
+        }
+        it->tableIndex = it->next;
+        evIterRow(it);
+    }
+    if (++(it->evNum) >= EVperEVT) {
+        return -1;
+    }
+    return readFlashBlock((WORD)(&(eventTable[it->tableIndex].evs[it->pos++])));
+}
+
+/**
+ * Check whether any event uses the forceOwnNN flag. Only these events change when 
+ * the node number changes so indexes need not be rebuilt if there are none.
+ * 
+ * @return TRUE if there is at least one forceOwnNN event
+ */
+BOOL hasOwnNNEvents(void) {
+    EVENT_INDEX_T tableIndex;
+    EventTableFlags f;
+    
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        if (validStart(tableIndex)) {
+            f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+            if (f.forceOwnNN) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Return the NN for an event.
+ * Getter so that the application code can obtain information about the event.
+ * 
+ * @param tableIndex the index of the start of an event
+ * @return the Node Number
+ */
+WORD getNN(EVENT_INDEX_T tableIndex) {
+    WORD hi;
+    WORD lo;
+    EventTableFlags f;
+    
+    f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+    if (f.forceOwnNN) {
+        return nodeID;
+    }
+    lo=readFlashBlock((WORD)(&(eventTable[tableIndex].event.NN)));
+    hi = readFlashBlock((WORD)(&(eventTable[tableIndex].event.NN))+1);
+    return lo | (hi << 8);
+}
+
+/**
+ * Return the EN for an event.
+ * Getter so that the application code can obtain information about the event.
+ * 
+ * @param tableIndex the index of the start of an event
+ * @return the Event Number
+ */
+WORD getEN(EVENT_INDEX_T tableIndex) {
+    WORD hi;
+    WORD lo;
+    
+    lo=readFlashBlock((WORD)(&(eventTable[tableIndex].event.EN)));
+    hi = readFlashBlock((WORD)(&(eventTable[tableIndex].event.EN))+1);
+    return lo | (hi << 8);
+
+}
+
+#ifdef LOOPBACK_DIRECT
+/*
+ * Loopback of self produced events.
+ * 
+ * Rather than every event we send being copied back into the CAN receive FIFO
+ * to come round again through parseCbusEvent(), the event is looked up once when
+ * it is sent. Only if this module also consumes it is it put in a small queue,
+ * with its table index, for loopbackDispatch() to pass to processEvent(). The
+ * dispatch is deferred rather than made directly so that events sent from within
+ * processEvent() do not recurse.
+ */
+BYTE    loopbackQueue[LOOPBACK_QUEUE_LEN][8];
+EVENT_INDEX_T loopbackIndex[LOOPBACK_QUEUE_LEN];
+BYTE    loopbackCount = 0;
+WORD    loopbackSkipCount;
+
+/**
+ * Loop back an event that we have just sent.
+ * 
+ * @param msg the event message that was sent
+ * @return FALSE if the event is consumed but the queue is full, so the caller should loop it back another way
+ */
+BOOL loopbackEvent(BYTE *msg) {
+    WORD nodeNumber;
+    WORD eventNumber;
+    EVENT_INDEX_T tableIndex;
+    unsigned char i;
+    
+    if (msg[d0] & EVENT_SHORT_MASK) {
+        nodeNumber = 0;
+    } else {
+        nodeNumber = ((WORD)msg[d1] << 8) | msg[d2];
+    }
+    eventNumber = ((WORD)msg[d3] << 8) | msg[d4];
+    tableIndex = findEvent(nodeNumber, eventNumber);
+#ifdef EVENT_RANGES
+    if (tableIndex == NO_INDEX) {
+        tableIndex = rangeFindEvent(nodeNumber, eventNumber);
+    }
+#endif
+    if (tableIndex == NO_INDEX) {
+        loopbackSkipCount++;
+        return TRUE;
+    }
+    if (loopbackCount >= LOOPBACK_QUEUE_LEN) {
+        return FALSE;
+    }
+    for (i=0; i<8; i++) {
+        loopbackQueue[loopbackCount][i] = msg[d0+i];
+    }
+    loopbackIndex[loopbackCount++] = tableIndex;
+    return TRUE;
+}
+
+/**
+ * Process any looped back events. Called from cbusMsgReceived().
+ */
+void loopbackDispatch(void) {
+    BYTE msg[CBUS_MSG_LEN];
+    unsigned char i, j;
+    unsigned char n = loopbackCount;
+    
+    for (i=0; i<n; i++) {
+        for (j=0; j<8; j++) {
+            msg[d0+j] = loopbackQueue[i][j];
+        }
+        processEvent(loopbackIndex[i], msg);
+    }
+    // Keep any events sent by processEvent() for next time
+    for (i=n; i<loopbackCount; i++) {
+        for (j=0; j<8; j++) {
+            loopbackQueue[i-n][j] = loopbackQueue[i][j];
+        }
+        loopbackIndex[i-n] = loopbackIndex[i];
+    }
+    loopbackCount -= n;
+}
+#endif
+
+/**
+ * This Consumes a CBUS event if it has been provisioned.
+ * 
+ * @param msg
+ * @return 
+ */
+BOOL parseCbusEvent(BYTE * msg) {
+    WORD nodeNumber;
+    WORD eventNumber;
+    EVENT_INDEX_T tableIndex;
+    
+    if (msg[d0] & EVENT_SHORT_MASK) {
         nodeNumber = 0;
     } else {
         nodeNumber = msg[d1];
@@ -810,6 +1495,12 @@ BOOL parseCbusEvent(BYTE * msg) {
     eventNumber = eventNumber << 8;
     eventNumber |= msg[d4];
     tableIndex = findEvent(nodeNumber, eventNumber);
+#ifdef EVENT_RANGES
+    if (tableIndex == NO_INDEX) {
+        // no exact match, maybe it is within a range
+        tableIndex = rangeFindEvent(nodeNumber, eventNumber);
+    }
+#endif
     if (tableIndex != NO_INDEX) {
         processEvent(tableIndex, msg);
         return TRUE;
@@ -830,17 +1521,24 @@ BOOL parseCbusEvent(BYTE * msg) {
  * @param evtIdx
  * @return an index into eventTable
  */
-BYTE evtIdxToTableIndex(BYTE evtIdx) {
+EVENT_INDEX_T evtIdxToTableIndex(BYTE evtIdx) {
     return evtIdx-1;
 }
 
 /**
  * Convert an internal tableIndex into a CBUS EvtIdx.
+ * EvtIdx is a byte so with a large eventTable the rows after the first 254 
+ * have no EvtIdx and their events can only be read and taught by NN/EN.
  * 
  * @param tableIndex index into the eventTable
- * @return an CBUS EvtIdx
+ * @return an CBUS EvtIdx, 0 if the row can't be given one
  */
-BYTE tableIndexToEvtIdx(BYTE tableIndex) {
+BYTE tableIndexToEvtIdx(EVENT_INDEX_T tableIndex) {
+#if NUM_EVENTS > 255
+    if (tableIndex >= 255) {
+        return 0;
+    }
+#endif
     return tableIndex+1;
 }
 
@@ -850,15 +1548,13 @@ BYTE tableIndexToEvtIdx(BYTE tableIndex) {
  * 
  * @param tableIndex
  */
-void checkRemoveTableEntry(unsigned char tableIndex) {
-    unsigned char e;
+void checkRemoveTableEntry(EVENT_INDEX_T tableIndex) {
+    EvIterator it;
+    int ev;
     
-    if ( validStart(tableIndex)) {
-        if (getEVs(tableIndex)) {
-            return;
-        }
-        for (e=0; e<EVperEVT; e++) {
-            if (evs[e] != EV_FILL) {
+    if (evIterStart(&it, tableIndex)) {
+        while ((ev = evIterNext(&it)) >= 0) {
+            if (ev != EV_FILL) {
                 return;
             }
         }
@@ -895,17 +1591,13 @@ void checkRemoveTableEntry(unsigned char tableIndex) {
 }
  
 /**
- * Initialise the RAM hash chain for reverse lookup of event to action. Uses the
- * data from the Flash Event2Action table.
+ * Empty both RAM lookup tables. Used when the whole eventTable has been cleared
+ * so there is no need to scan the flash.
  */
-void rebuildHashtable(void) {
-    // invalidate the current hash table
+void hashClear(void) {
     unsigned char hash;
     unsigned char chainIdx;
-    unsigned char tableIndex;
-    int a;
 #ifdef PRODUCED_EVENTS
-    // first initialise to nothing
     HAPPENING_T happening;
     for (happening=0; happening<NUM_HAPPENINGS; happening++) {
         happening2Event[happening] = NO_INDEX;
@@ -916,12 +1608,238 @@ void rebuildHashtable(void) {
             eventChains[hash][chainIdx] = NO_INDEX;
         }
     }
+    for (chainIdx=0; chainIdx < HASH_OVERFLOW_LENGTH; chainIdx++) {
+        hashOverflow[chainIdx] = NO_INDEX;
+    }
+    hashOverflowUsed = 0;
+    hashSpilled = 0;
+}
+
+/**
+ * Add an eventTable entry to the end of its hash chain, or to the overflow 
+ * region if the chain is full. 
+ * The NN/EN of the entry must already be in the eventTable.
+ * @param tableIndex the first entry of the event
+ */
+void hashInsert(EVENT_INDEX_T tableIndex) {
+    unsigned char hash;
+    unsigned char chainIdx;
+    
+    hash = getHash(getNN(tableIndex), getEN(tableIndex));
+    for (chainIdx=0; chainIdx<CHAIN_LENGTH; chainIdx++) {
+        if (eventChains[hash][chainIdx] == NO_INDEX) {
+            // available
+            eventChains[hash][chainIdx] = tableIndex;
+            return;
+        }
+    }
+    if (hashOverflowUsed < HASH_OVERFLOW_LENGTH) {
+        hashOverflow[hashOverflowUsed] = tableIndex;
+        hashOverflowHash[hashOverflowUsed] = hash;
+        hashOverflowUsed++;
+    } else {
+        // findEvent will have to search the eventTable
+        hashSpilled++;
+    }
+}
+
+/**
+ * Remove an eventTable entry from the specified hash chain, or from the overflow
+ * region. The rest of the chain is moved down as findEvent() stops at the first 
+ * unused bucket and the freed bucket is refilled from the overflow region.
+ * @param hash the chain
+ * @param tableIndex the first entry of the event
+ * @return FALSE if the event had spilled out of the hash table
+ */
+BOOL hashChainRemove(unsigned char hash, EVENT_INDEX_T tableIndex) {
+    unsigned char chainIdx;
+    unsigned char o;
+    
+    for (chainIdx=0; chainIdx<CHAIN_LENGTH; chainIdx++) {
+        if (eventChains[hash][chainIdx] == tableIndex) {
+            for ( ; chainIdx<CHAIN_LENGTH-1; chainIdx++) {
+                eventChains[hash][chainIdx] = eventChains[hash][chainIdx+1];
+            }
+            eventChains[hash][CHAIN_LENGTH-1] = NO_INDEX;
+            // an overflow entry for this chain can now move into it
+            for (o=0; o<hashOverflowUsed; o++) {
+                if (hashOverflowHash[o] == hash) {
+                    eventChains[hash][CHAIN_LENGTH-1] = hashOverflow[o];
+                    break;
+                }
+            }
+            if (o >= hashOverflowUsed) {
+                return TRUE;
+            }
+            tableIndex = hashOverflow[o];
+            break;
+        }
+    }
+    // remove from the overflow region, keeping it packed
+    for (o=0; o<hashOverflowUsed; o++) {
+        if (hashOverflow[o] == tableIndex) {
+            hashOverflowUsed--;
+            for ( ; o<hashOverflowUsed; o++) {
+                hashOverflow[o] = hashOverflow[o+1];
+                hashOverflowHash[o] = hashOverflowHash[o+1];
+            }
+            hashOverflow[hashOverflowUsed] = NO_INDEX;
+            return TRUE;
+        }
+    }
+    if (hashSpilled) {
+        hashSpilled--;
+    }
+    return FALSE;
+}
+
+/**
+ * Update the hash table occupancy diagnostics. Only the RAM tables are read.
+ */
+void hashStats(void) {
+    unsigned char hash;
+    unsigned char chainIdx;
+    
+    hashEntries = 0;
+    hashChainsUsed = 0;
+    hashLongestChain = 0;
+    for (hash=0; hash<HASH_LENGTH; hash++) {
+        for (chainIdx=0; (chainIdx<CHAIN_LENGTH) && (eventChains[hash][chainIdx] != NO_INDEX); chainIdx++)
+            ;
+        hashEntries += chainIdx;
+        if (chainIdx) {
+            hashChainsUsed++;
+        }
+        if (chainIdx > hashLongestChain) {
+            hashLongestChain = chainIdx;
+        }
+    }
+}
+
+#ifdef EVENT_COMPACT
+/**
+ * Change the index of an event in both lookup tables when its start row has
+ * been moved, keeping its place in the hash chain.
+ * @param from the old first entry of the event
+ * @param to the new first entry, already holding the NN/EN
+ */
+void hashMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to) {
+    unsigned char hash;
+    unsigned char i;
+#ifdef PRODUCED_EVENTS
+    int happening;
+#endif
+    
+    hash = getHash(getNN(to), getEN(to));
+    for (i=0; i<CHAIN_LENGTH; i++) {
+        if (eventChains[hash][i] == from) {
+            eventChains[hash][i] = to;
+        }
+    }
+    for (i=0; i<hashOverflowUsed; i++) {
+        if (hashOverflow[i] == from) {
+            hashOverflow[i] = to;
+        }
+    }
+#ifdef PRODUCED_EVENTS
+    // the new index may change which event is used for the Happening
+    happeningUnmap(from);
+    happening = getEv(to, 0);
+    if (happening >= 0) {
+        happeningMap(to, (BYTE)happening);
+    }
+#endif
+}
+#endif
+
+/**
+ * Remove an event from both lookup tables. Must be called before the entry 
+ * is freed as the NN/EN are needed to find the chain.
+ * @param tableIndex the first entry of the event
+ * @return FALSE if the event had spilled out of the hash table
+ */
+BOOL hashRemove(EVENT_INDEX_T tableIndex) {
+#ifdef PRODUCED_EVENTS
+    happeningUnmap(tableIndex);
+#endif
+    return hashChainRemove(getHash(getNN(tableIndex), getEN(tableIndex)), tableIndex);
+}
+
+#ifdef PRODUCED_EVENTS
+/**
+ * Update the Happening lookup after EV#1 of an event has been written.
+ * When several events produce the same Happening the one with the highest 
+ * tableIndex is used, as rebuildHashtable() and happeningRescan() do.
+ * @param tableIndex the first entry of the event
+ * @param happening the new EV#1 value
+ */
+void happeningMap(EVENT_INDEX_T tableIndex, BYTE happening) {
+    BOOL inRange = (happening >= HAPPENING_BASE) && (happening-HAPPENING_BASE < NUM_HAPPENINGS);
+    EVENT_INDEX_T current;
+    
+    if (inRange && (happening2Event[happening-HAPPENING_BASE] == tableIndex)) {
+        return;     // unchanged
+    }
+    happeningUnmap(tableIndex);
+    if (inRange) {
+        current = happening2Event[happening-HAPPENING_BASE];
+        if ((current == NO_INDEX) || (tableIndex > current)) {
+            happening2Event[happening-HAPPENING_BASE] = tableIndex;
+        }
+    }
+}
+
+/**
+ * Remove an event from the Happening lookup. If another event also produces 
+ * the same Happening then that one takes over, as it would after a rebuild.
+ * @param tableIndex the first entry of the event
+ */
+void happeningUnmap(EVENT_INDEX_T tableIndex) {
+    HAPPENING_T happening;
+    
+    for (happening=0; happening<NUM_HAPPENINGS; happening++) {
+        if (happening2Event[happening] == tableIndex) {
+            happening2Event[happening] = happeningRescan(happening+HAPPENING_BASE, tableIndex);
+        }
+    }
+}
+
+/**
+ * Find the last event, other than the one specified, which produces a Happening.
+ * @param happening the Happening
+ * @param skip the eventTable entry to ignore
+ * @return the first entry of the event or NO_INDEX
+ */
+EVENT_INDEX_T happeningRescan(BYTE happening, EVENT_INDEX_T skip) {
+    EVENT_INDEX_T tableIndex;
+    
+    for (tableIndex=NUM_EVENTS; tableIndex-- > 0; ) {
+        if ((tableIndex != skip) && (getEv(tableIndex, 0) == happening)) {
+            return tableIndex;
+        }
+    }
+    return NO_INDEX;
+}
+#endif
+
+/**
+ * Initialise the RAM hash chain for reverse lookup of event to action. Uses the
+ * data from the Flash Event2Action table.
+ * Only needed at power up or to recover, normal changes are made incrementally.
+ */
+void rebuildHashtable(void) {
+    EVENT_INDEX_T tableIndex;
+    int a;
+#ifdef PRODUCED_EVENTS
+    HAPPENING_T happening;
+#endif
+    hashRebuildCount++;
+    // invalidate the current hash table
+    hashClear();
     // now scan the event2Action table and populate the hash and lookup tables
     
     for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
         if (validStart(tableIndex)) {
-            unsigned char e;
-    
             // found the start of an event definition
 #ifdef PRODUCED_EVENTS
             // ev[0] is used to store the Produced event's action
@@ -933,18 +1851,453 @@ void rebuildHashtable(void) {
                 }
             }
 #endif
-            hash = getHash(getNN(tableIndex), getEN(tableIndex));
-                
-            for (chainIdx=0; chainIdx<CHAIN_LENGTH; chainIdx++) {
-                if (eventChains[hash][chainIdx] == NO_INDEX) {
-                    // available
-                    eventChains[hash][chainIdx] = tableIndex;
+            hashInsert(tableIndex);
+        }
+    }
+}
+
+/**
+ * Move the events which use the module's own NN (forceOwnNN) to their new 
+ * hash chains after the NN has been changed.
+ * @param oldNN the NN the hash table was built with
+ */
+void rehashOwnEvents(WORD oldNN) {
+    EVENT_INDEX_T tableIndex;
+    EventTableFlags f;
+    
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        if (validStart(tableIndex)) {
+            f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+            if (f.forceOwnNN) {
+                hashChainRemove(getHash(oldNN, getEN(tableIndex)), tableIndex);
+                hashInsert(tableIndex);
+            }
+        }
+    }
+    if (hashSpilled) {
+        // chains may have been emptied which events that didn't fit could use
+        rebuildHashtable();
+    }
+}
+
+#endif
+
+#ifdef EVENT_BLOOM
+/**
+ * Work out the two filter bits for an event.
+ * The second index is taken from a further multiply so that the two bits are 
+ * independent.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @param idx returns the two bit numbers
+ */
+void bloomIndexes(WORD nodeNumber, WORD eventNumber, WORD * idx) {
+    WORD h = nodeNumber * 0x2F6B;
+    
+    h = (h ^ eventNumber) * 0x9E37;
+    idx[0] = (h >> 7) & (BLOOM_BYTES*8 - 1);
+    h = (h ^ (h >> 8)) * 0x6F4B;
+    idx[1] = (h >> 7) & (BLOOM_BYTES*8 - 1);
+}
+
+/**
+ * Empty the filter.
+ */
+void bloomClear(void) {
+    unsigned char i;
+    for (i=0; i<BLOOM_BYTES; i++) {
+        bloomBits[i] = 0;
+    }
+    bloomStale = 0;
+}
+
+/**
+ * Add an event to the filter.
+ * @param nodeNumber
+ * @param eventNumber
+ */
+void bloomAdd(WORD nodeNumber, WORD eventNumber) {
+    WORD idx[2];
+    
+    bloomIndexes(nodeNumber, eventNumber, idx);
+    bloomBits[idx[0] >> 3] |= 1 << (idx[0] & 7);
+    bloomBits[idx[1] >> 3] |= 1 << (idx[1] & 7);
+}
+
+/**
+ * Check the filter for an event.
+ * @param nodeNumber
+ * @param eventNumber
+ * @return FALSE if the event is definitely not taught
+ */
+BOOL bloomMayContain(WORD nodeNumber, WORD eventNumber) {
+    WORD idx[2];
+    
+    bloomIndexes(nodeNumber, eventNumber, idx);
+    return (bloomBits[idx[0] >> 3] & (1 << (idx[0] & 7))) 
+        && (bloomBits[idx[1] >> 3] & (1 << (idx[1] & 7)));
+}
+
+/**
+ * Called when an event has been removed. Its bits remain set so once enough
+ * events have gone the filter is rebuilt to stop it passing more and more 
+ * events which aren't taught.
+ */
+void bloomRemoved(void) {
+    if (++bloomStale >= BLOOM_STALE_LIMIT) {
+        bloomRebuild();
+    }
+}
+
+/**
+ * Rebuild the filter from the eventTable. Called at power up and when the NN
+ * changes, as that changes the NN of forceOwnNN events.
+ */
+void bloomRebuild(void) {
+    EVENT_INDEX_T tableIndex;
+    
+    bloomRebuildCount++;
+    bloomClear();
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        if (validStart(tableIndex)) {
+            bloomAdd(getNN(tableIndex), getEN(tableIndex));
+        }
+    }
+}
+#endif
+
+#ifdef EVENT_CACHE
+/**
+ * Forget all cached lookups. Called at power up, when all events are cleared
+ * and when the NN changes, as that changes the NN of forceOwnNN events.
+ */
+void eventCacheClear(void) {
+    eventCacheUsed = 0;
+    eventCacheNext = 0;
+}
+
+/**
+ * Remember the result of a lookup.
+ * @param nodeNumber
+ * @param eventNumber
+ * @param tableIndex the index found or NO_INDEX
+ */
+void eventCachePut(WORD nodeNumber, WORD eventNumber, EVENT_INDEX_T tableIndex) {
+    unsigned char i;
+    
+    if (eventCacheUsed < EVENT_CACHE_LEN) {
+        i = eventCacheUsed++;
+    } else {
+        i = eventCacheNext;
+        if (++eventCacheNext >= EVENT_CACHE_LEN) {
+            eventCacheNext = 0;
+        }
+    }
+    eventCache[i].nn = nodeNumber;
+    eventCache[i].en = eventNumber;
+    eventCache[i].tableIndex = tableIndex;
+}
+
+/**
+ * Remove an entry, moving the last entry in use into its place.
+ * @param i the entry to remove
+ */
+void eventCacheDrop(unsigned char i) {
+    eventCacheUsed--;
+    eventCache[i] = eventCache[eventCacheUsed];
+    if (eventCacheNext > eventCacheUsed) {
+        eventCacheNext = 0;
+    }
+}
+
+/**
+ * Forget lookups which found an event which is being removed.
+ * @param tableIndex the index of the event
+ */
+void eventCacheRemoveRow(EVENT_INDEX_T tableIndex) {
+    unsigned char i = 0;
+    
+    while (i < eventCacheUsed) {
+        if (eventCache[i].tableIndex == tableIndex) {
+            eventCacheDrop(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+/**
+ * Forget lookups which found nothing for an EN which has just been taught.
+ * Any NN is matched as a forceOwnNN event may have been looked up by a 
+ * different NN to the one it is stored with.
+ * @param eventNumber the EN of the new event
+ */
+void eventCacheRemoveMisses(WORD eventNumber) {
+    unsigned char i = 0;
+    
+    while (i < eventCacheUsed) {
+        if ((eventCache[i].tableIndex == NO_INDEX) && (eventCache[i].en == eventNumber)) {
+            eventCacheDrop(i);
+        } else {
+            i++;
+        }
+    }
+}
+#endif
+
+#ifdef EVENT_COMPACT
+/**
+ * Do one step of event table compaction. Called regularly when the module is
+ * not being taught. At most COMPACT_SCAN_ROWS rows are examined and at most
+ * one row is moved so the time taken and the number of flash blocks written 
+ * by each call are bounded. Once a complete pass has found nothing to do no 
+ * more work is done until the table is changed.
+ * 
+ * @return TRUE if a row was moved
+ */
+BOOL compactStep(void) {
+    unsigned char n;
+    
+    if ( ! compactNeeded) return FALSE;
+    for (n=0; n<COMPACT_SCAN_ROWS; n++) {
+        if (compactRow(compactCursor)) {
+            // stay with this event until all of its chain is in place
+            compactMoveCount++;
+            compactClean = FALSE;
+            return TRUE;
+        }
+        compactCursor++;
+        if (compactCursor >= NUM_EVENTS) {
+            compactCursor = 0;
+            if (compactClean) {
+                compactNeeded = FALSE;
+                return FALSE;
+            }
+            compactClean = TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Check that the rows of an event follow one another and, if not, move one
+ * row towards that. If the row after the first gap is free the successor is
+ * moved into it. Otherwise the start row is moved to the beginning of a run of
+ * free rows long enough for the whole chain, preferably within one flash block,
+ * and the continuation rows follow it in the next steps. Only free rows are 
+ * written so events which are already in place are never disturbed.
+ * 
+ * @param tableIndex the row to be checked, sets compactCursor to the new 
+ * index if the start row is moved
+ * @return TRUE if a row was moved
+ */
+BOOL compactRow(EVENT_INDEX_T tableIndex) {
+    EventTableFlags f;
+    EVENT_INDEX_T startIndex = tableIndex;
+    EVENT_INDEX_T nextIdx;
+    unsigned char rows = 1;
+    EVENT_INDEX_T run;
+    
+    if ( ! validStart(tableIndex)) return FALSE;
+    // follow the chain whilst it is contiguous
+    for (;;) {
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if ( ! f.continued) return FALSE;
+        nextIdx = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
+        if (nextIdx >= NUM_EVENTS) return FALSE;
+        if (nextIdx != tableIndex+1) break;
+        tableIndex = nextIdx;
+        rows++;
+    }
+    if (tableIndex+1 < NUM_EVENTS) {
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex+1].flags.asByte)));
+        if (f.freeEntry) {
+#ifdef FREE_ROW_BITMAP
+            freeRowSet(tableIndex+1, FALSE);
+#endif
+            compactMoveRow(nextIdx, tableIndex+1, tableIndex);
+            return TRUE;
+        }
+    }
+    // count the rest of the chain
+    do {
+        rows++;
+        f.asByte = readFlashBlock((WORD)(&(eventTable[nextIdx].flags.asByte)));
+        if ( ! f.continued) break;
+        nextIdx = readFlashIndex((WORD)(&(eventTable[nextIdx].next)));
+    } while (nextIdx < NUM_EVENTS);
+    run = compactFindRun(rows);
+    if (run == NO_INDEX) return FALSE;
+#ifdef FREE_ROW_BITMAP
+    freeRowSet(run, FALSE);
+#endif
+    compactMoveRow(startIndex, run, NO_INDEX);
+    compactCursor = run;
+    return TRUE;
+}
+
+/**
+ * Find a run of free rows, preferring one which lies within a single flash 
+ * block so that the event can be read without reloading the flash buffer.
+ * 
+ * @param rows the number of rows needed
+ * @return the first row of the run or NO_INDEX if there isn't one
+ */
+EVENT_INDEX_T compactFindRun(unsigned char rows) {
+    EventTableFlags f;
+    EVENT_INDEX_T tableIndex;
+    EVENT_INDEX_T count = 0;
+    EVENT_INDEX_T start;
+    EVENT_INDEX_T found = NO_INDEX;
+    
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if ( ! f.freeEntry) {
+            count = 0;
+            continue;
+        }
+        count++;
+        if (count >= rows) {
+            start = tableIndex+1-rows;
+            if (ROW_BLOCK(start) == ROW_END_BLOCK(tableIndex)) {
+                return start;
+            }
+            if (found == NO_INDEX) {
+                found = start;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Move a row to a free row. A continuation row is relinked from its 
+ * predecessor. A start row changes the event's index so the lookup tables are
+ * updated, the rest of its chain stays where it is until moved by later steps.
+ * The copy is written before anything refers to it and the old row is freed 
+ * last. Only the start of a chain is ever moved, a single row event is 
+ * already in place, and it is marked as a continuation straight after the 
+ * copy is written. An interruption can therefore leave two identical starts 
+ * which continue with the same row, or a continuation row which nothing refers
+ * to, and compactRecover() tidies up both at the next power up.
+ * 
+ * @param from the row to be moved
+ * @param to a free row, already marked as used in the free row bitmap
+ * @param prev the row whose next is from, NO_INDEX if from is a start row
+ */
+void compactMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to, EVENT_INDEX_T prev) {
+    unsigned char i;
+    EventTableFlags f;
+    
+    for (i=0; i<sizeof(EventTable); i++) {
+        ((BYTE*)&compactBuffer)[i] = readFlashBlock((WORD)(&(eventTable[from]))+i);
+    }
+    // the flags go last so that a row split across two flash blocks isn't in use until complete
+    setFlashBuffer(((BYTE*)&(eventTable[to]))+1, ((BYTE*)&compactBuffer)+1, sizeof(EventTable)-1);
+    writeFlashByte((BYTE*)&(eventTable[to].flags.asByte), compactBuffer.flags.asByte);
+    if (prev != NO_INDEX) {
+        setFlashIndex(&(eventTable[prev].next), to);
+    } else {
+        // from stops being a start before the lookup tables are changed
+        f.asByte = compactBuffer.flags.asByte;
+        f.continuation = 1;
+        writeFlashByte((BYTE*)&(eventTable[from].flags.asByte), f.asByte);
+#ifdef HASH_TABLE
+        hashMoveRow(from, to);
+#endif
+#ifdef EVENT_MPH
+        mphMoveRow(from, to);
+#endif
+#ifdef KEY_INDEX
+        keyIndexMoveRow(from, to);
+#endif
+#ifdef EVENT_RANGES
+        rangeMoveRow(from, to);
+#endif
+#ifdef EVENT_CACHE
+        eventCacheRemoveRow(from);
+#endif
+    }
+    writeFlashByte((BYTE*)&(eventTable[from].flags.asByte), 0xff);
+#ifdef FREE_ROW_BITMAP
+    freeRowSet(from, TRUE);
+#endif
+}
+
+/**
+ * Tidy up after a compaction step, or a new continuation row, which was 
+ * interrupted by a power failure. Where two identical starts continue with the
+ * same row the later one is freed. Then continuation rows which no row refers
+ * to, such as the old start of a moved chain or a new continuation row which 
+ * was never linked, are freed. Called from eventsInit() before the lookup 
+ * tables are built. Needs 
+ * about NUM_EVENTS/8 bytes of local variables.
+ * 
+ * @return TRUE if any row was freed
+ */
+BOOL compactRecover(void) {
+    BYTE    linked[(NUM_EVENTS+7)/8];   // rows which another row refers to
+    EVENT_INDEX_T tableIndex;
+    EVENT_INDEX_T other;
+    EVENT_INDEX_T nextIdx;
+    EventTableFlags f;
+    BOOL    changed = FALSE;
+    
+    for (tableIndex=0; tableIndex<sizeof(linked); tableIndex++) {
+        linked[tableIndex] = 0;
+    }
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if (f.freeEntry) continue;
+        nextIdx = readFlashIndex((WORD)(&(eventTable[tableIndex].next)));
+        if (nextIdx >= NUM_EVENTS) continue;
+        if ( ! f.continued) continue;
+        if (linked[nextIdx>>3] & (1<<(nextIdx&7))) {
+            // two rows continue with the same row, find the other one
+            for (other=0; other<tableIndex; other++) {
+                f.asByte = readFlashBlock((WORD)(&(eventTable[other].flags.asByte)));
+                if (( ! f.freeEntry) && f.continued 
+                        && (readFlashIndex((WORD)(&(eventTable[other].next))) == nextIdx)) {
                     break;
                 }
             }
+            if (validStart(tableIndex) && validStart(other) && compactSameRow(tableIndex, other)) {
+                writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), 0xff);
+                changed = TRUE;
+            }
         }
+        linked[nextIdx>>3] |= (1<<(nextIdx&7));
     }
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
+        if (( ! f.freeEntry) && f.continuation && ! (linked[tableIndex>>3] & (1<<(tableIndex&7)))) {
+            writeFlashByte((BYTE*)&(eventTable[tableIndex].flags.asByte), 0xff);
+            changed = TRUE;
+        }
+    }
+    return changed;
 }
 
+/**
+ * Compare two rows apart from their next index.
+ * 
+ * @param a a row
+ * @param b another row
+ * @return TRUE if the flags, event and EVs are the same
+ */
+BOOL compactSameRow(EVENT_INDEX_T a, EVENT_INDEX_T b) {
+    unsigned char i;
+    
+    for (i=0; i<sizeof(EventTable); i++) {
+        if ((i < (WORD)(&(eventTable[0].next)) - (WORD)(&(eventTable[0]))) 
+                || (i >= (WORD)(&(eventTable[0].next)) - (WORD)(&(eventTable[0])) + sizeof(EVENT_INDEX_T))) {
+            if (readFlashBlock((WORD)(&(eventTable[a]))+i) != readFlashBlock((WORD)(&(eventTable[b]))+i)) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
 #endif
 
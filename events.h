@@ -3,6 +3,7 @@
 
 #include "FliM.h"
 #include "module.h"
+#include "eventindex.h"
 /*
 
  Copyright (C) Pete Brownlow 2014-2017   software@upsys.co.uk
@@ -73,6 +74,7 @@ events.h - Definitions for CBUS event handling module - Part of CBUS libraries f
  * event's actions and to produce actions using the application's actions.
  *
  */
+
 // A helper structure to store the details of an event.
 typedef struct {
     WORD NN;
@@ -95,11 +97,23 @@ typedef union
 
 typedef struct {
     EventTableFlags flags;          // put first so could potentially use the Event bytes for EVs in subsequent rows.
-    BYTE next;                      // index to continuation also indicates if entry is free
+    EVENT_INDEX_T next;             // index to continuation also indicates if entry is free
     Event event;                    // the NN and EN
     BYTE evs[EVENT_TABLE_WIDTH];    // EVENT_TABLE_WIDTH is maximum of 15 as we have 4 bits of maxEvUsed
 } EventTable;
 
+/*
+ * Position when working through the EVs of an event with evIterStart() and 
+ * evIterNext().
+ */
+typedef struct {
+    EVENT_INDEX_T tableIndex;       // current row of the event
+    EVENT_INDEX_T next;             // following row or NO_INDEX
+    BYTE    used;                   // EVs used in the current row
+    BYTE    pos;                    // next EV within the current row
+    BYTE    evNum;                  // EV number of the EV last returned, starting at 0
+} EvIterator;
+
 
 // EVENT DECODING
 //    An event opcode has bits 4 and 7 set, bits 1 and 2 clear
@@ -137,7 +151,12 @@ typedef struct {
 #define     EVENT_SHORT_MASK 0b00001000
 
 #define EV_FILL             0
-#define NO_INDEX            0xff
+
+#ifdef HASH_TABLE
+#ifndef HASH_OVERFLOW_LENGTH
+#define HASH_OVERFLOW_LENGTH    8       // Events which did not fit in their hash chain, may be set in module.h
+#endif
+#endif
 
 // Function prototypes for event management
 
@@ -147,18 +166,21 @@ extern void clearAction2Event(void);
 extern void clearChainTable(void);
 extern void eventsInit(void);
 extern void doEvlrn(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal);
-extern BYTE numEv(unsigned char tableIndex);
-extern int getEv(unsigned char tableIndex, unsigned char evNum);
-extern unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal);
-extern BYTE getEVs(unsigned char tableIndex);
+extern BYTE numEv(EVENT_INDEX_T tableIndex);
+extern int getEv(EVENT_INDEX_T tableIndex, unsigned char evNum);
+extern unsigned char writeEv(EVENT_INDEX_T tableIndex, BYTE evNum, BYTE evVal);
+extern BYTE getEVs(EVENT_INDEX_T tableIndex);
+extern BOOL evIterStart(EvIterator * it, EVENT_INDEX_T tableIndex);
+extern int evIterNext(EvIterator * it);
 extern unsigned char addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal, BOOL forceOwnNN);
 extern unsigned char removeEvent(WORD nodeNumber, WORD eventNumber);
-extern unsigned char writeEv(unsigned char tableIndex, BYTE evNum, BYTE evVal);
-extern WORD getNN(unsigned char tableIndex);
-extern WORD getEN(unsigned char tableIndex);
-extern BOOL validStart(unsigned char tableIndex);
-extern void checkRemoveTableEntry(unsigned char tableIndex);
-extern BYTE tableIndexToEvtIdx(BYTE tableIndex);
+extern unsigned char writeEv(EVENT_INDEX_T tableIndex, BYTE evNum, BYTE evVal);
+extern WORD getNN(EVENT_INDEX_T tableIndex);
+extern BOOL hasOwnNNEvents(void);
+extern WORD getEN(EVENT_INDEX_T tableIndex);
+extern BOOL validStart(EVENT_INDEX_T tableIndex);
+extern void checkRemoveTableEntry(EVENT_INDEX_T tableIndex);
+extern BYTE tableIndexToEvtIdx(EVENT_INDEX_T tableIndex);
 
 extern rom near EventTable * eventTable;
 extern Event producedEvent;
@@ -169,7 +191,7 @@ extern BYTE evs[EVperEVT];
 void 	doNnclr(void);
 void 	doNnevn(void);
 void 	doNerd(void);
-void    doNenrd(unsigned char tableIndex);
+void    doNenrd(unsigned char index);
 void 	doRqevn(void);
 void	doEvuln(WORD nodeNumber, WORD eventNumber);
 void 	doReval(BYTE tableIndex, BYTE evNum);
@@ -177,15 +199,78 @@ void 	doReqev(WORD nodeNumber, WORD eventNumber, BYTE evNum);
 void 	doEvlrn(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal);
 void 	doEvlrni(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal);
 
-BYTE    findEvent( WORD eventNode, WORD eventNum);
+EVENT_INDEX_T findEvent( WORD eventNode, WORD eventNum);
 BYTE    findEventContinuation(BYTE eventIndex);
 
 BYTE    eventHash( BYTE nodeByte, BYTE eventBYTE );
 
 BOOL    parseCbusEvent( BYTE *msg );
 
+#ifdef LOOPBACK_DIRECT
+#define LOOPBACK_QUEUE_LEN  2           // Self produced events waiting to be consumed
+
+extern  WORD    loopbackSkipCount;      // Self produced events not consumed by this module, so not looped back
+
+BOOL    loopbackEvent( BYTE *msg );
+void    loopbackDispatch( void );
+#endif
+
 #ifdef HASH_TABLE
+extern WORD hashRebuildCount;
+
+// Diagnostic variables for the hash table
+extern BYTE hashOverflowUsed;           // Events currently in the overflow region
+extern EVENT_INDEX_T hashSpilled;       // Events in neither chain nor overflow, found by linear search
+extern BYTE hashMaxProbe;               // Most table entries compared by a single findEvent
+extern WORD hashLinearCount;            // Lookups which needed the linear search
+extern EVENT_INDEX_T hashEntries;       // Set by hashStats: events in the chains
+extern BYTE hashChainsUsed;             // Set by hashStats: chains with at least one event
+extern BYTE hashLongestChain;           // Set by hashStats: events in the fullest chain
+
 extern void rebuildHashtable(void);
+extern void rehashOwnEvents(WORD oldNN);
+extern void hashStats(void);
+#endif
+
+#ifdef EVENT_BLOOM
+#ifndef BLOOM_BYTES
+#define BLOOM_BYTES         64      // Size of the filter, must be a power of 2, may be set in module.h
+#endif
+#if BLOOM_BYTES > 64
+#error "BLOOM_BYTES must be no more than 64, bloomIndexes() only has 9 bits of hash for each index"
+#endif
+#ifndef BLOOM_STALE_LIMIT
+#define BLOOM_STALE_LIMIT   16      // Events removed before the filter is rebuilt, may be set in module.h
+#endif
+
+// Diagnostic variables for the Bloom filter
+extern WORD bloomRejectCount;           // Lookups answered by the filter without reading flash
+extern WORD bloomFalseCount;            // Lookups passed by the filter for events which aren't taught
+extern WORD bloomRebuildCount;
+
+extern void bloomRebuild(void);
+#endif
+
+#ifdef EVENT_CACHE
+#ifndef EVENT_CACHE_LEN
+#define EVENT_CACHE_LEN     8       // Recent lookups remembered, may be set in module.h
+#endif
+
+// Diagnostic variables for the lookup cache
+extern WORD eventCacheHitCount;         // Lookups answered from the cache
+extern WORD eventCacheMissCount;
+
+extern void eventCacheClear(void);
+#endif
+
+#ifdef EVENT_COMPACT
+#ifndef COMPACT_SCAN_ROWS
+#define COMPACT_SCAN_ROWS   16      // Rows examined by each compaction step, may be set in module.h
+#endif
+
+extern WORD compactMoveCount;           // Rows moved by compaction
+
+extern BOOL compactStep(void);
 #endif
 
 
@@ -0,0 +1,419 @@
+/*
+
+ GridConnect encoding and decoding of CAN frames - part of CBUS libraries for PIC 18F
+ Used by the serial, USB and TCP transports to carry CBUS frames as ASCII text.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * GridConnect codec.
+ * 
+ * Converts between the CanPacket layout used by can18.c and GridConnect text. 
+ * 
+ * The decoder is a state machine fed from a byte buffer. It stops as soon as a frame
+ * is complete, or when the input runs out in which case the next call carries on 
+ * from the same place, so frames may be split across any number of buffers (eg: TCP
+ * segments or UART interrupts). The frame is decoded directly into the caller's packet
+ * which must be the same for every call until GC_FRAME is returned. 
+ * A ':' always starts a new frame, so after any corruption the decoder resynchronises 
+ * at the start of the next frame having lost at most the frame that was corrupted.
+ * 
+ * The encoder can either produce a whole frame in one go (gcEncodeFrame) or be
+ * used as a stream (gcEncode) that fills whatever space the caller has and resumes
+ * from the same point next time.
+ * 
+ * All character conversion is done by table lookup: one table gives the class of each
+ * received character (hex digit value or frame syntax character) and another gives
+ * the hex character for each nibble.
+ */
+
+#include "devincs.h"
+#include "GenericTypeDefs.h"
+#include "gridconnect.h"
+
+#ifdef __XC8__
+#define GC_ROM  const
+#else
+#define GC_ROM  const rom
+#endif
+
+// Decoder states
+
+enum GcStates {
+    gcIdle=0,       // Waiting for ':'
+    gcType,         // Waiting for 'S' or 'X'
+    gcId,           // Receiving id hex digits
+    gcRtr,          // Waiting for 'N' or 'R'
+    gcData          // Receiving data hex digits or ';'
+};
+
+// Character classes - values 0 to 15 are hex digits
+
+#define GC_SOF      0x10    // ':'
+#define GC_EOF      0x11    // ';'
+#define GC_STD      0x12    // 'S'
+#define GC_EXT      0x13    // 'X'
+#define GC_NORM     0x14    // 'N'
+#define GC_RTR      0x15    // 'R'
+#define GC_BAD      0xFF
+
+GC_ROM BYTE gcCharClass[128] = {
+    GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x00
+    GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x10
+    GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x20
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, GC_SOF, GC_EOF, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x30
+    GC_BAD, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_NORM, GC_BAD,    // 0x40
+    GC_BAD, GC_BAD, GC_RTR, GC_STD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_EXT, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x50
+    GC_BAD, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x60
+    GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD, GC_BAD,    // 0x70
+};
+
+GC_ROM BYTE gcHexChars[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
+
+// Internal routine definitions
+
+BYTE gcFrameLen(CanPacket *pkt);
+BYTE gcEncodeChar(CanPacket *pkt, BYTE pos, BYTE len);
+
+
+/**
+ * Initialise a decoder, ready for the start of a frame.
+ * 
+ * @param dec the decoder state
+ */
+void gcDecoderInit(GcDecoder *dec)
+{
+    dec->state = gcIdle;
+    dec->errors = 0;
+}
+
+
+/**
+ * Decode GridConnect text into a CAN packet. 
+ * Stops at the end of a frame or when the input has all been used.
+ * 
+ * @param dec the decoder state
+ * @param pkt the packet being decoded into, must be the same on each call until GC_FRAME is returned
+ * @param src the received text
+ * @param srcLen number of characters in src
+ * @param consumed set to the number of characters used
+ * @return GC_FRAME if a complete frame is now in pkt, otherwise GC_MORE
+ */
+BYTE gcDecode(GcDecoder *dec, CanPacket *pkt, BYTE *src, BYTE srcLen, BYTE *consumed)
+{
+    BYTE    *buf = pkt->buffer;
+    BYTE    i, c;
+
+    for (i=0; i<srcLen; i++)
+    {
+        c = src[i];
+        c = (c & 0x80) ? GC_BAD : gcCharClass[c];
+
+        if (c == GC_SOF)
+        {
+            if (dec->state != gcIdle)
+                dec->errors++;          // Previous frame was not terminated
+            dec->state = gcType;
+            continue;
+        }
+
+        switch (dec->state)
+        {
+            case gcIdle:
+                continue;               // Discard anything between frames
+
+            case gcType:
+                if (c == GC_STD)
+                    dec->digits = 4;
+                else if (c == GC_EXT)
+                    dec->digits = 8;
+                else
+                    break;              // Error
+                buf[con] = 0;
+                buf[eidh] = 0;
+                buf[eidl] = 0;
+                buf[dlc] = 0;
+                dec->idx = sidh;
+                dec->state = gcId;
+                continue;
+
+            case gcId:
+                if (c > 0x0F)
+                    break;              // Error
+                dec->value = (dec->value << 4) | c;
+                if ((--dec->digits & 1) == 0)
+                    buf[dec->idx++] = dec->value;
+                if (dec->digits == 0)
+                {
+                    if (dec->idx > eidh)
+                        buf[sidl] |= GC_EXIDE;
+                    dec->state = gcRtr;
+                }
+                continue;
+
+            case gcRtr:
+                if (c == GC_RTR)
+                    buf[dlc] = 0x40;
+                else if (c != GC_NORM)
+                    break;              // Error
+                dec->idx = d0;
+                dec->digits = 0;
+                dec->state = gcData;
+                continue;
+
+            case gcData:
+                if (c == GC_EOF)
+                {
+                    if (dec->digits & 1)
+                        break;          // Odd number of data digits
+                    buf[dlc] |= dec->digits >> 1;
+                    dec->state = gcIdle;
+                    *consumed = i+1;
+                    return GC_FRAME;
+                }
+                if ((c > 0x0F) || (dec->digits >= 16))
+                    break;              // Error, or too many data bytes
+                dec->value = (dec->value << 4) | c;
+                if ((++dec->digits & 1) == 0)
+                    buf[dec->idx++] = dec->value;
+                continue;
+        }
+
+        // Only get here on a framing error - discard this frame and wait for the next ':'
+
+        dec->errors++;
+        dec->state = gcIdle;
+    }
+
+    *consumed = srcLen;
+    return GC_MORE;
+}
+
+
+/**
+ * Decode as many whole frames as will fit from a buffer of GridConnect text.
+ * If the text ends part way through a frame, that frame is left partly decoded in 
+ * pkts[n] where n is the number of frames returned. Pass the same packet as the first 
+ * entry next time to carry on with it.
+ * 
+ * @param dec the decoder state
+ * @param src the received text
+ * @param srcLen number of characters in src
+ * @param pkts array of packets to decode into
+ * @param maxFrames number of packets in the array
+ * @param consumed set to the number of characters used
+ * @return the number of complete frames decoded
+ */
+BYTE gcDecodeFrames(GcDecoder *dec, BYTE *src, WORD srcLen, CanPacket *pkts, BYTE maxFrames, WORD *consumed)
+{
+    WORD    pos = 0;
+    BYTE    frames = 0;
+    BYTE    used;
+
+    while ((frames < maxFrames) && (pos < srcLen))
+    {
+        if (gcDecode(dec, &pkts[frames], src+pos, (srcLen-pos > 0xFF) ? 0xFF : srcLen-pos, &used) == GC_FRAME)
+            frames++;
+        pos += used;
+    }
+    *consumed = pos;
+    return frames;
+}
+
+
+/**
+ * Work out the number of characters needed for a frame.
+ * 
+ * @param pkt the CAN packet
+ * @return the GridConnect frame length
+ */
+BYTE gcFrameLen(CanPacket *pkt)
+{
+    BYTE    len = pkt->buffer[dlc] & 0x0F;
+
+    if (len > 8)
+        len = 8;
+    return ((pkt->buffer[sidl] & GC_EXIDE) ? 12 : 8) + (len << 1);
+}
+
+
+/**
+ * Convert a CAN packet to GridConnect text in one go.
+ * 
+ * @param dest where to put the text, must have room for GC_MAX_FRAME_LEN characters
+ * @param pkt the CAN packet, with sidh, sidl and dlc set
+ * @return the number of characters written
+ */
+BYTE gcEncodeFrame(BYTE *dest, CanPacket *pkt)
+{
+    BYTE    *buf = pkt->buffer;
+    BYTE    *p = dest;
+    BYTE    i, b, end;
+
+    end = buf[dlc] & 0x0F;
+    if (end > 8)
+        end = 8;
+    end += d0;
+
+    *p++ = ':';
+    if (buf[sidl] & GC_EXIDE)
+    {
+        *p++ = 'X';
+        i = sidh;
+        b = dlc;
+    }
+    else
+    {
+        *p++ = 'S';
+        i = sidh;
+        b = eidh;
+    }
+    for (; i<b; i++)
+    {
+        *p++ = gcHexChars[buf[i] >> 4];
+        *p++ = gcHexChars[buf[i] & 0x0F];
+    }
+    *p++ = (buf[dlc] & 0x40) ? 'R' : 'N';
+    for (i=d0; i<end; i++)
+    {
+        b = buf[i];
+        *p++ = gcHexChars[b >> 4];
+        *p++ = gcHexChars[b & 0x0F];
+    }
+    *p++ = ';';
+    return p - dest;
+}
+
+
+/**
+ * Convert an array of CAN packets to GridConnect text. Only whole frames are written.
+ * 
+ * @param dest where to put the text
+ * @param space number of characters available at dest
+ * @param pkts the CAN packets
+ * @param count number of packets
+ * @param framesDone set to the number of packets converted
+ * @return the number of characters written
+ */
+WORD gcEncodeFrames(BYTE *dest, WORD space, CanPacket *pkts, BYTE count, BYTE *framesDone)
+{
+    WORD    used = 0;
+    BYTE    i;
+
+    for (i=0; i<count; i++)
+    {
+        if ((space - used < GC_MAX_FRAME_LEN) && (space - used < gcFrameLen(&pkts[i])))
+            break;
+        used += gcEncodeFrame(dest+used, &pkts[i]);
+    }
+    *framesDone = i;
+    return used;
+}
+
+
+/**
+ * Start streaming a CAN packet as GridConnect text.
+ * 
+ * @param enc the encoder state
+ * @param pkt the CAN packet, with sidh, sidl and dlc set
+ */
+void gcEncoderInit(GcEncoder *enc, CanPacket *pkt)
+{
+    enc->pos = 0;
+    enc->len = gcFrameLen(pkt);
+}
+
+
+/**
+ * Output the next part of a GridConnect frame. 
+ * Call repeatedly, with the same packet, until enc->pos reaches enc->len.
+ * 
+ * @param enc the encoder state
+ * @param pkt the CAN packet being encoded
+ * @param dest where to put the text
+ * @param space number of characters available at dest
+ * @return the number of characters written
+ */
+BYTE gcEncode(GcEncoder *enc, CanPacket *pkt, BYTE *dest, BYTE space)
+{
+    BYTE    n = 0;
+
+    while ((enc->pos < enc->len) && (n < space))
+        dest[n++] = gcEncodeChar(pkt, enc->pos++, enc->len);
+
+    return n;
+}
+
+
+/**
+ * Work out a single character of a GridConnect frame.
+ * 
+ * @param pkt the CAN packet
+ * @param pos position in the frame
+ * @param len total length of the frame
+ * @return the character at that position
+ */
+BYTE gcEncodeChar(CanPacket *pkt, BYTE pos, BYTE len)
+{
+    BYTE    *buf = pkt->buffer;
+    BYTE    idEnd = (buf[sidl] & GC_EXIDE) ? 10 : 6;
+    BYTE    b;
+
+    if (pos == 0)
+        return ':';
+    if (pos == 1)
+        return (idEnd == 10) ? 'X' : 'S';
+    if (pos == len-1)
+        return ';';
+    if (pos == idEnd)
+        return (buf[dlc] & 0x40) ? 'R' : 'N';
+
+    if (pos < idEnd)
+    {
+        pos -= 2;
+        b = buf[sidh + (pos >> 1)];
+    }
+    else
+    {
+        pos -= idEnd+1;
+        b = buf[d0 + (pos >> 1)];
+    }
+    return gcHexChars[(pos & 1) ? (b & 0x0F) : (b >> 4)];
+}
@@ -0,0 +1,109 @@
+#ifndef __GRIDCONNECT_H
+#define __GRIDCONNECT_H
+
+/*
+
+ gridconnect.h - Definitions for GridConnect ASCII encoding of CAN frames - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "can18.h"
+
+/* GridConnect frames look like:
+ *
+ *      :SB020N9001020304;
+ *
+ * ':'  start of frame
+ * 'S'  standard id, 'X' for extended id
+ * B020 the id as the SIDH/SIDL register bytes in hex (SIDH/SIDL/EIDH/EIDL for extended)
+ * 'N'  normal frame, 'R' for RTR
+ * 90.. data bytes in hex, 0 to 8 of them
+ * ';'  end of frame
+ *
+ * Frames are converted to and from the CanPacket layout used by can18.c, so a decoded
+ * frame can be handed straight to the rest of the library. Extended frames have the
+ * EXIDE bit (0x08) set in sidl.
+ */
+
+#define GC_MAX_FRAME_LEN    28      // ":X" + 8 id + "R" + 16 data + ";"
+#define GC_EXIDE            0x08    // Extended id flag in sidl
+
+// Decoder results
+
+#define GC_MORE             0       // Input used up, frame not yet complete
+#define GC_FRAME            1       // A complete frame has been decoded
+
+/*
+ * The encoder and decoder keep all their state in these structures so that
+ * conversion can be resumed when a buffer fills up or runs out part way through
+ * a frame, and so that several streams can be converted at once.
+ */
+
+typedef struct
+{
+    BYTE    state;
+    BYTE    digits;         // Hex digits expected (id) or received (data)
+    BYTE    value;          // Byte being assembled from hex digits
+    BYTE    idx;            // Next byte of the packet to fill
+    BYTE    errors;         // Count of malformed frames discarded
+} GcDecoder;
+
+typedef struct
+{
+    BYTE    pos;            // Next character of the frame to output
+    BYTE    len;            // Total characters in the frame
+} GcEncoder;
+
+// Streaming API
+
+void gcDecoderInit(GcDecoder *dec);
+BYTE gcDecode(GcDecoder *dec, CanPacket *pkt, BYTE *src, BYTE srcLen, BYTE *consumed);
+void gcEncoderInit(GcEncoder *enc, CanPacket *pkt);
+BYTE gcEncode(GcEncoder *enc, CanPacket *pkt, BYTE *dest, BYTE space);
+
+// Whole frame and bulk API
+
+BYTE gcEncodeFrame(BYTE *dest, CanPacket *pkt);
+WORD gcEncodeFrames(BYTE *dest, WORD space, CanPacket *pkts, BYTE count, BYTE *framesDone);
+BYTE gcDecodeFrames(GcDecoder *dec, BYTE *src, WORD srcLen, CanPacket *pkts, BYTE maxFrames, WORD *consumed);
+
+#endif	// __GRIDCONNECT_H
@@ -77,7 +77,7 @@
 Event producedEvent;
 BOOL getProducedEvent(HAPPENING_T happening) {
 #ifndef HASH_TABLE
-    unsigned char tableIndex;
+    EVENT_INDEX_T tableIndex;
 #endif
     if ((happening < HAPPENING_BASE) || (happening >= HAPPENING_BASE + NUM_HAPPENINGS)) return FALSE;    // not a produced valid action
 #ifdef HASH_TABLE
@@ -132,12 +132,15 @@ BOOL sendProducedEvent(HAPPENING_T happening, BOOL on) {
     }
 #ifdef DEBUG_PRODUCED_EVENTS
     // Didn't find a provisioned event so instead send a debug message containing the action
-    cbusMsg[d3] = happening & 0xFF;
-    cbusMsg[d4] = happening >> 8;
-    cbusMsg[d5] = on;
-    cbusMsg[d6] = status;
-    cbusMsg[d7] = 0;
-    return cbusSendOpcNN(ALL_CBUS, OPC_ACDAT, -1, cbusMsg);
+    {
+        BYTE msg[CBUS_MSG_LEN];
+        msg[d3] = happening & 0xFF;
+        msg[d4] = happening >> 8;
+        msg[d5] = on;
+        msg[d6] = status;
+        msg[d7] = 0;
+        return cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, OPC_ACDAT, MY_NN, NULL));
+    }
 #else
     // Didn't find an event to send so lie and say we sent it otherwise the
     // caller would retry in an infinite loop.
@@ -150,7 +153,7 @@ BOOL sendProducedEvent(HAPPENING_T happening, BOOL on) {
  * @param action
  */
 void deleteHappeningRange(HAPPENING_T action, unsigned char number) {
-    unsigned char tableIndex;
+    EVENT_INDEX_T tableIndex;
     for (tableIndex=0; tableIndex < NUM_EVENTS; tableIndex++) {
         if ( validStart(tableIndex)) {
             EventTableFlags f;
@@ -158,15 +161,13 @@ void deleteHappeningRange(HAPPENING_T action, unsigned char number) {
             f.asByte = readFlashBlock((WORD)(&(eventTable[tableIndex].flags.asByte)));
             pa = readFlashBlock((WORD)(&(eventTable[tableIndex].evs[0])));
             if ((pa >= action) && (pa < action+number)) {
+                // writeEv and removeTableEntry keep the hash tables up to date
                 writeEv(tableIndex, 0, EV_FILL);
                 checkRemoveTableEntry(tableIndex);
             }                
         }
     }
     flushFlashImage();
-#ifdef HASH_TABLE
-    rebuildHashtable();                
-#endif
 }
 
 
@@ -186,7 +187,7 @@ void doAreq(WORD nodeNumber, WORD eventNumber) {
     HAPPENING_T happening;
     int ev0;
     
-    unsigned char tableIndex = findEvent(nodeNumber, eventNumber);
+    EVENT_INDEX_T tableIndex = findEvent(nodeNumber, eventNumber);
     if (tableIndex == NO_INDEX) return;
     // found the matching event
     ev0 = getEv(tableIndex, 0); // get the Happening
@@ -199,21 +200,17 @@ void doAreq(WORD nodeNumber, WORD eventNumber) {
         unsigned char bit = happening & 0x7;
         unsigned char byte = happening >> 3;
         BOOL status = ee_read((WORD)(EE_AREQ_STATUS+byte)) & (1<<bit);
-        if (nodeNumber == 0) {
-            cbusMsg[d1] = nodeID >> 8;
-            cbusMsg[d2] = nodeID & 0xFF;
-        } else {
-            cbusMsg[d1] = nodeNumber >> 8;
-            cbusMsg[d2] = nodeNumber & 0xFF;
-        }
-        cbusMsg[d3] = eventNumber >> 8;
-        cbusMsg[d4] = eventNumber & 0xFF;
+        BYTE msg[CBUS_MSG_LEN];
+        BYTE opc;
+
+        msg[d3] = eventNumber >> 8;
+        msg[d4] = eventNumber & 0xFF;
         if (status) {
-            cbusMsg[d0] = nodeNumber == 0 ? OPC_ARSON : OPC_ARON;    
+            opc = nodeNumber == 0 ? OPC_ARSON : OPC_ARON;    
         } else {
-            cbusMsg[d0] = nodeNumber == 0 ? OPC_ARSOF : OPC_AROF;
+            opc = nodeNumber == 0 ? OPC_ARSOF : OPC_AROF;
         }
-        cbusSendMsg(ALL_CBUS, cbusMsg);
+        cbusSendMsg(ALL_CBUS, cbusMakeMsgNN(msg, opc, nodeNumber == 0 ? MY_NN : nodeNumber, NULL));
     }
 }
 #endif /* AREQ_SUPPORT */
@@ -224,19 +221,21 @@ void doAreq(WORD nodeNumber, WORD eventNumber) {
  * @param action
  */
 void deleteActionRange(ACTION_T action, unsigned char number) {
-    unsigned char tableIndex;
+    EVENT_INDEX_T tableIndex;
     for (tableIndex=0; tableIndex < NUM_EVENTS; tableIndex++) {
-        if (validStart(tableIndex)) {
+        EvIterator it;
+        int ev;
+        if (evIterStart(&it, tableIndex)) {
             BOOL updated = FALSE;
-            unsigned char e;
-            if (getEVs(tableIndex)) {
-                return;
-            }
-                
-            for (e=1; e<EVperEVT; e++) {
-                if ((evs[e] >= action) && (evs[e] < action+number)) {
-                    writeEv(tableIndex, e, EV_FILL);
+            while ((ev = evIterNext(&it)) >= 0) {
+                // EV#1 is the produced happening
+                if ((it.evNum > 0) && (ev >= action) && (ev < action+number)) {
+                    writeEv(tableIndex, it.evNum, EV_FILL);
                     updated = TRUE;
+                    if ( ! validStart(tableIndex)) {
+                        // that was the last EV so the event has gone
+                        break;
+                    }
                 }
             }
             if (updated) {
@@ -245,9 +244,6 @@ void deleteActionRange(ACTION_T action, unsigned char number) {
         }
     }
     flushFlashImage();
-#ifdef HASH_TABLE
-    rebuildHashtable();                
-#endif
 }
 
 
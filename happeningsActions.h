@@ -53,7 +53,7 @@ void    doAreq(WORD nodeNumber, WORD eventNumber);
 
 #ifdef PRODUCED_EVENTS
 // the lookup table to find an EventTable entry by Happening
-extern BYTE happening2Event[NUM_HAPPENINGS];    // MIO: 64+8 bytes
+extern EVENT_INDEX_T happening2Event[NUM_HAPPENINGS];  // MIO: 64+8 bytes
 #endif
 
 #ifdef	__cplusplus
@@ -0,0 +1,369 @@
+/*
+
+ Sorted flash index of events - part of CBUS libraries for PIC 18F
+ Gives findEvent() a binary search without the RAM hash table.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Key index.
+ * 
+ * Without HASH_TABLE findEvent() reads the flags, NN and EN of every row of the 
+ * eventTable, working through most of its 64 byte flash blocks for every event 
+ * received. When KEY_INDEX is defined a copy of the NN/EN of every event, sorted 
+ * by NN then EN, is kept in flash along with the eventTable index of each. 
+ * findEvent() then does a binary search of this, which reads only a few flash 
+ * blocks, and no RAM is needed.
+ * 
+ * The index is kept up to date as events are taught and removed. Adding or 
+ * removing an event moves the entries after it up or down one place, a flash 
+ * block at a time. Clearing all events erases it, and if the NN changes (which 
+ * moves any forceOwnNN events) it is rebuilt. At power up it is checked against 
+ * the eventTable and rebuilt if they don't agree, for example if power was lost 
+ * part way through an update.
+ * 
+ * The keys and the eventTable indexes are held in separate arrays so that 
+ * moving entries works through one array at a time and keys don't straddle 
+ * flash blocks.
+ */
+
+#include "devincs.h"
+#include "module.h"
+#include "events.h"
+#include "romops.h"
+#include "keyindex.h"
+
+#ifdef KEY_INDEX
+
+#ifdef __XC8
+const KeyIndex keyIndex[1] @AT_KEY_INDEX;
+#else
+rom near KeyIndex * keyIndex = (rom near KeyIndex*)AT_KEY_INDEX;
+#endif
+
+#define KEY_NONE        0xFFFFFFFF              // Key of an unused entry
+#define KEY_CHUNK       (64/sizeof(Event))      // Keys in one flash block
+#define KEY_SLOTS       (64/sizeof(EVENT_INDEX_T))  // Indexes in one flash block
+
+WORD  keyIndexRebuildCount;
+
+DWORD keyIndexKey(EVENT_INDEX_T pos);
+void keyIndexSetKey(EVENT_INDEX_T pos, DWORD key);
+EVENT_INDEX_T keyIndexLower(DWORD key);
+EVENT_INDEX_T keyIndexCount(void);
+
+/**
+ * Check the index against the eventTable and rebuild it if necessary. 
+ * Called from eventsInit().
+ */
+void keyIndexInit(void) {
+    EVENT_INDEX_T tableIndex;
+    EVENT_INDEX_T found;
+    EVENT_INDEX_T numEvents;
+    WORD    nn;
+    WORD    en;
+    
+    keyIndexRebuildCount = 0;
+    numEvents = 0;
+    for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+        if (validStart(tableIndex)) {
+            numEvents++;
+            nn = getNN(tableIndex);
+            en = getEN(tableIndex);
+            found = keyIndexFind(nn, en);
+            // if the same event has been taught twice the other entry may be found
+            if ((found >= NUM_EVENTS) || !validStart(found) || (getNN(found) != nn) || (getEN(found) != en)) {
+                keyIndexRebuild();
+                return;
+            }
+        }
+    }
+    // and the rest must be unused
+    for (tableIndex=keyIndexCount(); tableIndex<NUM_EVENTS; tableIndex++) {
+        if (keyIndexKey(tableIndex) != KEY_NONE) {
+            numEvents = NO_INDEX;
+            break;
+        }
+    }
+    if (numEvents != keyIndexCount()) {
+        keyIndexRebuild();
+    }
+}
+
+/**
+ * Read the key at a position in the index.
+ * @param pos the position
+ * @return NN in the top 16 bits and EN in the bottom 16 bits
+ */
+DWORD keyIndexKey(EVENT_INDEX_T pos) {
+    DWORD key;
+    WORD addr = (WORD)(&(keyIndex->keys[pos]));
+    
+    key = readFlashBlock(addr+1);           // NN hi
+    key = (key << 8) | readFlashBlock(addr);
+    key = (key << 8) | readFlashBlock(addr+3);  // EN hi
+    key = (key << 8) | readFlashBlock(addr+2);
+    return key;
+}
+
+/**
+ * Write the key at a position in the index into the flash image.
+ * @param pos the position
+ * @param key NN in the top 16 bits and EN in the bottom 16 bits
+ */
+void keyIndexSetKey(EVENT_INDEX_T pos, DWORD key) {
+    setFlashWord((WORD*)&(keyIndex->keys[pos].NN), (WORD)(key >> 16));
+    setFlashWord((WORD*)&(keyIndex->keys[pos].EN), (WORD)key);
+}
+
+/**
+ * Find the first position in the index with a key not less than the one given.
+ * @param key NN in the top 16 bits and EN in the bottom 16 bits
+ * @return the position, NUM_EVENTS if all keys are less
+ */
+EVENT_INDEX_T keyIndexLower(DWORD key) {
+    EVENT_INDEX_T lo = 0;
+    EVENT_INDEX_T hi = NUM_EVENTS;
+    EVENT_INDEX_T mid;
+    
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (keyIndexKey(mid) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @return the number of events in the index
+ */
+EVENT_INDEX_T keyIndexCount(void) {
+    return keyIndexLower(KEY_NONE);
+}
+
+/**
+ * Find an event using the index.
+ * 
+ * @param nodeNumber
+ * @param eventNumber
+ * @return index into eventTable or NO_INDEX if not present
+ */
+EVENT_INDEX_T keyIndexFind(WORD nodeNumber, WORD eventNumber) {
+    DWORD   key = ((DWORD)nodeNumber << 16) | eventNumber;
+    EVENT_INDEX_T pos;
+    
+    pos = keyIndexLower(key);
+    if ((pos < NUM_EVENTS) && (keyIndexKey(pos) == key)) {
+        return readFlashIndex((WORD)(&(keyIndex->index[pos])));
+    }
+    return NO_INDEX;
+}
+
+/**
+ * Add a newly created event to the index. The NN/EN must already be in 
+ * the eventTable.
+ * @param tableIndex the first entry of the event
+ */
+void keyIndexInsert(EVENT_INDEX_T tableIndex) {
+    DWORD   key = ((DWORD)getNN(tableIndex) << 16) | getEN(tableIndex);
+    EVENT_INDEX_T count;
+    EVENT_INDEX_T pos;
+    EVENT_INDEX_T i;
+    
+    count = keyIndexCount();
+    if (count >= NUM_EVENTS) {
+        return;     // can't happen as there is an entry for every eventTable row
+    }
+    pos = keyIndexLower(key);
+    // move the later entries up one, working down from the end
+    for (i=count; i>pos; i--) {
+        keyIndexSetKey(i, keyIndexKey(i-1));
+    }
+    keyIndexSetKey(pos, key);
+    for (i=count; i>pos; i--) {
+        setFlashIndex(&(keyIndex->index[i]), readFlashIndex((WORD)(&(keyIndex->index[i-1]))));
+    }
+    setFlashIndex(&(keyIndex->index[pos]), tableIndex);
+    flushFlashImage();
+}
+
+/**
+ * Remove an event from the index. Must be called before the entry 
+ * is freed as the NN/EN are needed to find it.
+ * @param tableIndex the first entry of the event
+ */
+void keyIndexRemove(EVENT_INDEX_T tableIndex) {
+    DWORD   key = ((DWORD)getNN(tableIndex) << 16) | getEN(tableIndex);
+    EVENT_INDEX_T pos;
+    EVENT_INDEX_T last;
+    EVENT_INDEX_T i;
+    
+    pos = keyIndexLower(key);
+    if ((pos >= NUM_EVENTS) || (keyIndexKey(pos) != key)) {
+        return;     // not in the index
+    }
+    last = keyIndexCount() - 1;
+    // move the later entries down one
+    for (i=pos; i<last; i++) {
+        keyIndexSetKey(i, keyIndexKey(i+1));
+    }
+    keyIndexSetKey(last, KEY_NONE);
+    for (i=pos; i<last; i++) {
+        setFlashIndex(&(keyIndex->index[i]), readFlashIndex((WORD)(&(keyIndex->index[i+1]))));
+    }
+    setFlashIndex(&(keyIndex->index[last]), NO_INDEX);
+    flushFlashImage();
+}
+
+/**
+ * Remove all events from the index.
+ */
+void keyIndexClear(void) {
+    EVENT_INDEX_T pos;
+    
+    for (pos=0; pos<NUM_EVENTS; pos++) {
+        keyIndexSetKey(pos, KEY_NONE);
+    }
+    for (pos=0; pos<NUM_EVENTS; pos++) {
+        setFlashIndex(&(keyIndex->index[pos]), NO_INDEX);
+    }
+    flushFlashImage();
+}
+
+/**
+ * Rebuild the index from the eventTable. 
+ * 
+ * The keys are found a flash block's worth at a time by keeping the smallest 
+ * KEY_CHUNK keys, greater than those already written, whilst scanning the 
+ * eventTable. The eventTable indexes are then filled in 64 at a time, so each 
+ * block of the index is only written once.
+ */
+void keyIndexRebuild(void) {
+    DWORD   chunk[KEY_CHUNK];
+    EVENT_INDEX_T *slots = (EVENT_INDEX_T*)chunk;  // reused for the eventTable indexes, 64 bytes
+    DWORD   key;
+    DWORD   prev = 0;
+    EVENT_INDEX_T n;
+    EVENT_INDEX_T pos = 0;
+    EVENT_INDEX_T tableIndex;
+    BYTE    i;
+    BYTE    j;
+    WORD    start;
+    
+    keyIndexRebuildCount++;
+    do {
+        n = 0;
+        for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+            if (validStart(tableIndex)) {
+                key = ((DWORD)getNN(tableIndex) << 16) | getEN(tableIndex);
+                if ((pos > 0) && (key <= prev)) {
+                    continue;   // already written
+                }
+                for (i=0; (i<n) && (chunk[i]<key); i++)
+                    ;
+                if ((i >= KEY_CHUNK) || ((i < n) && (chunk[i] == key))) {
+                    continue;   // too big for this chunk, or a duplicate
+                }
+                if (n < KEY_CHUNK) {
+                    n++;
+                }
+                // insert, dropping the largest if full
+                for (j=n-1; j>i; j--) {
+                    chunk[j] = chunk[j-1];
+                }
+                chunk[i] = key;
+            }
+        }
+        for (i=0; i<n; i++) {
+            keyIndexSetKey(pos++, chunk[i]);
+        }
+        if (n) {
+            prev = chunk[n-1];
+        }
+    } while ((n == KEY_CHUNK) && (pos < NUM_EVENTS));
+    n = pos;    // number of events
+    for ( ; pos<NUM_EVENTS; pos++) {
+        keyIndexSetKey(pos, KEY_NONE);
+    }
+    
+    for (start=0; start<NUM_EVENTS; start+=KEY_SLOTS) {
+        for (i=0; i<KEY_SLOTS; i++) {
+            slots[i] = NO_INDEX;
+        }
+        for (tableIndex=0; tableIndex<NUM_EVENTS; tableIndex++) {
+            if (validStart(tableIndex)) {
+                pos = keyIndexLower(((DWORD)getNN(tableIndex) << 16) | getEN(tableIndex));
+                if ((pos >= start) && (pos < start+KEY_SLOTS) && (pos < n)) {
+                    slots[pos-start] = tableIndex;
+                }
+            }
+        }
+        for (i=0; (i<KEY_SLOTS) && (start+i<NUM_EVENTS); i++) {
+            setFlashIndex(&(keyIndex->index[start+i]), slots[i]);
+        }
+    }
+    flushFlashImage();
+}
+
+#ifdef EVENT_COMPACT
+/**
+ * Change the eventTable index of an event whose start row has been moved.
+ * @param from the old index
+ * @param to the new index, already holding the NN/EN
+ */
+void keyIndexMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to) {
+    DWORD   key = ((DWORD)getNN(to) << 16) | getEN(to);
+    EVENT_INDEX_T pos;
+    
+    pos = keyIndexLower(key);
+    for (; (pos < NUM_EVENTS) && (keyIndexKey(pos) == key); pos++) {
+        if (readFlashIndex((WORD)(&(keyIndex->index[pos]))) == from) {
+            setFlashIndex(&(keyIndex->index[pos]), to);
+            flushFlashImage();
+            return;
+        }
+    }
+}
+#endif
+
+#endif  // KEY_INDEX
@@ -0,0 +1,88 @@
+#ifndef __KEYINDEX_H
+#define __KEYINDEX_H
+
+/*
+
+ keyindex.h - Definitions for the sorted flash index of events - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "events.h"
+
+#ifdef KEY_INDEX
+
+#if defined(HASH_TABLE) || defined(EVENT_MPH)
+#error "KEY_INDEX is an alternative to HASH_TABLE and EVENT_MPH, define only one of them"
+#endif
+
+// AT_KEY_INDEX must be defined in module.h, within the writeable flash area and
+// not overlapping the event table or NVs. It should be on a 64 byte boundary.
+// sizeof(KeyIndex) bytes are needed.
+
+/*
+ * Every event in the eventTable, sorted by NN then EN. Unused entries are 
+ * 0xFFFF:0xFFFF, so are after all the events. That event therefore can't be 
+ * indexed and addEvent() refuses to learn it.
+ */
+typedef struct {
+    Event   keys[NUM_EVENTS];               // NN/EN of each event in order
+    EVENT_INDEX_T index[NUM_EVENTS];        // eventTable index of each event
+} KeyIndex;
+
+// Diagnostic variables for the key index
+
+extern  WORD  keyIndexRebuildCount;         // Times the index had to be rebuilt from the eventTable
+
+void keyIndexInit(void);
+void keyIndexRebuild(void);
+void keyIndexClear(void);
+void keyIndexInsert(EVENT_INDEX_T tableIndex);
+void keyIndexRemove(EVENT_INDEX_T tableIndex);
+EVENT_INDEX_T keyIndexFind(WORD nodeNumber, WORD eventNumber);
+#ifdef EVENT_COMPACT
+void keyIndexMoveRow(EVENT_INDEX_T from, EVENT_INDEX_T to);
+#endif
+
+#endif  // KEY_INDEX
+
+#endif	// __KEYINDEX_H
@@ -0,0 +1,308 @@
+/*
+
+ Synthetic CBUS traffic generator - part of CBUS libraries for PIC 18F
+ Generates a repeatable mix of CBUS traffic into the CAN receive path for load testing.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Traffic generator.
+ * 
+ * Frames are produced from a seeded pseudo random sequence so that a given seed 
+ * and mix always gives the same traffic. Events follow a Zipf distribution: the 
+ * event of rank k is chosen with probability proportional to 1/k, as on a real 
+ * layout where a few events (eg. busy points and sensors) make up most of the traffic.
+ * 
+ * Generated frames enter the receive path through canInjectRx(), which does the 
+ * same checks and FIFO insertion as frames from the ECAN hardware, so they are 
+ * then collected by cbusMsgReceived() and processed in the usual way.
+ * 
+ * loadGenPoll() injects one frame every interval ticks. loadGenBurst() injects 
+ * a number of frames back to back without giving the main loop chance to remove 
+ * any, far above CAN line rate, to find where the receive FIFO starts to drop 
+ * frames (see rxOflowCount and maxCanRxFifo).
+ */
+
+#include "devincs.h"
+#include "module.h"
+#include "cbus.h"
+#include "cbusdefs.h"
+#include "TickTime.h"
+#include "loadgen.h"
+
+#ifdef CBUS_LOADGEN
+
+extern BYTE canID;
+
+WORD    loadGenSeed;
+LoadMix loadGenMix;
+WORD    loadGenMixTotal;
+WORD    loadGenInterval;
+DWORD   loadGenLastTime;
+DWORD   loadGenZipfCdf[LOADGEN_EVENTS];         // Cumulative weights, entry k-1 is sum of 1/j for j<=k scaled
+
+WORD  loadGenFrames;
+
+// Internal routine definitions
+
+WORD loadGenRand(void);
+BYTE loadGenZipf(void);
+void loadGenHeader(CanPacket *pkt, BYTE len);
+
+/**
+ * Initialise the generator.
+ * 
+ * @param seed non zero seed for the pseudo random sequence
+ * @param mix relative weights of the kinds of traffic
+ * @param interval ticks between frames injected by loadGenPoll, 0 for every call
+ */
+void loadGenInit(WORD seed, LoadMix *mix, WORD interval)
+{
+    BYTE    k;
+    DWORD   total = 0;
+
+    loadGenSeed = seed ? seed : 1;              // xorshift must not be seeded with 0
+    loadGenMix = *mix;
+    loadGenMixTotal = (WORD)mix->longEvents + mix->shortEvents + mix->nodeConfig + mix->rtr + mix->dcc;
+    loadGenInterval = interval;
+    loadGenLastTime = tickGet();
+    loadGenFrames = 0;
+
+    for (k=0; k<LOADGEN_EVENTS; k++)
+    {
+        total += 0x8000 / (k+1);
+        loadGenZipfCdf[k] = total;
+    }
+}
+
+/**
+ * Generate the next frame.
+ * 
+ * @param pkt where to put the frame, all CanPacket bytes are filled in
+ */
+void loadGenFrame(CanPacket *pkt)
+{
+    WORD    r;
+    BYTE    rank;
+    WORD    nn;
+
+    r = loadGenMixTotal ? loadGenRand() % loadGenMixTotal : 0;
+
+    if (r < loadGenMix.longEvents)
+    {
+        rank = loadGenZipf();
+        nn = LOADGEN_NN_BASE + (rank % LOADGEN_NN_COUNT);
+        loadGenHeader(pkt, 5);
+        pkt->buffer[d0] = (loadGenRand() & 1) ? OPC_ACOF : OPC_ACON;
+        pkt->buffer[d1] = nn >> 8;
+        pkt->buffer[d2] = nn & 0xFF;
+        pkt->buffer[d3] = 0;
+        pkt->buffer[d4] = rank + 1;
+        return;
+    }
+    r -= loadGenMix.longEvents;
+
+    if (r < loadGenMix.shortEvents)
+    {
+        rank = loadGenZipf();
+        nn = LOADGEN_NN_BASE + (loadGenRand() % LOADGEN_NN_COUNT);
+        loadGenHeader(pkt, 5);
+        pkt->buffer[d0] = (loadGenRand() & 1) ? OPC_ASOF : OPC_ASON;
+        pkt->buffer[d1] = nn >> 8;
+        pkt->buffer[d2] = nn & 0xFF;
+        pkt->buffer[d3] = 0;
+        pkt->buffer[d4] = rank + 1;
+        return;
+    }
+    r -= loadGenMix.shortEvents;
+
+    if (r < loadGenMix.nodeConfig)
+    {
+        // One in four is addressed to this node, the rest to other nodes
+        nn = (loadGenRand() & 3) ? LOADGEN_NN_BASE + (loadGenRand() % LOADGEN_NN_COUNT) : nodeID;
+        switch (loadGenRand() & 3)
+        {
+        case 0:
+            loadGenHeader(pkt, 1);
+            pkt->buffer[d0] = OPC_QNN;
+            return;
+        case 1:
+            loadGenHeader(pkt, 4);
+            pkt->buffer[d0] = OPC_RQNPN;
+            pkt->buffer[d3] = loadGenRand() % 20;
+            break;
+        case 2:
+            loadGenHeader(pkt, 4);
+            pkt->buffer[d0] = OPC_NVRD;
+            pkt->buffer[d3] = 1 + (loadGenRand() % 16);
+            break;
+        default:
+            loadGenHeader(pkt, 3);
+            pkt->buffer[d0] = OPC_RQEVN;
+            break;
+        }
+        pkt->buffer[d1] = nn >> 8;
+        pkt->buffer[d2] = nn & 0xFF;
+        return;
+    }
+    r -= loadGenMix.nodeConfig;
+
+    if (r < loadGenMix.rtr)
+    {
+        loadGenHeader(pkt, 0);
+        pkt->buffer[dlc] = 0x40;                // RTR, no data
+        return;
+    }
+
+    // DCC cab traffic for one of a few sessions
+    switch (loadGenRand() % 3)
+    {
+    case 0:
+        loadGenHeader(pkt, 3);
+        pkt->buffer[d0] = OPC_DSPD;
+        pkt->buffer[d2] = loadGenRand() & 0xFF;
+        break;
+    case 1:
+        loadGenHeader(pkt, 4);
+        pkt->buffer[d0] = OPC_DFUN;
+        pkt->buffer[d2] = 1 + (loadGenRand() % 5);
+        pkt->buffer[d3] = loadGenRand() & 0xFF;
+        break;
+    default:
+        loadGenHeader(pkt, 2);
+        pkt->buffer[d0] = OPC_DKEEP;
+        break;
+    }
+    pkt->buffer[d1] = 1 + (loadGenRand() & 7);
+}
+
+/**
+ * Inject a number of frames back to back into the receive path.
+ * 
+ * @param count number of frames
+ * @return the number of frames that were lost because the receive FIFO was full
+ */
+BYTE loadGenBurst(BYTE count)
+{
+    CanPacket   pkt;
+    BYTE        oflowStart = rxOflowCount;
+
+    while (count--)
+    {
+        loadGenFrame(&pkt);
+        canInjectRx(&pkt);
+        loadGenFrames++;
+    }
+    return rxOflowCount - oflowStart;
+}
+
+/**
+ * Inject a frame if the interval has passed. Call regularly from the main loop.
+ */
+void loadGenPoll(void)
+{
+    CanPacket   pkt;
+
+    if ((loadGenInterval != 0) && (tickGet() - loadGenLastTime < loadGenInterval))
+        return;
+    loadGenLastTime += loadGenInterval;
+    loadGenFrame(&pkt);
+    canInjectRx(&pkt);
+    loadGenFrames++;
+}
+
+/**
+ * Next number from a 16 bit xorshift sequence.
+ */
+WORD loadGenRand(void)
+{
+    loadGenSeed ^= loadGenSeed << 7;
+    loadGenSeed ^= loadGenSeed >> 9;
+    loadGenSeed ^= loadGenSeed << 8;
+    return loadGenSeed;
+}
+
+/**
+ * Choose an event rank from the Zipf distribution.
+ * 
+ * @return rank, 0 is the most frequent
+ */
+BYTE loadGenZipf(void)
+{
+    DWORD   r;
+    BYTE    low = 0;
+    BYTE    high = LOADGEN_EVENTS - 1;
+    BYTE    mid;
+
+    r = (((DWORD)loadGenRand() << 16) | loadGenRand()) % loadGenZipfCdf[LOADGEN_EVENTS-1];
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (r < loadGenZipfCdf[mid])
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low;
+}
+
+/**
+ * Fill in the CAN header of a generated frame, from a random CANID other than ours.
+ * 
+ * @param pkt the frame
+ * @param len number of data bytes
+ */
+void loadGenHeader(CanPacket *pkt, BYTE len)
+{
+    BYTE    id;
+
+    do {
+        id = 1 + (loadGenRand() % 99);
+    } while (id == canID);
+
+    pkt->buffer[con] = 0;
+    pkt->buffer[sidh] = 0b10110000 | ((id & 0x78) >> 3);
+    pkt->buffer[sidl] = (id & 0x07) << 5;
+    pkt->buffer[eidh] = 0;
+    pkt->buffer[eidl] = 0;
+    pkt->buffer[dlc] = len;
+}
+
+#endif  // CBUS_LOADGEN
@@ -0,0 +1,83 @@
+#ifndef __LOADGEN_H
+#define __LOADGEN_H
+
+/*
+
+ loadgen.h - Definitions for the synthetic CBUS traffic generator - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "can18.h"
+
+#ifdef CBUS_LOADGEN
+
+#ifndef LOADGEN_EVENTS
+#define LOADGEN_EVENTS      32                  // Number of distinct events generated
+#endif
+#define LOADGEN_NN_BASE     256                 // Lowest node number used for generated long events
+#define LOADGEN_NN_COUNT    8                   // Number of producer node numbers the events are spread over
+
+/*
+ * Relative weights of each kind of traffic in the mix. A frame's kind is chosen
+ * in proportion to these, so { 6, 2, 1, 0, 1 } gives 60% long events etc.
+ */
+typedef struct {
+    BYTE    longEvents;                         // ACON/ACOF with a Zipf distributed NN:EN
+    BYTE    shortEvents;                        // ASON/ASOF with a Zipf distributed EN
+    BYTE    nodeConfig;                         // QNN, RQNPN, NVRD, RQEVN, some to this node
+    BYTE    rtr;                                // Self enumeration RTR frames
+    BYTE    dcc;                                // Cab traffic: DSPD, DFUN, DKEEP
+} LoadMix;
+
+// Diagnostic variables for the generator
+
+extern  WORD  loadGenFrames;                    // Frames put into the receive path
+
+void loadGenInit(WORD seed, LoadMix *mix, WORD interval);
+void loadGenFrame(CanPacket *pkt);
+BYTE loadGenBurst(BYTE count);
+void loadGenPoll(void);
+
+#endif  // CBUS_LOADGEN
+
+#endif	// __LOADGEN_H
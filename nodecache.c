@@ -0,0 +1,202 @@
+/*
+
+ Passive node discovery cache - part of CBUS libraries for PIC 18F
+ Remembers the nodes seen on the bus from the traffic they send.
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+/**
+ * Node cache.
+ * 
+ * Every message received through cbusMsgReceived() is looked at, and any whose node number 
+ * identifies the node that sent it (responses such as PNN, NNACK, RQNN and WRACK,
+ * and events, which carry the producer's node number) records or refreshes that 
+ * node along with the CANID it was sent from. PNN also gives the manufacturer, 
+ * module id and flags. PARAMS carries no node number so is matched to a node by 
+ * its CANID.
+ * 
+ * The application can then find out which nodes are on the bus, and how recently 
+ * they have been heard from, without sending QNN and waiting for every node to 
+ * answer at once. When full, the node not heard from for longest is replaced.
+ * 
+ * The interface each frame arrived on is recorded too, so when bridging the 
+ * cache knows which side of the bridge each node is.
+ */
+
+#include <stddef.h>
+#include "devincs.h"
+#include "module.h"
+#include "cbus.h"
+#include "opcflags.h"
+#include "TickTime.h"
+#include "nodecache.h"
+
+#ifdef NODE_CACHE
+
+NodeCacheEntry  nodeCache[NODE_CACHE_LEN];
+BYTE            nodeCacheCount;
+
+WORD  nodeCacheEvictions;
+
+#define nodeCacheNow()  ((WORD)(tickGet() >> 16))
+
+/**
+ * Empty the cache.
+ */
+void nodeCacheInit(void)
+{
+    nodeCacheCount = 0;
+    nodeCacheEvictions = 0;
+}
+
+/**
+ * Look at a message and record the node that sent it, if that can be told.
+ * 
+ * @param cbusNum the interface it was received on, or ALL_CBUS if not known
+ * @param msg the received CBUS message, including the CAN header bytes
+ */
+void nodeCacheObserve(BYTE cbusNum, BYTE *msg)
+{
+    NodeCacheEntry  *e;
+    BYTE            canId;
+    BYTE            i;
+    WORD            nn;
+
+    canId = ((msg[sidh] << 3) + (msg[sidl] >> 5)) & 0x7F;
+
+    if (msg[d0] == OPC_PARAMS)
+    {
+        for (i=0; i<nodeCacheCount; i++)
+        {
+            if (nodeCache[i].canID == canId)
+            {
+                nodeCache[i].manufacturer = msg[d1];
+                nodeCache[i].moduleId = msg[d3];
+                nodeCache[i].lastSeen = nodeCacheNow();
+            }
+        }
+        return;
+    }
+
+    if (!(getOpcFlags(msg[d0]) & (OPF_NNSRC | OPF_EVENT)))
+        return;
+    nn = ((WORD)msg[d1] << 8) + msg[d2];
+    if (nn == 0)
+        return;
+
+    e = nodeCacheFind(nn);
+    if (e == NULL)
+    {
+        if (nodeCacheCount < NODE_CACHE_LEN)
+            e = &nodeCache[nodeCacheCount++];
+        else
+        {   // Replace the one not heard from for longest
+            e = &nodeCache[0];
+            for (i=1; i<NODE_CACHE_LEN; i++)
+            {
+                if (nodeCacheAge(&nodeCache[i]) > nodeCacheAge(e))
+                    e = &nodeCache[i];
+            }
+            nodeCacheEvictions++;
+        }
+        e->nn = nn;
+        e->bus = NODE_UNKNOWN_BUS;
+        e->manufacturer = 0;
+        e->moduleId = 0;
+        e->flags = 0;
+    }
+
+    e->canID = canId;
+    if (cbusNum != ALL_CBUS)
+        e->bus = cbusNum;
+    if (msg[d0] == OPC_PNN)
+    {
+        e->manufacturer = msg[d3];
+        e->moduleId = msg[d4];
+        e->flags = msg[d5];
+    }
+    e->lastSeen = nodeCacheNow();
+}
+
+/**
+ * Find a node in the cache.
+ * 
+ * @param nn the node number
+ * @return the entry, or NULL if the node has not been seen
+ */
+NodeCacheEntry *nodeCacheFind(WORD nn)
+{
+    BYTE    i;
+
+    for (i=0; i<nodeCacheCount; i++)
+    {
+        if (nodeCache[i].nn == nn)
+            return &nodeCache[i];
+    }
+    return NULL;
+}
+
+/**
+ * @return time since the node was last heard from, in the same units as lastSeen
+ */
+WORD nodeCacheAge(NodeCacheEntry *entry)
+{
+    return nodeCacheNow() - entry->lastSeen;
+}
+
+/**
+ * Forget nodes that have not been heard from recently.
+ * 
+ * @param maxAge nodes older than this are removed, in units of about one second
+ */
+void nodeCacheExpire(WORD maxAge)
+{
+    BYTE    i = 0;
+
+    while (i < nodeCacheCount)
+    {
+        if (nodeCacheAge(&nodeCache[i]) > maxAge)
+            nodeCache[i] = nodeCache[--nodeCacheCount];    // Move the last entry into the gap
+        else
+            i++;
+    }
+}
+
+#endif  // NODE_CACHE
@@ -0,0 +1,89 @@
+#ifndef __NODECACHE_H
+#define __NODECACHE_H
+
+/*
+
+ nodecache.h - Definitions for the passive node discovery cache - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+
+#ifdef NODE_CACHE
+
+#ifndef NODE_CACHE_LEN
+#define NODE_CACHE_LEN      16                  // Number of nodes remembered
+#endif
+
+#define NODE_UNKNOWN_BUS    0xFF                // Entry bus when the interface has not been seen
+
+/*
+ * What is known about a node. Manufacturer, module id and flags are only filled 
+ * in once a PNN or PARAMS from the node has been seen, until then they are zero.
+ * lastSeen is in units of 65536 ticks, about one second.
+ */
+typedef struct {
+    WORD    nn;
+    BYTE    canID;
+    BYTE    bus;                                // cbusNum the node was seen on, when known
+    BYTE    manufacturer;
+    BYTE    moduleId;
+    BYTE    flags;
+    WORD    lastSeen;
+} NodeCacheEntry;
+
+extern NodeCacheEntry   nodeCache[NODE_CACHE_LEN];
+extern BYTE             nodeCacheCount;         // Entries in use, from the start of nodeCache
+
+// Diagnostic variables for the node cache
+
+extern  WORD  nodeCacheEvictions;               // Nodes forgotten to make room for another
+
+void nodeCacheInit(void);
+void nodeCacheObserve(BYTE cbusNum, BYTE *msg);
+NodeCacheEntry *nodeCacheFind(WORD nn);
+WORD nodeCacheAge(NodeCacheEntry *entry);
+void nodeCacheExpire(WORD maxAge);
+
+#endif  // NODE_CACHE
+
+#endif	// __NODECACHE_H
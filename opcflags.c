@@ -0,0 +1,124 @@
+/*
+
+ Opcode dispatch table - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+#include "opcflags.h"
+#include "can18.h"
+
+/**
+ * The table of flags for each opcode, indexed by opcode.
+ * Generated at compile time from cbusdefs.h, see OPF_OF().
+ */
+#ifdef __XC8__
+const BYTE opcFlags[256] = {
+#else
+rom BYTE opcFlags[256] = {
+#endif
+    /* 0x00 */ OPF_OF(0x00), OPF_OF(0x01), OPF_OF(0x02), OPF_OF(0x03), OPF_OF(0x04), OPF_OF(0x05), OPF_OF(0x06), OPF_OF(0x07), OPF_OF(0x08), OPF_OF(0x09), OPF_OF(0x0A), OPF_OF(0x0B), OPF_OF(0x0C), OPF_OF(0x0D), OPF_OF(0x0E), OPF_OF(0x0F),
+    /* 0x10 */ OPF_OF(0x10), OPF_OF(0x11), OPF_OF(0x12), OPF_OF(0x13), OPF_OF(0x14), OPF_OF(0x15), OPF_OF(0x16), OPF_OF(0x17), OPF_OF(0x18), OPF_OF(0x19), OPF_OF(0x1A), OPF_OF(0x1B), OPF_OF(0x1C), OPF_OF(0x1D), OPF_OF(0x1E), OPF_OF(0x1F),
+    /* 0x20 */ OPF_OF(0x20), OPF_OF(0x21), OPF_OF(0x22), OPF_OF(0x23), OPF_OF(0x24), OPF_OF(0x25), OPF_OF(0x26), OPF_OF(0x27), OPF_OF(0x28), OPF_OF(0x29), OPF_OF(0x2A), OPF_OF(0x2B), OPF_OF(0x2C), OPF_OF(0x2D), OPF_OF(0x2E), OPF_OF(0x2F),
+    /* 0x30 */ OPF_OF(0x30), OPF_OF(0x31), OPF_OF(0x32), OPF_OF(0x33), OPF_OF(0x34), OPF_OF(0x35), OPF_OF(0x36), OPF_OF(0x37), OPF_OF(0x38), OPF_OF(0x39), OPF_OF(0x3A), OPF_OF(0x3B), OPF_OF(0x3C), OPF_OF(0x3D), OPF_OF(0x3E), OPF_OF(0x3F),
+    /* 0x40 */ OPF_OF(0x40), OPF_OF(0x41), OPF_OF(0x42), OPF_OF(0x43), OPF_OF(0x44), OPF_OF(0x45), OPF_OF(0x46), OPF_OF(0x47), OPF_OF(0x48), OPF_OF(0x49), OPF_OF(0x4A), OPF_OF(0x4B), OPF_OF(0x4C), OPF_OF(0x4D), OPF_OF(0x4E), OPF_OF(0x4F),
+    /* 0x50 */ OPF_OF(0x50), OPF_OF(0x51), OPF_OF(0x52), OPF_OF(0x53), OPF_OF(0x54), OPF_OF(0x55), OPF_OF(0x56), OPF_OF(0x57), OPF_OF(0x58), OPF_OF(0x59), OPF_OF(0x5A), OPF_OF(0x5B), OPF_OF(0x5C), OPF_OF(0x5D), OPF_OF(0x5E), OPF_OF(0x5F),
+    /* 0x60 */ OPF_OF(0x60), OPF_OF(0x61), OPF_OF(0x62), OPF_OF(0x63), OPF_OF(0x64), OPF_OF(0x65), OPF_OF(0x66), OPF_OF(0x67), OPF_OF(0x68), OPF_OF(0x69), OPF_OF(0x6A), OPF_OF(0x6B), OPF_OF(0x6C), OPF_OF(0x6D), OPF_OF(0x6E), OPF_OF(0x6F),
+    /* 0x70 */ OPF_OF(0x70), OPF_OF(0x71), OPF_OF(0x72), OPF_OF(0x73), OPF_OF(0x74), OPF_OF(0x75), OPF_OF(0x76), OPF_OF(0x77), OPF_OF(0x78), OPF_OF(0x79), OPF_OF(0x7A), OPF_OF(0x7B), OPF_OF(0x7C), OPF_OF(0x7D), OPF_OF(0x7E), OPF_OF(0x7F),
+    /* 0x80 */ OPF_OF(0x80), OPF_OF(0x81), OPF_OF(0x82), OPF_OF(0x83), OPF_OF(0x84), OPF_OF(0x85), OPF_OF(0x86), OPF_OF(0x87), OPF_OF(0x88), OPF_OF(0x89), OPF_OF(0x8A), OPF_OF(0x8B), OPF_OF(0x8C), OPF_OF(0x8D), OPF_OF(0x8E), OPF_OF(0x8F),
+    /* 0x90 */ OPF_OF(0x90), OPF_OF(0x91), OPF_OF(0x92), OPF_OF(0x93), OPF_OF(0x94), OPF_OF(0x95), OPF_OF(0x96), OPF_OF(0x97), OPF_OF(0x98), OPF_OF(0x99), OPF_OF(0x9A), OPF_OF(0x9B), OPF_OF(0x9C), OPF_OF(0x9D), OPF_OF(0x9E), OPF_OF(0x9F),
+    /* 0xA0 */ OPF_OF(0xA0), OPF_OF(0xA1), OPF_OF(0xA2), OPF_OF(0xA3), OPF_OF(0xA4), OPF_OF(0xA5), OPF_OF(0xA6), OPF_OF(0xA7), OPF_OF(0xA8), OPF_OF(0xA9), OPF_OF(0xAA), OPF_OF(0xAB), OPF_OF(0xAC), OPF_OF(0xAD), OPF_OF(0xAE), OPF_OF(0xAF),
+    /* 0xB0 */ OPF_OF(0xB0), OPF_OF(0xB1), OPF_OF(0xB2), OPF_OF(0xB3), OPF_OF(0xB4), OPF_OF(0xB5), OPF_OF(0xB6), OPF_OF(0xB7), OPF_OF(0xB8), OPF_OF(0xB9), OPF_OF(0xBA), OPF_OF(0xBB), OPF_OF(0xBC), OPF_OF(0xBD), OPF_OF(0xBE), OPF_OF(0xBF),
+    /* 0xC0 */ OPF_OF(0xC0), OPF_OF(0xC1), OPF_OF(0xC2), OPF_OF(0xC3), OPF_OF(0xC4), OPF_OF(0xC5), OPF_OF(0xC6), OPF_OF(0xC7), OPF_OF(0xC8), OPF_OF(0xC9), OPF_OF(0xCA), OPF_OF(0xCB), OPF_OF(0xCC), OPF_OF(0xCD), OPF_OF(0xCE), OPF_OF(0xCF),
+    /* 0xD0 */ OPF_OF(0xD0), OPF_OF(0xD1), OPF_OF(0xD2), OPF_OF(0xD3), OPF_OF(0xD4), OPF_OF(0xD5), OPF_OF(0xD6), OPF_OF(0xD7), OPF_OF(0xD8), OPF_OF(0xD9), OPF_OF(0xDA), OPF_OF(0xDB), OPF_OF(0xDC), OPF_OF(0xDD), OPF_OF(0xDE), OPF_OF(0xDF),
+    /* 0xE0 */ OPF_OF(0xE0), OPF_OF(0xE1), OPF_OF(0xE2), OPF_OF(0xE3), OPF_OF(0xE4), OPF_OF(0xE5), OPF_OF(0xE6), OPF_OF(0xE7), OPF_OF(0xE8), OPF_OF(0xE9), OPF_OF(0xEA), OPF_OF(0xEB), OPF_OF(0xEC), OPF_OF(0xED), OPF_OF(0xEE), OPF_OF(0xEF),
+    /* 0xF0 */ OPF_OF(0xF0), OPF_OF(0xF1), OPF_OF(0xF2), OPF_OF(0xF3), OPF_OF(0xF4), OPF_OF(0xF5), OPF_OF(0xF6), OPF_OF(0xF7), OPF_OF(0xF8), OPF_OF(0xF9), OPF_OF(0xFA), OPF_OF(0xFB), OPF_OF(0xFC), OPF_OF(0xFD), OPF_OF(0xFE), OPF_OF(0xFF)
+};
+
+#ifdef NUM_APP_HANDLERS
+/*
+ * Application registered handlers. Kept as a short list in RAM rather than
+ * in the table above so that the table can stay in program memory.
+ */
+static BYTE         appHandlerOpc[NUM_APP_HANDLERS];
+static OpcHandler   appHandler[NUM_APP_HANDLERS];
+static BYTE         numAppHandlers = 0;
+
+/**
+ * Register an application handler for an opcode.
+ * Registering a second handler for the same opcode replaces the first.
+ * 
+ * @param opc the opcode
+ * @param handler the function to be called with the received message
+ * @return TRUE if registered, FALSE if there is no space
+ */
+BOOL registerOpcHandler(BYTE opc, OpcHandler handler) {
+    BYTE i;
+    
+    for (i=0; i<numAppHandlers; i++) {
+        if (appHandlerOpc[i] == opc) {
+            appHandler[i] = handler;
+            return TRUE;
+        }
+    }
+    if (numAppHandlers >= NUM_APP_HANDLERS) return FALSE;
+    appHandlerOpc[numAppHandlers] = opc;
+    appHandler[numAppHandlers] = handler;
+    numAppHandlers++;
+    return TRUE;
+}
+
+/**
+ * Pass a received message to any application handler registered for its opcode.
+ * 
+ * @param msg the received CBUS message
+ * @return TRUE if a handler processed the message
+ */
+BOOL dispatchAppHandler(BYTE *msg) {
+    BYTE i;
+    
+    for (i=0; i<numAppHandlers; i++) {
+        if (appHandlerOpc[i] == msg[d0]) {
+            return appHandler[i](msg);
+        }
+    }
+    return FALSE;
+}
+#endif
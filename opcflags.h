@@ -0,0 +1,123 @@
+#ifndef __OPCFLAGS_H
+#define __OPCFLAGS_H
+
+/*
+
+ opcflags.h - Opcode dispatch table for received CBUS messages - part of CBUS libraries for PIC 18F
+
+  This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                   and indicate if changes were made. You may do so in any reasonable manner,
+                   but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                  your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                  legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+**************************************************************************************************************
+  Note:   This source code has been written using a tab stop and indentation setting
+          of 4 characters. To see everything lined up correctly, please set your
+          IDE or text editor to the same settings.
+******************************************************************************************************
+	
+ For library version number and revision history see CBUSLib.h
+
+*/
+
+/**
+ * Opcode dispatch.
+ * 
+ * Every received opcode is looked up in a 256 entry table held in program
+ * memory. Each entry is a set of flags saying which part of the library, if any,
+ * handles that opcode and in which FLiM state. parseCBUSMsg() uses a single
+ * indexed read of this table to route a frame, rather than passing every
+ * frame through the mask test and each of the parseFLiMCmd() switch blocks in turn.
+ * Opcodes with no flags set are not processed by the library at all.
+ * 
+ * The table is built at compile time from the opcode values in cbusdefs.h so it
+ * follows any changes to that file.
+ * 
+ * The data length of an opcode is not held in the table as it is given by
+ * the top 3 bits of the opcode, see cbusDataLen().
+ * 
+ * Applications may additionally register their own handlers for particular
+ * opcodes by defining NUM_APP_HANDLERS in module.h and calling
+ * registerOpcHandler(). Registered handlers are called before the library's
+ * own processing and may claim the message by returning TRUE.
+ */
+
+#include "GenericTypeDefs.h"
+#include "module.h"
+#include "cbusdefs.h"
+#include "events.h"
+
+// Opcode flags
+#define OPF_EVENT   0x01    // An event, passed to parseCbusEvent()
+#define OPF_LEARN   0x02    // Processed when in learn mode
+#define OPF_THISNN  0x04    // Processed when addressed to this node
+#define OPF_GLOBAL  0x08    // Processed whatever node it is addressed to
+#define OPF_SETUP   0x10    // Processed when in setup mode
+#define OPF_STREAM  0x20    // Long message packet, passed to cbusLongRx()
+#define OPF_NNSRC   0x40    // Node number is that of the sending node, used by the node cache
+
+#define OPF_FLIM    (OPF_LEARN | OPF_THISNN | OPF_GLOBAL | OPF_SETUP)
+
+// Compile time generation of the flags for an opcode
+#define OPF_IS_EVENT(o) ((((o) & EVENT_SET_MASK) == EVENT_SET_MASK) && (((~(o)) & EVENT_CLR_MASK) == EVENT_CLR_MASK))
+
+#define OPF_OF(o) ( \
+    (OPF_IS_EVENT(o) ? OPF_EVENT : 0) | \
+    ((o) == OPC_NNLRN ? OPF_LEARN | OPF_THISNN : 0) | \
+    (((o) == OPC_NNULN) || ((o) == OPC_NNCLR) || ((o) == OPC_EVULN) || \
+     ((o) == OPC_EVLRN) || ((o) == OPC_EVLRNI) || ((o) == OPC_REQEV) ? OPF_LEARN : 0) | \
+    (((o) == OPC_RQNPN) || ((o) == OPC_NNEVN) || ((o) == OPC_NERD) || \
+     ((o) == OPC_NENRD) || ((o) == OPC_RQEVN) || ((o) == OPC_NVRD) || \
+     ((o) == OPC_NVSET) || ((o) == OPC_REVAL) || ((o) == OPC_BOOT) || \
+     ((o) == OPC_CANID) || ((o) == OPC_ENUM) ? OPF_THISNN : 0) | \
+    (((o) == OPC_QNN) || ((o) == OPC_AREQ) || ((o) == OPC_ASRQ) ? OPF_GLOBAL : 0) | \
+    (((o) == OPC_RQNP) || ((o) == OPC_RQMN) || ((o) == OPC_SNN) ? OPF_SETUP : 0) | \
+    ((o) == OPC_DTXC ? OPF_STREAM : 0) | \
+    (((o) == OPC_RQNN) || ((o) == OPC_NNREL) || ((o) == OPC_NNACK) || \
+     ((o) == OPC_WRACK) || ((o) == OPC_CMDERR) || ((o) == OPC_EVNLF) || \
+     ((o) == OPC_NUMEV) || ((o) == OPC_NVANS) || ((o) == OPC_PARAN) || \
+     ((o) == OPC_NEVAL) || ((o) == OPC_PNN) || ((o) == OPC_EVANS) || \
+     ((o) == OPC_ENRSP) || ((o) == OPC_ARON) || ((o) == OPC_AROF) || \
+     ((o) == OPC_ARSON) || ((o) == OPC_ARSOF) || ((o) == OPC_ACDAT) ? OPF_NNSRC : 0))
+
+#ifdef __XC8__
+extern const BYTE opcFlags[256];
+#else
+extern rom BYTE opcFlags[256];
+#endif
+
+#define getOpcFlags(opc)    (opcFlags[(opc)])
+
+#ifdef NUM_APP_HANDLERS
+typedef BOOL (*OpcHandler)(BYTE *msg);
+
+extern BOOL registerOpcHandler(BYTE opc, OpcHandler handler);
+extern BOOL dispatchAppHandler(BYTE *msg);
+#endif
+
+#endif	// __OPCFLAGS_H
@@ -71,6 +71,22 @@ FlashFlags  flashFlags;
 BYTE        flashbuf[64];    // Assumes that Erase and Write are the same size
 BYTE        flashidx;
 WORD        flashblock;     //address of current 64 byte flash block
+#ifdef TEACH_SESSION
+BOOL        flashDeferred;  // flushFlashImage leaves changes in the buffer
+#endif
+
+// Diagnostic counters
+WORD        flashWriteCount;    // 64 byte blocks written
+WORD        flashEraseCount;    // of which needed an erase first
+
+#ifdef EVENT_RAM_MIRROR
+BYTE *      flashMirror;        // RAM copy of flash starting at flashMirrorStart
+WORD        flashMirrorStart;
+WORD        flashMirrorLen;
+#else
+// without a mirror every read is through the buffer
+#define loadFlashBlock readFlashBlock
+#endif
 
 #ifndef __XC8__
 //#pragma code APP
@@ -80,7 +96,7 @@ WORD        flashblock;     //address of current 64 byte flash block
 
 void writeFlashShort(void);
 void writeFlashWithErase(void);
-BYTE readFlashBlock(WORD flashAddr);
+BYTE loadFlashBlock(WORD flashAddr);
 
 /**
  *  Initialise variables for Flash program tracking.
@@ -90,6 +106,12 @@ void initRomOps(void)
 {
     flashFlags.asByte = 0;
     flashblock = 0xFFFF;
+#ifdef EVENT_RAM_MIRROR
+    flashMirrorLen = 0;
+#endif
+#ifdef TEACH_SESSION
+    flashDeferred = FALSE;
+#endif
 }
 
 
@@ -213,15 +235,36 @@ void  writeFlashWithErase(void)
 
 /**
  * If the buffer has unwritten changes then write these out to Flash.
+ * Whilst flashDeferred is set the changes are kept in the buffer and only 
+ * written when another block is needed or commitFlashImage() is called.
  */
  void flushFlashImage( void ) 
+ {
+#ifdef TEACH_SESSION
+     if (flashDeferred) 
+         return;
+#endif
+     commitFlashImage();
+ }
+
+/**
+ * Write any unwritten changes in the buffer out to Flash now.
+ */
+ void commitFlashImage( void ) 
  {
      if (flashFlags.modified) 
      {
+        flashWriteCount++;
         if(flashFlags.zeroto1) 
+        {
+            flashEraseCount++;
             writeFlashWithErase();
+        }
         else
             writeFlashShort();
+        // buffer and Flash now agree so don't write the same block again
+        flashFlags.modified = 0;
+        flashFlags.zeroto1 = 0;
      }
  }
 
@@ -240,7 +283,7 @@ void  writeFlashWithErase(void)
  * @param addr the address to be read from Flash
  * @return the byte read from Flash
  */
-BYTE readFlashBlock(WORD flashAddr) 
+BYTE loadFlashBlock(WORD flashAddr) 
 {
     WORD ptr;
     // check we are only reading within the persistent data area
@@ -258,7 +301,7 @@ BYTE readFlashBlock(WORD flashAddr)
     if(flashFlags.loaded && flashblock!=(flashAddr & 0XFFC0)) 
     {
         //detected access from a different block so we need to write this one (if it has been changed)
-        flushFlashImage();
+        commitFlashImage();
         flashFlags.asByte=5;
     }
 
@@ -299,6 +342,41 @@ _endasm
     return flashbuf[flashAddr & 0X3F];
 }
 
+#ifdef EVENT_RAM_MIRROR
+/**
+ * Read a byte from flash, from the RAM mirror if the address is mirrored 
+ * otherwise through the buffer.
+ * @param addr the address to be read from Flash
+ * @return the byte read from Flash
+ */
+BYTE readFlashBlock(WORD flashAddr) 
+{
+    if ((WORD)(flashAddr - flashMirrorStart) < flashMirrorLen) 
+        return flashMirror[flashAddr - flashMirrorStart];
+    return loadFlashBlock(flashAddr);
+}
+
+/**
+ * Copy an area of flash into RAM. Reads of the area are then served from RAM
+ * without disturbing the 64 byte buffer, writes update both. Only one area 
+ * can be mirrored.
+ * @param mirror the RAM to hold the copy, len bytes
+ * @param start address of the area in flash
+ * @param len length of the area
+ */
+void setFlashMirror(BYTE * mirror, WORD start, WORD len) 
+{
+    WORD i;
+    
+    flashMirrorLen = 0;     // read the current contents, including anything in the buffer
+    for (i=0; i<len; i++) 
+        mirror[i] = loadFlashBlock(start + i);
+    flashMirror = mirror;
+    flashMirrorStart = start;
+    flashMirrorLen = len;
+}
+#endif
+
 
 /**
  * Write a byte to the FLASH image. You may need to flush current image to Flash if necessary.
@@ -321,7 +399,7 @@ void writeFlashImage(BYTE * addr, BYTE data)
     }
 
     if (!flashFlags.loaded || flashblock!=((WORD)addr & 0XFFC0)) 
-        readFlashBlock((WORD)addr);
+        loadFlashBlock((WORD)addr);
     
     offset = &flashbuf[(WORD)addr & 0x3F];
 
@@ -331,6 +409,10 @@ void writeFlashImage(BYTE * addr, BYTE data)
     if(data & ~*offset) 
         flashFlags.zeroto1=1;
     *offset=data;
+#ifdef EVENT_RAM_MIRROR
+    if ((WORD)((WORD)addr - flashMirrorStart) < flashMirrorLen) 
+        flashMirror[(WORD)addr - flashMirrorStart] = data;
+#endif
 }
 
 /**
@@ -390,7 +472,7 @@ BYTE ee_read(WORD addr) {
     EECON1bits.RD = 1;			/* EEPROM Read */
     while (EECON1bits.RD)
         ;
-#ifdef __XC8
+#ifdef __XC8__
     asm("NOP");                 /* data available after a NOP */
 #else
      _asm
@@ -469,7 +551,7 @@ void ee_write_short(WORD addr, WORD data) {
 /**
  * Read the DevId from the Config area
  */
-#ifdef __XC8__
+#ifdef __XC8
 extern const WORD devId @0x3FFFFE;
 #endif
 WORD readCPUType( void ) {
@@ -105,8 +105,19 @@ void writeFlashImage(BYTE * addr, BYTE data);
 void setFlashWord( WORD * flashAddr, WORD flashData );
 void setFlashBuffer( BYTE * flashAddr, BYTE *bufferaddr, BYTE bufferSize );
 void flushFlashImage( void );
+void commitFlashImage( void );
 BYTE readFlashBlock(WORD flashAddr);
 
+extern WORD flashblock;     // address of the 64 byte flash block in the write buffer
+#ifdef TEACH_SESSION
+extern BOOL flashDeferred;  // set to keep changes in the write buffer until commitFlashImage()
+#endif
+extern WORD flashWriteCount;
+extern WORD flashEraseCount;
+#ifdef EVENT_RAM_MIRROR
+void setFlashMirror(BYTE * mirror, WORD start, WORD len);
+#endif
+
 
 BYTE ee_read(WORD addr);
 void ee_write(WORD addr, BYTE data);
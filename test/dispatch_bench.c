@@ -0,0 +1,198 @@
+/*
+ * Benchmark of received message dispatch through parseCBUSMsg(). A traffic
+ * mix for a busy layout is recorded with the capture module and played back
+ * as fast as possible with the replay module, so every frame takes the same
+ * path as a received one. The node is in FLiM with 64 events learnt. The 
+ * mix is also replayed without the events, as their cost is mostly the event
+ * lookup rather than the dispatch.
+ *
+ * Mix, per 100 frames:
+ *  40 long events ACON/ACOF, a quarter of them learnt
+ *  20 short events ASON/ASOF, a quarter of them learnt
+ *  20 cab traffic DSPD/DKEEP, which the library does not handle
+ *  10 replies from other nodes PNN/NNACK/WRACK/NVANS
+ *  10 configuration for other nodes RQNPN/NVRD/NERD/RQEVN
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module.h"
+#include "cbus.h"
+#include "romops.h"
+#include "FliM.h"
+#include "events.h"
+#include "capture.h"
+
+#define FRAMES      4000                // Frames in the recording
+#define ROUNDS      50                  // Times it is replayed
+#define LEARNT      64                  // Events learnt
+
+// Normally provided by cbus.c, can18.c and the application
+
+WORD        nodeID = 256;
+BYTE        canID = 5;
+BYTE        cbusMsg[sizeof(CanPacket)];
+const ParamVals FLiMparams;
+const FCUParams FCUparams;
+
+BYTE *cbusMakeMsg(BYTE *msg, BYTE opc, BYTE *data) { msg[d0] = opc; return msg; }
+BYTE *cbusMakeMsgNN(BYTE *msg, BYTE opc, WORD nn, BYTE *data) { msg[d0] = opc; return msg; }
+BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg) { return TRUE; }
+BYTE cbusSendBatch(BYTE cbusNum, CanPacket *msgs, BYTE count) { return count; }
+void cbusInit(WORD initNodeID) { }
+BOOL setNewCanId(BYTE newCanId) { return TRUE; }
+void doEnum(BOOL sendResult) { }
+void setSLiMLed(void) { }
+void setFLiMLed(void) { }
+void setStatusLed(BOOL FLiMLED) { }
+void startFLiMFlash(BOOL fast) { }
+BOOL validateNV(BYTE NVindex, BYTE oldValue, BYTE newValue) { return TRUE; }
+void actUponNVchange(BYTE NVindex, BYTE oldValue, BYTE NVvalue) { }
+unsigned char APP_addEvent(WORD nodeNumber, WORD eventNumber, BYTE evNum, BYTE evVal, BOOL forceOwnNN) { return 0; }
+
+static DWORD consumed;
+
+void processEvent(EVENT_INDEX_T action, BYTE *msg)
+{
+    consumed++;
+}
+
+static BYTE recording[FRAMES * 16];
+static WORD recordingLen;
+static DWORD recordedFrames;
+
+/**
+ * Make the next frame of the mix.
+ */
+static void makeFrame(CanPacket *pkt, int i)
+{
+    BYTE    *p = pkt->buffer;
+    int     kind = i % 100;
+    WORD    nn = 300 + rand() % 40;
+    WORD    en = rand() % (LEARNT * 2);     // A quarter of them learnt
+
+    memset(p, 0, sizeof(CanPacket));
+    p[sidh] = 0xB0 | (rand() & 0x0F);
+    p[sidl] = (rand() & 0x07) << 5;
+    if (kind < 40)
+    {
+        p[d0] = (kind & 1) ? OPC_ACOF : OPC_ACON;
+        p[d1] = nn >> 8;
+        p[d2] = nn & 0xFF;
+    }
+    else if (kind < 60)
+    {
+        p[d0] = (kind & 1) ? OPC_ASOF : OPC_ASON;
+        p[d1] = rand();
+        p[d2] = rand();
+    }
+    else if (kind < 80)
+    {
+        p[d0] = (kind & 1) ? OPC_DKEEP : OPC_DSPD;
+        p[d1] = rand() & 0x0F;
+        p[d2] = rand();
+    }
+    else if (kind < 90)
+    {
+        static const BYTE replies[] = { OPC_PNN, OPC_NNACK, OPC_WRACK, OPC_NVANS };
+        p[d0] = replies[kind & 3];
+        p[d1] = nn >> 8;
+        p[d2] = nn & 0xFF;
+        p[d3] = rand();
+        p[d4] = rand();
+    }
+    else
+    {
+        static const BYTE requests[] = { OPC_RQNPN, OPC_NVRD, OPC_NERD, OPC_RQEVN };
+        p[d0] = requests[kind & 3];
+        p[d1] = nn >> 8;
+        p[d2] = nn & 0xFF;
+        p[d3] = rand();
+    }
+    if (p[d0] == OPC_ACON || p[d0] == OPC_ACOF || p[d0] == OPC_ASON || p[d0] == OPC_ASOF)
+    {
+        if ((en < LEARNT/2) && (kind < 40))
+        {
+            // the learnt long events are 300:0 to 300:31
+            p[d1] = 300 >> 8;
+            p[d2] = 300 & 0xFF;
+        }
+        p[d3] = en >> 8;
+        p[d4] = en & 0xFF;
+    }
+    p[dlc] = (p[d0] >> 5) + 1;
+}
+
+/**
+ * Record the mix.
+ * @param events FALSE to leave out the events
+ */
+static void record(BOOL events)
+{
+    CanPacket   pkt;
+    int         i;
+
+    srand(29);
+    captureStart(0);
+    recordingLen = captureRead(recording, 255);
+    for (i=0; i<FRAMES; i++)
+    {
+        makeFrame(&pkt, i);
+        hostTicks += 30;                    // A frame about every 500us
+        if (!events && (i % 100 < 60))
+            continue;
+        captureRecord(FALSE, &pkt);
+        recordingLen += captureRead(recording + recordingLen, 255);
+    }
+    captureStop();
+    recordedFrames = captureFrames;
+    CHECK(captureOflowCount == 0);
+}
+
+/**
+ * Replay the recording as fast as possible.
+ */
+static void replay(const char *name)
+{
+    DWORD   frames = 0;
+    DWORD   loads = hostFlashTableReads;
+    DWORD   events = consumed;
+    double  start = hostNow();
+    double  secs;
+    int     r;
+
+    for (r=0; r<ROUNDS; r++)
+    {
+        CHECK(replayStart(recording, recordingLen, REPLAY_AFAP));
+        while (replayPoll())
+            ;
+        frames += replayFrames;
+    }
+    secs = hostNow() - start;
+    CHECK(frames == recordedFrames * ROUNDS);
+
+    printf("%-16s %7lu frames %6lu consumed %6.3f blocks loaded %6.1f ns per frame\n", name,
+            (unsigned long)frames, (unsigned long)(consumed - events),
+            (double)(hostFlashTableReads - loads) / 64 / frames, secs * 1e9 / frames);
+}
+
+int main(void)
+{
+    WORD        en;
+
+    initRomOps();
+    clearAllEvents();
+    eventsInit();
+    for (en=0; en<LEARNT/2; en++)
+    {
+        CHECK(addEvent(300, en, 1, en, FALSE) == 0);
+        CHECK(addEvent(0, en, 1, en, FALSE) == 0);      // Short events have NN 0
+    }
+    flimState = fsFLiM;
+
+    record(TRUE);
+    replay("whole mix");
+    record(FALSE);
+    replay("without events");
+    return hostFailures ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Benchmark of the event table read path, built with and without 
+ * EVENT_RAM_MIRROR. 60 events have 20 EVs each, with their continuation rows
+ * in other flash blocks, and each received event does a findEvent() and a 
+ * getEVs(). This is done with only reads, then with an NV write left pending 
+ * in the flash buffer before each event, which forces the buffer to be written
+ * before another block can be loaded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module.h"
+#include "cbus.h"
+#include "romops.h"
+#include "FliM.h"
+#include "events.h"
+
+#define EVENTS      60
+#define RECEIVED    20000               // Events received in each run
+
+// Normally provided by FliM.c and the application
+
+WORD nodeID = 256;
+
+BYTE *cbusMakeMsgNN(BYTE *msg, BYTE opc, WORD nn, BYTE *data) { return msg; }
+BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg) { return TRUE; }
+BYTE cbusSendBatch(BYTE cbusNum, CanPacket *msgs, BYTE count) { return count; }
+void doError(BYTE code) { }
+void processEvent(EVENT_INDEX_T action, BYTE *msg) { }
+
+static void run(const char *name, BOOL nvWrite)
+{
+    DWORD   loads = hostFlashTableReads;
+    DWORD   writes = hostFlashRowWrites;
+    double  start = hostNow();
+    EVENT_INDEX_T tableIndex;
+    int     i, n, ev;
+
+    for (i=0; i<RECEIVED; i++)
+    {
+        n = i % EVENTS;
+        if (nvWrite)
+            writeFlashImage((BYTE *)(AT_NV + 1), i);
+        tableIndex = findEvent(100 + n, n);
+        CHECK(tableIndex != NO_INDEX);
+        CHECK(getEVs(tableIndex) == 0);
+        for (ev=0; ev<EVperEVT; ev++)
+            CHECK(evs[ev] == (BYTE)(n + ev));
+    }
+    flushFlashImage();
+    printf("%-34s %8.2f blocks loaded %8.2f blocks written %7.0f ns per event\n", name, 
+            (double)(hostFlashTableReads - loads) / 64 / RECEIVED, 
+            (double)(hostFlashRowWrites - writes) / RECEIVED,
+            (hostNow() - start) * 1e9 / RECEIVED);
+}
+
+int main(void)
+{
+    int     n, ev;
+
+    initRomOps();
+    clearAllEvents();
+    eventsInit();
+    // all the first rows, then all the continuation rows
+    for (n=0; n<EVENTS; n++)
+        for (ev=0; ev<EVENT_TABLE_WIDTH; ev++)
+            CHECK(addEvent(100 + n, n, ev, n + ev, FALSE) == 0);
+    for (n=0; n<EVENTS; n++)
+        for (ev=EVENT_TABLE_WIDTH; ev<EVperEVT; ev++)
+            CHECK(addEvent(100 + n, n, ev, n + ev, FALSE) == 0);
+    // as after a power up
+    initRomOps();
+    eventsInit();
+
+#ifdef EVENT_RAM_MIRROR
+    printf("EVENT_RAM_MIRROR, %d bytes\n", (int)(NUM_EVENTS * sizeof(EventTable)));
+#else
+    printf("no mirror\n");
+#endif
+    run("findEvent and getEVs", FALSE);
+    run("with an NV write pending", TRUE);
+    return hostFailures ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Micro-benchmark for the GridConnect codec. Encodes and decodes a mix of 
+ * standard CBUS frames with 0 to 8 data bytes, one in eight of them extended,
+ * whole frame at a time, a character at a time as the UART transport does, 
+ * and in bulk on TCP segment sized buffers as the TCP transport does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostpic.h"
+#include "gridconnect.h"
+
+#define FRAMES      1024                // Different frames in the mix
+#define ROUNDS      1000                // Times through the mix
+#define SEGMENT     1460                // TCP segment size
+
+static CanPacket    pkts[FRAMES];
+static BYTE         text[FRAMES * GC_MAX_FRAME_LEN];
+static WORD         textLen;
+static volatile BYTE sink;
+
+static void report(const char *name, double start)
+{
+    double secs = hostNow() - start;
+    double frames = (double)FRAMES * ROUNDS;
+
+    printf("%-34s %7.1f ns/frame %8.2f Mframes/s %7.1f MB/s\n", name, secs * 1e9 / frames, 
+            frames / secs / 1e6, (double)textLen * ROUNDS / secs / 1e6);
+}
+
+int main(void)
+{
+    GcEncoder   enc;
+    GcDecoder   dec;
+    CanPacket   out[64];
+    BYTE        buf[SEGMENT];
+    BYTE        used, done, c;
+    WORD        pos, n, consumed, got;
+    int         r, i;
+    double      start;
+
+    srand(27);
+    for (i=0; i<FRAMES; i++)
+    {
+        BYTE *p = pkts[i].buffer;
+        BYTE len = rand() % 9;
+
+        p[sidh] = rand();
+        p[sidl] = (i % 8 == 0) ? (rand() & 0xE3) | GC_EXIDE : rand() & 0xE0;
+        p[eidh] = rand();
+        p[eidl] = rand();
+        p[dlc] = len;
+        for (c=0; c<len; c++)
+            p[d0+c] = rand();
+    }
+    for (i=0; i<FRAMES; i++)
+        textLen += gcEncodeFrame(text + textLen, &pkts[i]);
+
+    start = hostNow();
+    for (r=0; r<ROUNDS; r++)
+        for (i=0; i<FRAMES; i++)
+            sink = gcEncodeFrame(buf, &pkts[i]);
+    report("gcEncodeFrame", start);
+
+    start = hostNow();
+    for (r=0; r<ROUNDS; r++)
+        for (i=0; i<FRAMES; i++)
+        {
+            gcEncoderInit(&enc, &pkts[i]);
+            while (enc.pos < enc.len)
+                sink = gcEncode(&enc, &pkts[i], &c, 1);
+        }
+    report("gcEncode, a character per call", start);
+
+    start = hostNow();
+    for (r=0; r<ROUNDS; r++)
+        for (i=0; i<FRAMES; i+=done)
+            sink = gcEncodeFrames(buf, sizeof(buf), &pkts[i], (FRAMES - i > 255) ? 255 : FRAMES - i, &done);
+    report("gcEncodeFrames, segment buffers", start);
+
+    gcDecoderInit(&dec);
+    start = hostNow();
+    for (r=0; r<ROUNDS; r++)
+        for (pos=0, got=0; pos<textLen; pos++)
+            if (gcDecode(&dec, &out[0], &text[pos], 1, &used) == GC_FRAME)
+                got++;
+    report("gcDecode, a character per call", start);
+    if (got != FRAMES)
+        printf("decoded %u frames, expected %u\n", got, FRAMES);
+
+    start = hostNow();
+    for (r=0; r<ROUNDS; r++)
+        for (pos=0, got=0; pos<textLen; pos+=consumed)
+        {
+            n = (textLen - pos > SEGMENT) ? SEGMENT : textLen - pos;
+            done = gcDecodeFrames(&dec, &text[pos], n, out, 64, &consumed);
+            got += done;
+            if (done < 64)
+                out[0] = out[done];     // Carry on with a part decoded frame
+        }
+    report("gcDecodeFrames, segment buffers", start);
+    if (got != FRAMES)
+        printf("decoded %u frames, expected %u\n", got, FRAMES);
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Fuzz tests for the GridConnect codec: random frames round trip through
+ * the streaming and bulk encoders and decoders with the text split at random
+ * points, and malformed input - truncated frames, bad characters, too much 
+ * data and random noise - is rejected without damaging the following frame
+ * or writing past the packet.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostpic.h"
+#include "gridconnect.h"
+
+#define ITERATIONS  20000
+#define CANARY      0xA5
+
+typedef struct
+{
+    CanPacket   pkt;
+    BYTE        guard[32];              // Must still be CANARY after decoding
+} GuardedPacket;
+
+static GcDecoder    dec;
+
+static void randomPacket(CanPacket *p)
+{
+    BYTE len = rand() % 9;
+    int i;
+
+    memset(p, 0, sizeof(CanPacket));
+    p->buffer[sidh] = rand();
+    if (rand() & 1)
+    {
+        p->buffer[sidl] = (rand() & 0xE3) | GC_EXIDE;
+        p->buffer[eidh] = rand();
+        p->buffer[eidl] = rand();
+    }
+    else
+        p->buffer[sidl] = rand() & 0xE0;
+    p->buffer[dlc] = len | ((rand() % 4 == 0) ? 0x40 : 0);
+    for (i=0; i<len; i++)
+        p->buffer[d0+i] = rand();
+}
+
+static BOOL samePacket(CanPacket *a, CanPacket *b)
+{
+    BYTE len = a->buffer[dlc] & 0x0F;
+
+    return memcmp(a->buffer + sidh, b->buffer + sidh, (a->buffer[sidl] & GC_EXIDE) ? 4 : 2) == 0
+        && a->buffer[dlc] == b->buffer[dlc]
+        && len <= 8
+        && memcmp(a->buffer + d0, b->buffer + d0, len) == 0;
+}
+
+static void guardInit(GuardedPacket *g)
+{
+    memset(g, CANARY, sizeof(GuardedPacket));
+}
+
+static BOOL guardIntact(GuardedPacket *g)
+{
+    int i;
+
+    for (i=0; i<sizeof(g->guard); i++)
+        if (g->guard[i] != CANARY)
+            return FALSE;
+    return TRUE;
+}
+
+/**
+ * Decode text fed in random sized pieces.
+ * @return number of frames decoded, the last in g
+ */
+static int decodeSplit(BYTE *text, int len, GuardedPacket *g)
+{
+    int pos = 0, frames = 0;
+    BYTE used, chunk;
+
+    while (pos < len)
+    {
+        chunk = 1 + rand() % 12;
+        if (chunk > len - pos)
+            chunk = len - pos;
+        if (gcDecode(&dec, &g->pkt, text + pos, chunk, &used) == GC_FRAME)
+        {
+            frames++;
+            CHECK((g->pkt.buffer[dlc] & 0x0F) <= 8);
+        }
+        CHECK(used <= chunk);
+        pos += used;
+    }
+    CHECK(guardIntact(g));
+    return frames;
+}
+
+/**
+ * The streaming encoder, given random amounts of space, produces the same 
+ * text as gcEncodeFrame, and the text decodes back to the packet however it 
+ * is split and whatever noise is in front of it.
+ */
+static void testRoundTrip(void)
+{
+    CanPacket       pkt;
+    GuardedPacket   out;
+    GcEncoder       enc;
+    BYTE            text[GC_MAX_FRAME_LEN + 8];
+    BYTE            streamed[GC_MAX_FRAME_LEN];
+    BYTE            len, pos, i, noise;
+
+    randomPacket(&pkt);
+    noise = rand() % 8;
+    for (i=0; i<noise; i++)
+        text[i] = "0123456789ABCDEFNRSX;\r\n \xFF"[rand() % 25];
+    len = gcEncodeFrame(text + noise, &pkt);
+    CHECK(len <= GC_MAX_FRAME_LEN);
+
+    gcEncoderInit(&enc, &pkt);
+    CHECK(enc.len == len);
+    for (pos=0; enc.pos < enc.len; )
+        pos += gcEncode(&enc, &pkt, streamed + pos, 1 + rand() % 6);
+    CHECK(pos == len && memcmp(streamed, text + noise, len) == 0);
+
+    guardInit(&out);
+    CHECK(decodeSplit(text, noise + len, &out) == 1);
+    CHECK(samePacket(&out.pkt, &pkt));
+}
+
+/**
+ * Damage a frame in one of several ways and follow it with a good one. The
+ * damaged frame must not be delivered and the good one must be.
+ */
+static void testMalformed(void)
+{
+    CanPacket       bad, good;
+    GuardedPacket   out;
+    BYTE            text[3 * GC_MAX_FRAME_LEN + 40];
+    BYTE            len, cut, start, i, extra, errors;
+    int             frames;
+
+    randomPacket(&bad);
+    randomPacket(&good);
+    len = gcEncodeFrame(text, &bad);
+    switch (rand() % 4)
+    {
+        case 0:     // Truncated, just after the ':' at least
+            len = 1 + rand() % (len - 1);
+            break;
+        case 1:     // A character, other than the ':', replaced by one not valid there
+            cut = 1 + rand() % (len - 1);
+            start = (text[1] == 'X') ? 11 : 7;
+            text[cut] = (text[cut] == ';') ? 'G' : "G ;z\x80\x00-"[rand() % 7];
+            if ((text[cut] == ';') && (cut >= start) && (((cut - start) & 1) == 0))
+                text[cut] = 'G';    // Would end the frame early but validly
+            break;
+        case 2:     // Too much data
+            len--;
+            extra = 2 * (9 - (bad.buffer[dlc] & 0x0F)) + 2 * (rand() % 8);
+            for (i=0; i<extra; i++)
+                text[len++] = "0123456789ABCDEF"[rand() % 16];
+            text[len++] = ';';
+            break;
+        case 3:     // Odd number of data digits
+            len--;
+            text[len++] = "0123456789ABCDEF"[rand() % 16];
+            text[len++] = ';';
+            break;
+    }
+    len += gcEncodeFrame(text + len, &good);
+
+    guardInit(&out);
+    errors = dec.errors;
+    frames = decodeSplit(text, len, &out);
+    CHECK(frames == 1);
+    CHECK(samePacket(&out.pkt, &good));
+    CHECK(dec.errors != errors);
+}
+
+/**
+ * Random noise mostly made of GridConnect characters. Nothing decoded from 
+ * it may be too long, and the frame after it must come through.
+ */
+static void testNoise(void)
+{
+    CanPacket       good;
+    GuardedPacket   out;
+    BYTE            text[100 + GC_MAX_FRAME_LEN];
+    BYTE            i, len = 1 + rand() % 100;
+
+    for (i=0; i<len; i++)
+        text[i] = (rand() % 8) ? ":;SXNR0123456789ABCDEFabcdef"[rand() % 28] : rand();
+    text[len++] = ';';
+    randomPacket(&good);
+    len += gcEncodeFrame(text + len, &good);
+    guardInit(&out);
+    decodeSplit(text, len, &out);
+    CHECK(samePacket(&out.pkt, &good));
+}
+
+/**
+ * A run of frames through the bulk encoder and decoder, the text divided 
+ * into random sized buffers and the decoder allowed a random number of 
+ * frames each call, so frames are resumed across calls.
+ */
+static void testBulk(void)
+{
+    CanPacket   in[40], out[5];
+    BYTE        text[40 * GC_MAX_FRAME_LEN];
+    WORD        len = 0, pos = 0, used, space;
+    BYTE        count = 1 + rand() % 40, done, total = 0, n, i, max;
+
+    for (i=0; i<count; i++)
+        randomPacket(&in[i]);
+
+    // Only whole frames are written, even when there is not room for all of them
+    space = rand() % (sizeof(text) + 1);
+    len = gcEncodeFrames(text, space, in, count, &done);
+    CHECK(len <= space);
+    CHECK(done == count || space - len < GC_MAX_FRAME_LEN);
+    if (done < count)
+        len += gcEncodeFrames(text + len, sizeof(text) - len, in + done, count - done, &n);
+
+    while (pos < len)
+    {
+        max = 1 + rand() % 4;
+        space = 1 + rand() % 60;
+        if (space > len - pos)
+            space = len - pos;
+        n = gcDecodeFrames(&dec, text + pos, space, out, max, &used);
+        CHECK(n <= max && used <= space);
+        for (i=0; i<n; i++, total++)
+            CHECK(total < count && samePacket(&out[i], &in[total]));
+        out[0] = out[n < max ? n : 0];  // Carry on with a part decoded frame
+        pos += used;
+    }
+    CHECK(total == count);
+}
+
+int main(void)
+{
+    int i;
+
+    srand(27);
+    gcDecoderInit(&dec);
+    for (i=0; i<ITERATIONS; i++)
+    {
+        testRoundTrip();
+        testMalformed();
+        testNoise();
+        testBulk();
+    }
+    printf("%d iterations of round trip, malformed, noise and bulk\n", ITERATIONS);
+    printf("%s\n", hostFailures ? "FAILED" : "PASSED");
+    return hostFailures != 0;
+}
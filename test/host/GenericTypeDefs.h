@@ -0,0 +1,35 @@
+/*
+ * Host stand-in for the MLA GenericTypeDefs.h, used when building library
+ * modules with gcc for the tests in test/. Sizes match the PIC18 compilers.
+ */
+#ifndef __GENERIC_TYPE_DEFS_H_
+#define __GENERIC_TYPE_DEFS_H_
+
+#include <stdint.h>
+
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef uint32_t    DWORD;
+
+// A byte as on the PIC, so that structures of BOOL bit fields are one byte
+typedef enum __attribute__((packed)) _BOOL { FALSE = 0, TRUE } BOOL;
+
+typedef union
+{
+    WORD Val;
+    BYTE v[2];
+    struct
+    {
+        BYTE LB;
+        BYTE HB;
+    } byte;
+} WORD_VAL;
+
+typedef union
+{
+    DWORD Val;
+    WORD w[2];
+    BYTE v[4];
+} DWORD_VAL;
+
+#endif
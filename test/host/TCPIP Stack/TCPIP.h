@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for the MLA TCP/IP stack header: the TCP socket calls used
+ * by cbustcp.c, implemented by hosttcp.c on a loopback BSD socket.
+ */
+#ifndef __TCPIP_HCI_HEADER_H
+#define __TCPIP_HCI_HEADER_H
+
+#include "GenericTypeDefs.h"
+
+typedef BYTE TCP_SOCKET;
+
+#define INVALID_SOCKET                  0xFE
+#define TCP_OPEN_SERVER                 0
+#define TCP_PURPOSE_GENERIC_TCP_SERVER  0
+
+TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vSocketPurpose);
+BOOL TCPIsConnected(TCP_SOCKET hTCP);
+WORD TCPIsPutReady(TCP_SOCKET hTCP);
+WORD TCPPutArray(TCP_SOCKET hTCP, BYTE *Data, WORD Len);
+void TCPFlush(TCP_SOCKET hTCP);
+WORD TCPIsGetReady(TCP_SOCKET hTCP);
+WORD TCPGetArray(TCP_SOCKET hTCP, BYTE *buffer, WORD count);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Host stand-in for cbusdefs.h: the opcodes, error codes and parameter
+ * indexes used by the library, with values from the CBUS specification.
+ */
+#ifndef __CBUSDEFS_H_
+#define __CBUSDEFS_H_
+
+// Opcodes
+
+#define OPC_ACK     0x00
+#define OPC_QNN     0x0D
+#define OPC_RQNP    0x10
+#define OPC_RQMN    0x11
+#define OPC_DKEEP   0x23
+#define OPC_SNN     0x42
+#define OPC_DSPD    0x47
+#define OPC_RQNN    0x50
+#define OPC_NNREL   0x51
+#define OPC_NNACK   0x52
+#define OPC_NNLRN   0x53
+#define OPC_NNULN   0x54
+#define OPC_NNCLR   0x55
+#define OPC_NNEVN   0x56
+#define OPC_NERD    0x57
+#define OPC_RQEVN   0x58
+#define OPC_WRACK   0x59
+#define OPC_BOOT    0x5C
+#define OPC_ENUM    0x5D
+#define OPC_DFUN    0x60
+#define OPC_CMDERR  0x6F
+#define OPC_EVNLF   0x70
+#define OPC_NVRD    0x71
+#define OPC_NENRD   0x72
+#define OPC_RQNPN   0x73
+#define OPC_NUMEV   0x74
+#define OPC_CANID   0x75
+#define OPC_ACON    0x90
+#define OPC_ACOF    0x91
+#define OPC_AREQ    0x92
+#define OPC_ARON    0x93
+#define OPC_AROF    0x94
+#define OPC_EVULN   0x95
+#define OPC_NVSET   0x96
+#define OPC_NVANS   0x97
+#define OPC_ASON    0x98
+#define OPC_ASOF    0x99
+#define OPC_ASRQ    0x9A
+#define OPC_PARAN   0x9B
+#define OPC_REVAL   0x9C
+#define OPC_ARSON   0x9D
+#define OPC_ARSOF   0x9E
+#define OPC_REQEV   0xB2
+#define OPC_NEVAL   0xB5
+#define OPC_PNN     0xB6
+#define OPC_EVLRN   0xD2
+#define OPC_EVANS   0xD3
+#define OPC_NAME    0xE2
+#define OPC_DTXC    0xE9
+#define OPC_PARAMS  0xEF
+#define OPC_ENRSP   0xF2
+#define OPC_EVLRNI  0xF5
+#define OPC_ACDAT   0xF6
+
+// Error codes for OPC_CMDERR
+
+#define CMDERR_INV_CMD          1
+#define CMDERR_NOT_LRN          2
+#define CMDERR_NOT_SETUP        3
+#define CMDERR_TOO_MANY_EVENTS  4
+#define CMDERR_NO_EV            5
+#define CMDERR_INV_EV_IDX       6
+#define CMDERR_INVALID_EVENT    7
+#define CMDERR_INV_PARAM_IDX    9
+#define CMDERR_INV_NV_IDX       10
+#define CMDERR_INV_EV_VALUE     11
+#define CMDERR_INV_NV_VALUE     12
+
+// Parameter block
+
+#define PAR_FLAGS   8
+#define PAR_CPUMID  15
+#define PAR_CPUMAN  19
+
+#define PF_FLiM     4
+#define PF_LRN      32
+
+// Processor codes
+
+#define P18F2585    3
+#define P18F2680    4
+#define P18F2580    13
+#define P18F25K80   14
+#define P18F26K80   15
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Emulated PIC18 registers, program memory, EEPROM and tick timer for the
+ * host tests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "xc.h"
+#include "hostpic.h"
+
+volatile uint8_t EECON1, EECON2, EEADR, EEADRH, EEDATA, TABLAT, TBLPTRU;
+volatile uint8_t TXSTA1, RCSTA1, BAUDCON1, SPBRG1, SPBRGH1;
+volatile uint8_t TXSTA, RCSTA, BAUDCON, SPBRG, SPBRGH;
+volatile uint8_t T0CON, TMR0L, TMR0H;
+volatile uint16_t TBLPTR, FSR0;
+const uint16_t devId = 0x6180;          // 18F26K80
+volatile HostSfrBits INTCONbits, INTCON2bits, T0CONbits, PIR1bits, PIE1bits, PIR4bits;
+volatile HostSfrBits RCSTA1bits, TXSTA1bits, RCSTAbits, TXSTAbits;
+
+BYTE    hostEeprom[HOST_EEPROM_LEN];
+DWORD   hostFlashRowErases;
+DWORD   hostFlashRowWrites;
+DWORD   hostFlashTableReads;
+DWORD   hostTicks;
+BOOL    hostRealTime;
+WORD    hostResets;
+BYTE    hostFlimSw = 1;
+BYTE    hostLeds[4];
+int     hostFailures;
+
+// Normally provided by the application or other library modules
+
+__attribute__((weak)) BYTE clkMHz = 16;
+
+__attribute__((weak)) BOOL isSuitableTimeToWriteFlash(void)
+{
+    return TRUE;
+}
+
+static BYTE tableLatches[64];           // Holding registers written by TBLWT
+static volatile HostSfrBits eecon1;
+
+__attribute__((constructor)) static void hostPicInit(void)
+{
+    if (mmap((void *)HOST_FLASH, HOST_FLASH_LEN, PROT_READ | PROT_WRITE, 
+            MAP_FIXED_NOREPLACE | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) != (void *)HOST_FLASH)
+    {
+        perror("mapping emulated flash");
+        exit(2);
+    }
+    hostFlashClear();
+    memset(hostEeprom, 0xFF, sizeof(hostEeprom));
+    memset(tableLatches, 0xFF, sizeof(tableLatches));
+}
+
+/**
+ * Erase all of program memory.
+ */
+void hostFlashClear(void)
+{
+    memset((void *)HOST_FLASH, 0xFF, HOST_FLASH_LEN);
+}
+
+/**
+ * Seconds from an arbitrary start, for timing benchmarks.
+ */
+double hostNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+DWORD tickGet(void)
+{
+    if (hostRealTime)
+        return (DWORD)(hostNow() * 62500);
+    return hostTicks;
+}
+
+void hostReset(void)
+{
+    hostResets++;
+}
+
+/**
+ * Carry out the EEPROM or flash operation started by setting RD or WR, as 
+ * the hardware would have by the time the register is next looked at.
+ */
+volatile HostSfrBits *hostEecon1(void)
+{
+    BYTE    *row;
+    WORD    eeAddr = ((EEADRH << 8) | EEADR) & (HOST_EEPROM_LEN - 1);
+    int     i;
+
+    if (eecon1.RD)
+    {
+        EEDATA = hostEeprom[eeAddr];
+        eecon1.RD = 0;
+    }
+    if (eecon1.WR)
+    {
+        if (eecon1.WREN && !eecon1.EEPGD)
+            hostEeprom[eeAddr] = EEDATA;
+        else if (eecon1.WREN)
+        {
+            row = hostFlashPtr(TBLPTR & ~63);
+            if (eecon1.FREE)
+            {
+                memset(row, 0xFF, 64);
+                hostFlashRowErases++;
+            }
+            else
+            {
+                for (i=0; i<64; i++)
+                    row[i] &= tableLatches[i];      // Programming only clears bits
+                memset(tableLatches, 0xFF, sizeof(tableLatches));
+                hostFlashRowWrites++;
+            }
+        }
+        eecon1.WR = 0;
+        EEIF = 1;
+    }
+    return &eecon1;
+}
+
+/**
+ * The inline assembler instructions used by the library.
+ */
+void hostAsm(const char *insn)
+{
+    hostEecon1();
+    if (strcmp(insn, "TBLRD*+") == 0)
+    {
+        TABLAT = *hostFlashPtr(TBLPTR++);
+        hostFlashTableReads++;
+    }
+    else if (strcmp(insn, "TBLWT*+") == 0)
+        tableLatches[TBLPTR++ & 63] = TABLAT;
+    else if (strcmp(insn, "NOP") != 0)
+    {
+        fprintf(stderr, "hostAsm: %s not emulated\n", insn);
+        abort();
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * Emulated PIC18 for the host tests: program memory, EEPROM, the tick 
+ * timer and a UART backed by a pseudo terminal.
+ */
+#ifndef HOSTPIC_H
+#define HOSTPIC_H
+
+#include "GenericTypeDefs.h"
+
+// Program memory is mapped here so that the library's flash addresses are the 
+// low 16 bits of the host pointers to the tables it keeps in flash
+#define HOST_FLASH          0x10000000UL
+#define HOST_FLASH_LEN      0x10000
+#define HOST_EEPROM_LEN     1024
+
+#define hostFlashPtr(addr)  ((BYTE *)(HOST_FLASH + (WORD)(addr)))
+
+extern BYTE     hostEeprom[HOST_EEPROM_LEN];
+extern DWORD    hostFlashRowErases;         // 64 byte rows erased
+extern DWORD    hostFlashRowWrites;         // 64 byte rows programmed
+extern DWORD    hostFlashTableReads;        // Bytes read from program memory by TBLRD
+extern DWORD    hostTicks;                  // Returned by tickGet() unless hostRealTime
+extern BOOL     hostRealTime;               // tickGet() follows the host's clock, 16us per tick
+extern WORD     hostResets;
+
+void    hostFlashClear(void);
+double  hostNow(void);
+
+// UART, see hostuart.c
+
+int     hostUartOpen(void);
+void    hostUartPoll(void);
+void    hostUartReceive(int count);
+void    hostUartFramingError(void);
+void    hostUartOverrun(BYTE lost);
+void    hostUartDrop(void);
+extern DWORD hostUartIsrCalls;
+extern double hostUartIsrTime;
+
+// TCP, see hosttcp.c
+
+extern WORD  hostTcpPutSpace;
+extern DWORD hostTcpSegments;
+extern WORD  hostTcpLastSegment;
+
+// Check helpers for the tests
+
+extern int hostFailures;
+
+#define CHECK(cond) do { if (!(cond)) { hostFailures++; \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * The MLA TCP server socket calls used by cbustcp.c, on a BSD socket 
+ * listening on the loopback interface. Data put with TCPPutArray is held 
+ * until TCPFlush, which sends it with one send() so each flush is a segment.
+ * Anything the socket won't take stays in the FIFO, reducing TCPIsPutReady,
+ * until the next flush.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "hostpic.h"
+#include "TCPIP Stack/TCPIP.h"
+
+#define TX_FIFO_LEN     1024            // MLA default TX FIFO size for a generic server
+
+WORD    hostTcpPutSpace = TX_FIFO_LEN;  // Set lower to pretend the stack is short of room
+DWORD   hostTcpSegments;                // Number of TCPFlush calls which sent something
+WORD    hostTcpLastSegment;             // Length of the last one
+
+static int  listener = -1;
+static int  conn = -1;
+static BYTE txFifo[TX_FIFO_LEN];
+static WORD txLen;
+
+TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, BYTE vSocketPurpose)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+
+    if (listener >= 0)
+        close(listener);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(wPort);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, 1))
+    {
+        perror("TCPOpen");
+        return INVALID_SOCKET;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+BOOL TCPIsConnected(TCP_SOCKET hTCP)
+{
+    BYTE c;
+    int one = 1;
+    ssize_t n;
+
+    if (conn < 0)
+    {
+        conn = accept(listener, NULL, NULL);
+        if (conn < 0)
+            return FALSE;
+        fcntl(conn, F_SETFL, O_NONBLOCK);
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        txLen = 0;
+    }
+    n = recv(conn, &c, 1, MSG_PEEK);
+    if ((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        close(conn);                    // Far end has gone, listen for the next
+        conn = -1;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+WORD TCPIsPutReady(TCP_SOCKET hTCP)
+{
+    WORD space;
+
+    TCPFlush(hTCP);
+    space = TX_FIFO_LEN - txLen;
+    return (space < hostTcpPutSpace) ? space : hostTcpPutSpace;
+}
+
+WORD TCPPutArray(TCP_SOCKET hTCP, BYTE *Data, WORD Len)
+{
+    if (Len > TCPIsPutReady(hTCP))
+        Len = TCPIsPutReady(hTCP);
+    memcpy(txFifo + txLen, Data, Len);
+    txLen += Len;
+    return Len;
+}
+
+void TCPFlush(TCP_SOCKET hTCP)
+{
+    ssize_t n;
+
+    if ((conn < 0) || (txLen == 0))
+        return;
+    n = send(conn, txFifo, txLen, MSG_NOSIGNAL);
+    if (n <= 0)
+        return;
+    hostTcpSegments++;
+    hostTcpLastSegment = n;
+    txLen -= n;
+    memmove(txFifo, txFifo + n, txLen);
+}
+
+WORD TCPIsGetReady(TCP_SOCKET hTCP)
+{
+    int avail = 0;
+
+    if ((conn < 0) || ioctl(conn, FIONREAD, &avail))
+        return 0;
+    return (avail > 0xFFFF) ? 0xFFFF : avail;
+}
+
+WORD TCPGetArray(TCP_SOCKET hTCP, BYTE *buffer, WORD count)
+{
+    ssize_t n;
+
+    if (conn < 0)
+        return 0;
+    n = recv(conn, buffer, count, 0);
+    return (n < 0) ? 0 : n;
+}
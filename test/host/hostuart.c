@@ -0,0 +1,197 @@
+/*
+ * Emulated UART for the host tests. The line is a pseudo terminal: the test
+ * is the far end on the master side, reading and writing GridConnect text, 
+ * and the slave side feeds the PIC's two byte receive FIFO and takes bytes 
+ * written to TXREG1. Line faults are injected on the next bytes to arrive.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "xc.h"
+#include "hostpic.h"
+
+void uartInterruptHandler(void);
+
+#define FAULT_NONE      0
+#define FAULT_FERR      1
+#define FAULT_OERR      2
+#define FAULT_DROP      3
+
+DWORD   hostUartIsrCalls;
+double  hostUartIsrTime;                // Seconds spent in uartInterruptHandler
+
+static int  line = -1;                  // Slave side of the pty
+static BYTE fifo[2];                    // Hardware receive FIFO
+static BYTE fifoErr[2];                 // Framing error flag for each byte
+static BYTE fifoLen;
+static BYTE fault;
+static BYTE faultBytes;                 // Still to lose for an overrun
+static BYTE rcreg;
+static BYTE txreg;
+static BOOL txWritten;
+
+static void setFlags(void)
+{
+    PIR1bits.RC1IF = fifoLen != 0;
+    RCSTA1bits.FERR = fifoLen && fifoErr[0];
+    PIR1bits.TX1IF = 1;                 // Transmit shift register is always ready
+}
+
+/**
+ * Open the pseudo terminal for the line.
+ * @return the master file descriptor for the far end of the line
+ */
+int hostUartOpen(void)
+{
+    struct termios tio;
+    int far;
+
+    far = posix_openpt(O_RDWR | O_NOCTTY);
+    if (far < 0 || grantpt(far) || unlockpt(far) 
+            || (line = open(ptsname(far), O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0)
+    {
+        perror("opening pty");
+        exit(2);
+    }
+    tcgetattr(line, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(line, TCSANOW, &tio);
+    tcgetattr(far, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(far, TCSANOW, &tio);
+    fifoLen = 0;
+    setFlags();
+    return far;
+}
+
+void hostUartFramingError(void)
+{
+    fault = FAULT_FERR;
+}
+
+/**
+ * The next bytes are lost because the receive FIFO was full.
+ * @param lost number of bytes lost
+ */
+void hostUartOverrun(BYTE lost)
+{
+    fault = FAULT_OERR;
+    faultBytes = lost;
+}
+
+void hostUartDrop(void)
+{
+    fault = FAULT_DROP;
+}
+
+volatile uint8_t *hostUartRcreg(void)
+{
+    rcreg = fifo[0];
+    if (fifoLen)
+    {
+        fifo[0] = fifo[1];
+        fifoErr[0] = fifoErr[1];
+        fifoLen--;
+    }
+    setFlags();
+    return &rcreg;
+}
+
+volatile uint8_t *hostUartTxreg(void)
+{
+    txWritten = TRUE;
+    return &txreg;
+}
+
+static void interrupt(void)
+{
+    double start = hostNow();
+
+    uartInterruptHandler();
+    hostUartIsrTime += hostNow() - start;
+    hostUartIsrCalls++;
+    RCSTA1bits.OERR = 0;                // uartInterruptHandler has toggled CREN
+    if (txWritten)
+    {
+        txWritten = FALSE;
+        if (write(line, &txreg, 1) != 1)
+        {
+            perror("uart tx");
+            exit(2);
+        }
+    }
+}
+
+/**
+ * A byte arrives on the line, perhaps with the fault injected for it.
+ */
+static void arrive(BYTE c)
+{
+    switch (fault)
+    {
+    case FAULT_DROP:
+        fault = FAULT_NONE;
+        return;
+    case FAULT_OERR:
+        if (--faultBytes)
+            return;
+        RCSTA1bits.OERR = 1;                // FIFO was full so the bytes were lost
+        break;
+    case FAULT_FERR:
+        fifo[fifoLen] = c ^ 0x01;           // Likely to be received as another valid character
+        fifoErr[fifoLen] = TRUE;
+        fifoLen++;
+        break;
+    default:
+        fifo[fifoLen] = c;
+        fifoErr[fifoLen] = FALSE;
+        fifoLen++;
+    }
+    fault = FAULT_NONE;
+    setFlags();
+    interrupt();
+}
+
+/**
+ * Run the UART: pass whatever has arrived on the line to the receive FIFO, 
+ * calling the interrupt handler for each byte as the PIC would, then let the 
+ * handler send until its transmit ring is empty.
+ */
+void hostUartPoll(void)
+{
+    BYTE c;
+
+    while (read(line, &c, 1) == 1)
+        arrive(c);
+    setFlags();
+    while (PIE1bits.TX1IE)
+        interrupt();
+}
+
+/**
+ * Wait for bytes written by the far end, running the UART as they arrive.
+ * @param count number of bytes to wait for
+ */
+void hostUartReceive(int count)
+{
+    struct pollfd pfd = { line, POLLIN, 0 };
+    BYTE c;
+
+    while ((count > 0) && (poll(&pfd, 1, 1000) == 1))
+    {
+        if (read(line, &c, 1) == 1)
+        {
+            arrive(c);
+            count--;
+        }
+    }
+    if (count)
+    {
+        fprintf(stderr, "hostUartReceive: %d bytes missing\n", count);
+        exit(2);
+    }
+}
@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for the application's hwsettings.h.
+ */
+#ifndef __HWSETTINGS_H_
+#define __HWSETTINGS_H_
+
+#include "GenericTypeDefs.h"
+
+#define CAN_INTERRUPT_PRIORITY  0
+#define FLiM_SW                 hostFlimSw      // released
+#define setclkMHz()             (clkMHz = 16)
+
+extern BYTE hostFlimSw;
+
+#define LED_ON          1
+#define LED_OFF         0
+#define LED1Y           hostLeds[0]
+#define LED2G           hostLeds[1]
+#define TRIS_LED1Y      hostLeds[2]
+#define TRIS_LED2G      hostLeds[3]
+
+extern BYTE hostLeds[4];
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Host stand-in for the application's module.h. The feature defines for each
+ * test are given on the compiler command line in test/Makefile.
+ */
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "GenericTypeDefs.h"
+#include "hostpic.h"
+
+#define rom
+#define near
+#define far
+#define overlay
+
+#ifndef NUM_EVENTS
+#define NUM_EVENTS          255
+#endif
+#ifndef EVENT_TABLE_WIDTH
+#define EVENT_TABLE_WIDTH   10
+#endif
+#define EVperEVT            20
+#define HASH_LENGTH         32
+#define CHAIN_LENGTH        20
+#define NUM_HAPPENINGS      64
+#define HAPPENING_BASE      1
+#define HAPPENING_T         BYTE
+#define ACTION_T            BYTE
+
+#define NV_NUM              16
+typedef struct
+{
+    BYTE nv[NV_NUM];
+} ModuleNvDefs;
+
+// Persistent areas, in the emulated program memory
+
+#define AT_EVENTS           (HOST_FLASH + 0x6000)
+#define AT_KEY_INDEX        (HOST_FLASH + 0x7000)
+#define AT_EVENT_MPH        (HOST_FLASH + 0x7000)
+#define AT_EVENT_RANGES     (HOST_FLASH + 0x7400)
+#define AT_NV               (HOST_FLASH + 0x7F80)
+#define MIN_WRITEABLE_FLASH 0x6000
+#define MAX_WRITEABLE_FLASH 0x7FFF
+
+#include "EEPROM.h"
+
+#endif
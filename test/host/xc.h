@@ -0,0 +1,69 @@
+/*
+ * Host stand-in for the XC8 device header, used when building library 
+ * modules with gcc for the tests in test/.
+ * 
+ * Special function registers are plain variables defined in hostpic.c. The 
+ * ones with side effects are routed through hostpic.c and hostuart.c:
+ *  - TBLRD and TBLWT work on an emulated 64K of program memory at HOST_FLASH, 
+ *    and setting EECON1bits.WR erases or programs it, or writes the EEPROM.
+ *  - Reading RCREG1 takes the next received byte from the emulated UART and 
+ *    writing TXREG1 sends a byte.
+ */
+#ifndef HOST_XC_H
+#define HOST_XC_H
+
+#include <stdint.h>
+
+// All bit registers share one layout, only the bits the library uses are named
+
+typedef struct
+{
+    unsigned EEPGD:1, CFGS:1, FREE:1, WREN:1, WR:1, RD:1;
+    unsigned GIE:1, GIEH:1, GIEL:1, TMR0IF:1, TMR0IE:1, TMR0IP:1, TMR0ON:1;
+    unsigned RCIF:1, TXIF:1, RCIE:1, TXIE:1, RC1IF:1, TX1IF:1, RC1IE:1, TX1IE:1;
+    unsigned SPEN:1, CREN:1, FERR:1, OERR:1, TXEN:1, BRGH:1, BRG16:1, TRMT:1;
+    unsigned EEIF:1;
+} HostSfrBits;
+
+#define HOST_SFR(name)  extern volatile uint8_t name;
+
+HOST_SFR(EECON1) HOST_SFR(EECON2) HOST_SFR(EEADR) HOST_SFR(EEADRH) HOST_SFR(EEDATA)
+HOST_SFR(TABLAT) HOST_SFR(TBLPTRU)
+HOST_SFR(TXSTA1) HOST_SFR(RCSTA1) HOST_SFR(BAUDCON1) HOST_SFR(SPBRG1) HOST_SFR(SPBRGH1)
+HOST_SFR(TXSTA) HOST_SFR(RCSTA) HOST_SFR(BAUDCON) HOST_SFR(SPBRG) HOST_SFR(SPBRGH)
+HOST_SFR(T0CON) HOST_SFR(TMR0L) HOST_SFR(TMR0H)
+
+extern volatile uint16_t TBLPTR;
+extern volatile uint16_t FSR0;
+
+// Device id from the configuration area, placed at 0x3FFFFE on the PIC
+extern const uint16_t devId;
+
+extern volatile HostSfrBits INTCONbits, INTCON2bits, T0CONbits, PIR1bits, PIE1bits, PIR4bits;
+extern volatile HostSfrBits RCSTA1bits, TXSTA1bits, RCSTAbits, TXSTAbits;
+
+// Completes a started EEPROM or flash operation before returning the register
+extern volatile HostSfrBits *hostEecon1(void);
+#define EECON1bits      (*hostEecon1())
+#define EEIF            PIR4bits.EEIF
+
+extern volatile uint8_t *hostUartRcreg(void);
+extern volatile uint8_t *hostUartTxreg(void);
+#define RCREG1          (*hostUartRcreg())
+#define TXREG1          (*hostUartTxreg())
+#define RCREG           RCREG1
+#define TXREG           TXREG1
+
+extern void hostAsm(const char *insn);
+#define asm(insn)       hostAsm(insn)
+
+#define di()            (INTCONbits.GIE = 0)
+#define ei()            (INTCONbits.GIE = 1)
+#define geti()          (INTCONbits.GIE)
+#define Nop()
+#define Reset()         hostReset()
+#define CLRWDT()
+
+extern void hostReset(void);
+
+#endif
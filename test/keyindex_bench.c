@@ -0,0 +1,91 @@
+/*
+ * Benchmark of event lookup with the flash key index against the linear scan
+ * of the event table, with 32, 128 and 255 events learnt. The table and the
+ * index are in emulated flash and read through romops.c, so the counts of 
+ * readFlashBlock() calls and of 64 byte flash blocks loaded into the buffer 
+ * are the same as on the PIC. Host times are given for comparison only.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module.h"
+#include "cbus.h"
+#include "romops.h"
+#include "FliM.h"
+#include "events.h"
+#include "keyindex.h"
+
+#define LOOKUPS     4096                // Lookups of each kind at each size
+
+// Normally provided by FliM.c and the application
+
+WORD nodeID = 256;
+
+BYTE *cbusMakeMsgNN(BYTE *msg, BYTE opc, WORD nn, BYTE *data) { return msg; }
+BOOL cbusSendMsg(BYTE cbusNum, BYTE *msg) { return TRUE; }
+BYTE cbusSendBatch(BYTE cbusNum, CanPacket *msgs, BYTE count) { return count; }
+void doError(BYTE code) { }
+void processEvent(EVENT_INDEX_T action, BYTE *msg) { }
+
+// Internal to events.c, kept for when no index is configured
+EVENT_INDEX_T findEventLinear(WORD nodeNumber, WORD eventNumber);
+
+// Every readFlashBlock() call from events.c and keyindex.c is counted
+
+static DWORD flashReads;
+
+BYTE __real_readFlashBlock(WORD flashAddr);
+
+BYTE __wrap_readFlashBlock(WORD flashAddr)
+{
+    flashReads++;
+    return __real_readFlashBlock(flashAddr);
+}
+
+static WORD learntNN[NUM_EVENTS], learntEN[NUM_EVENTS];
+
+static void measure(const char *name, int count, EVENT_INDEX_T (*find)(WORD, WORD), BOOL hits)
+{
+    DWORD   reads = flashReads;
+    DWORD   loads = hostFlashTableReads;
+    double  start = hostNow();
+    int     i, n;
+
+    for (i=0; i<LOOKUPS; i++)
+    {
+        n = i % count;
+        if (hits)
+            CHECK(find(learntNN[n], learntEN[n]) != NO_INDEX);
+        else
+            CHECK(find(learntNN[n], learntEN[n] ^ 0x8000) == NO_INDEX);
+    }
+    printf("%3d events %-22s %7.1f flash reads %6.2f blocks loaded %7.1f ns\n", count, name,
+            (double)(flashReads - reads) / LOOKUPS, 
+            (double)(hostFlashTableReads - loads) / 64 / LOOKUPS,
+            (hostNow() - start) * 1e9 / LOOKUPS);
+}
+
+int main(void)
+{
+    static const int sizes[] = { 32, 128, 255 };
+    int     s, i;
+
+    initRomOps();
+    srand(41);
+    for (s=0; s<3; s++)
+    {
+        clearAllEvents();
+        eventsInit();
+        for (i=0; i<sizes[s]; i++)
+        {
+            learntNN[i] = 1 + rand() % 1000;
+            learntEN[i] = rand() & 0x7FFF;
+            CHECK(addEvent(learntNN[i], learntEN[i], 1, 1, FALSE) == 0);
+        }
+        measure("key index, hit", sizes[s], findEvent, TRUE);
+        measure("key index, miss", sizes[s], findEvent, FALSE);
+        measure("linear scan, hit", sizes[s], findEventLinear, TRUE);
+        measure("linear scan, miss", sizes[s], findEventLinear, FALSE);
+    }
+    return hostFailures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Throughput of CBUS over TCP through the loopback interface, in frames 
+ * per second each way. A client thread on the other end of the connection
+ * decodes what the node sends, or sends GridConnect text as fast as the node
+ * will take it. The tick timer runs in real time so TCP_FLUSH_TIME applies.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "hostpic.h"
+#include "cbus.h"
+#include "cbustcp.h"
+#include "gridconnect.h"
+
+#define FRAMES      200000
+
+BYTE        canID = 5;
+
+static int              client;
+static volatile DWORD   clientFrames;
+
+static void *clientReader(void *arg)
+{
+    GcDecoder   dec;
+    CanPacket   pkts[64];
+    BYTE        text[4096];
+    WORD        used, pos;
+    int         n, got;
+
+    gcDecoderInit(&dec);
+    while (clientFrames < FRAMES)
+    {
+        n = recv(client, text, sizeof(text), 0);
+        if (n <= 0)
+            break;
+        for (pos=0; pos<n; pos+=used)
+        {
+            got = gcDecodeFrames(&dec, text + pos, n - pos, pkts, 64, &used);
+            clientFrames += got;
+            if (got < 64)
+                pkts[0] = pkts[got];    // Carry on with a part decoded frame
+        }
+    }
+    return NULL;
+}
+
+static void *clientWriter(void *arg)
+{
+    CanPacket   pkt;
+    BYTE        text[4096];
+    WORD        len;
+    int         i;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.buffer[sidh] = 0xB0;
+    pkt.buffer[sidl] = 0x20;
+    pkt.buffer[dlc] = 5;
+    pkt.buffer[d0] = OPC_ACON;
+    for (i=0; i<FRAMES; )
+    {
+        for (len=0; (len < sizeof(text) - GC_MAX_FRAME_LEN) && (i < FRAMES); i++)
+        {
+            pkt.buffer[d4] = i;
+            len += gcEncodeFrame(text + len, &pkt);
+        }
+        if (send(client, text, len, 0) != len)
+            break;
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    struct sockaddr_in addr;
+    pthread_t   thread;
+    CanPacket   pkt;
+    BYTE        msg[sizeof(CanPacket)];
+    DWORD       sent = 0, received = 0;
+    double      start, secs;
+
+    hostRealTime = TRUE;
+    tcpInit();
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(CBUS_TCP_PORT);
+    if (connect(client, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        perror("connect");
+        return 2;
+    }
+    while (tcpTxFree() == 0xFF)
+        ;
+
+    // Node to client
+
+    pthread_create(&thread, NULL, clientReader, NULL);
+    memset(msg, 0, sizeof(msg));
+    msg[d0] = OPC_ACON;
+    start = hostNow();
+    while (sent < FRAMES)
+    {
+        while ((sent < FRAMES) && tcpTxFree())
+        {
+            msg[d4] = sent;
+            if (tcpSend(msg, 5))
+                sent++;
+        }
+        tcpRecv(&pkt);
+    }
+    while (clientFrames < FRAMES)
+        tcpRecv(&pkt);                  // Idle so the last batch is flushed
+    secs = hostNow() - start;
+    pthread_join(thread, NULL);
+    printf("send:    %8.0f frames/s, %.1f frames per segment\n", FRAMES / secs, 
+            (double)FRAMES / hostTcpSegments);
+
+    // Client to node
+
+    pthread_create(&thread, NULL, clientWriter, NULL);
+    start = hostNow();
+    while (received < FRAMES)
+        if (tcpRecv(&pkt))
+            received++;
+    secs = hostNow() - start;
+    pthread_join(thread, NULL);
+    printf("receive: %8.0f frames/s, %u decode errors\n", FRAMES / secs, tcpDecoder.errors);
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * CBUS over TCP against a client on the loopback interface, with the MLA 
+ * socket calls provided by host/hosttcp.c and the tick timer under the 
+ * test's control. Covers batching up to TCP_TX_BATCH_LEN, the flush after
+ * TCP_FLUSH_TIME and when idle, reception of frames split across segments,
+ * and behaviour with no connection.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "hostpic.h"
+#include "cbus.h"
+#include "cbustcp.h"
+#include "gridconnect.h"
+
+BYTE        canID = 5;
+
+static int  client = -1;
+static BYTE msg[sizeof(CanPacket)];
+
+static void makeMsg(BYTE seq)
+{
+    memset(msg, 0, sizeof(msg));
+    msg[d0] = OPC_ACON;
+    msg[d1] = 0x01;
+    msg[d2] = 0x02;
+    msg[d3] = 0x03;
+    msg[d4] = seq;
+}
+
+static void connectClient(void)
+{
+    struct sockaddr_in addr;
+    int i;
+
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(CBUS_TCP_PORT);
+    if (connect(client, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        perror("connect");
+        exit(2);
+    }
+    for (i=0; (i<1000) && (tcpTxFree() == 0xFF); i++)
+        usleep(1000);
+    CHECK(tcpTxFree() != 0xFF);
+}
+
+/**
+ * Read frames sent by the node.
+ * @param pkts where to put them
+ * @param count number expected
+ * @return number received before a timeout
+ */
+static int clientRecv(CanPacket *pkts, int count)
+{
+    static GcDecoder dec;
+    struct pollfd pfd = { client, POLLIN, 0 };
+    BYTE text[512];
+    WORD used;
+    int got = 0, n;
+
+    gcDecoderInit(&dec);
+    while ((got < count) && (poll(&pfd, 1, 1000) == 1))
+    {
+        n = recv(client, text, (count - got) * 18 < sizeof(text) ? (count - got) * 18 : sizeof(text), 0);
+        if (n <= 0)
+            break;
+        got += gcDecodeFrames(&dec, text, n, pkts + got, count - got, &used);
+        CHECK(used == n);
+    }
+    return got;
+}
+
+static BOOL nothingToRead(void)
+{
+    struct pollfd pfd = { client, POLLIN, 0 };
+
+    return poll(&pfd, 1, 20) == 0;
+}
+
+static void testDisconnected(void)
+{
+    CanPacket pkt;
+
+    tcpInit();
+    CHECK(tcpTxFree() == 0xFF);
+    makeMsg(0);
+    CHECK(tcpSend(msg, 5));             // Accepted and thrown away
+    CHECK(!tcpRecv(&pkt));
+    CHECK(hostTcpSegments == 0);
+}
+
+/**
+ * Frames sent without polling go out as one segment of as much of 
+ * TCP_TX_BATCH_LEN as whole frames fill, once the next would not fit.
+ */
+static void testBatch(void)
+{
+    CanPacket   pkts[16];
+    DWORD       segments = hostTcpSegments;
+    int         frames, i;
+
+    for (frames=0; hostTcpSegments == segments; frames++)
+    {
+        CHECK(frames < 16 && tcpTxFree() > 0);
+        makeMsg(frames);
+        CHECK(tcpSend(msg, 5));
+    }
+    frames--;                           // The last one is waiting in the next batch
+    CHECK(hostTcpSegments == segments + 1);
+    CHECK(hostTcpLastSegment <= TCP_TX_BATCH_LEN);
+    CHECK(hostTcpLastSegment > TCP_TX_BATCH_LEN - GC_MAX_FRAME_LEN);
+    CHECK(clientRecv(pkts, frames) == frames);
+    for (i=0; i<frames; i++)
+        CHECK(pkts[i].buffer[dlc] == 5 && pkts[i].buffer[d4] == i);
+    printf("batch: %d frames in a %u byte segment\n", frames, hostTcpLastSegment);
+
+    // The stack has no room, so the batch is held and sending refused
+    hostTcpPutSpace = 0;
+    while (tcpTxFree() > 0)
+        CHECK(tcpSend(msg, 5));
+    CHECK(!tcpSend(msg, 5));
+    hostTcpPutSpace = 1024;
+    CHECK(tcpTxFree() > 0);
+    clientRecv(pkts, 16);
+}
+
+/**
+ * Whilst frames keep being added the batch is sent once the first has 
+ * waited TCP_FLUSH_TIME.
+ */
+static void testFlushTime(void)
+{
+    CanPacket   pkts[4];
+    DWORD       segments = hostTcpSegments;
+
+    hostTicks = 1000;
+    makeMsg(1);
+    tcpSend(msg, 5);
+    tcpRecv(&pkts[0]);
+    CHECK(hostTcpSegments == segments);
+    hostTicks += TCP_FLUSH_TIME - 1;
+    makeMsg(2);
+    tcpSend(msg, 5);
+    tcpRecv(&pkts[0]);
+    CHECK(hostTcpSegments == segments);
+    CHECK(nothingToRead());
+    hostTicks += 2;
+    makeMsg(3);
+    tcpSend(msg, 5);
+    tcpRecv(&pkts[0]);
+    CHECK(hostTcpSegments == segments + 1);
+    CHECK(clientRecv(pkts, 3) == 3);
+    CHECK(pkts[2].buffer[d4] == 3);
+}
+
+/**
+ * A batch is sent as soon as a poll finds nothing has been added since the 
+ * last poll.
+ */
+static void testIdleFlush(void)
+{
+    CanPacket   pkts[1];
+    DWORD       segments = hostTcpSegments;
+
+    makeMsg(4);
+    tcpSend(msg, 5);
+    tcpRecv(&pkts[0]);
+    CHECK(hostTcpSegments == segments);
+    tcpRecv(&pkts[0]);
+    CHECK(hostTcpSegments == segments + 1);
+    CHECK(clientRecv(pkts, 1) == 1 && pkts[0].buffer[d4] == 4);
+}
+
+static CanPacket    rxSent[200];
+static int          rxGot;
+
+static void takeReceived(void)
+{
+    CanPacket pkt;
+
+    while (tcpRecv(&pkt))
+    {
+        CHECK(rxGot < 200 && memcmp(pkt.buffer + sidh, rxSent[rxGot].buffer + sidh, 2) == 0);
+        CHECK(pkt.buffer[dlc] == rxSent[rxGot].buffer[dlc] && pkt.buffer[d0] == rxSent[rxGot].buffer[d0]);
+        rxGot++;
+    }
+}
+
+/**
+ * Frames written by the client in random pieces, with ones which aren't CBUS
+ * messages and a malformed one amongst them, are received in order.
+ */
+static void testReceive(void)
+{
+    BYTE        text[200 * GC_MAX_FRAME_LEN];
+    WORD        len = 0, pos, n;
+    int         i, tries;
+
+    for (i=0; i<200; i++)
+    {
+        memset(&rxSent[i], 0, sizeof(CanPacket));
+        rxSent[i].buffer[sidh] = 0xB0;
+        rxSent[i].buffer[sidl] = 0x20;
+        rxSent[i].buffer[dlc] = 1 + i % 8;
+        rxSent[i].buffer[d0] = i;
+        len += gcEncodeFrame(text + len, &rxSent[i]);
+        if (i % 20 == 0)
+        {
+            memcpy(text + len, ":X00080004N01;:SB020R;:SB020N;:SB020N901;", 42);
+            len += 42;
+        }
+    }
+    for (pos=0; pos<len; pos+=n)
+    {
+        n = 1 + rand() % 100;
+        if (n > len - pos)
+            n = len - pos;
+        CHECK(send(client, text + pos, n, 0) == n);
+        takeReceived();
+    }
+    for (tries=0; (rxGot < 200) && (tries < 1000); tries++)
+    {
+        usleep(1000);
+        takeReceived();
+    }
+    CHECK(rxGot == 200);
+    CHECK(tcpRxFrames == 200);
+}
+
+/**
+ * Once the client has gone frames are discarded and tcpTxFree() says any 
+ * number can be sent.
+ */
+static void testDisconnect(void)
+{
+    int i;
+
+    makeMsg(5);
+    tcpSend(msg, 5);
+    close(client);
+    for (i=0; (i<1000) && (tcpTxFree() != 0xFF); i++)
+        usleep(1000);
+    CHECK(tcpTxFree() == 0xFF);
+    CHECK(tcpSend(msg, 5));
+    for (i=0; i<50; i++)
+        CHECK(tcpSend(msg, 5));
+    CHECK(tcpTxFree() == 0xFF);
+}
+
+int main(void)
+{
+    srand(26);
+    testDisconnected();
+    connectClient();
+    testBatch();
+    testFlushTime();
+    testIdleFlush();
+    testReceive();
+    testDisconnect();
+    connectClient();                    // The next connection works too
+    testIdleFlush();
+    printf("%s\n", hostFailures ? "FAILED" : "PASSED");
+    return hostFailures != 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * CBUS over UART on the host, through an emulated UART whose line is a 
+ * pseudo terminal: the interrupt handler, both ring buffers and the 
+ * GridConnect decoder as built for the PIC.
+ * 
+ * A framing error, a silently dropped byte or an overrun is injected at 
+ * every byte of a run of frames in turn. Each time only the frame the fault
+ * hit may be lost, or for an overrun losing several bytes the frames those 
+ * bytes were in, and no damaged frame may be delivered.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hostpic.h"
+#include "cbus.h"
+#include "cbusuart.h"
+#include "gridconnect.h"
+
+#define FRAMES      3
+#define RUNS        20
+
+#define FAULT_FERR  0
+#define FAULT_OERR  1
+#define FAULT_DROP  2
+
+BYTE        canID = 5;
+
+static int          far;                        // Our end of the line
+static CanPacket    frames[FRAMES];
+static BYTE         text[FRAMES * GC_MAX_FRAME_LEN];
+static int          frameEnd[FRAMES];           // Offset in text after each frame
+static int          textLen;
+static CanPacket    received[FRAMES * 2];
+static int          receivedCount;
+
+static void makeFrames(void)
+{
+    int f, i;
+
+    textLen = 0;
+    for (f=0; f<FRAMES; f++)
+    {
+        BYTE *p = frames[f].buffer;
+        BYTE id = 1 + rand() % 127;
+
+        memset(p, 0, pktsize);
+        p[sidh] = 0b10110000 | (id >> 3);
+        p[sidl] = (id & 0x07) << 5;
+        p[dlc] = 1 + rand() % 8;
+        for (i=0; i<p[dlc]; i++)
+            p[d0+i] = rand();
+        textLen += gcEncodeFrame(text + textLen, &frames[f]);
+        frameEnd[f] = textLen;
+    }
+}
+
+static void lineWrite(BYTE *src, int len)
+{
+    if (write(far, src, len) != len)
+    {
+        perror("write");
+        exit(2);
+    }
+    hostUartReceive(len);
+}
+
+/**
+ * Send text down the line to the UART, taking frames from it as it goes so 
+ * that its receive ring doesn't overflow.
+ */
+static void sendLine(BYTE *src, int len)
+{
+    int chunk;
+
+    for ( ; len; src += chunk, len -= chunk)
+    {
+        chunk = len < 16 ? len : 16;
+        lineWrite(src, chunk);
+        while ((receivedCount < FRAMES * 2) && uartRecv(&received[receivedCount]))
+            receivedCount++;
+    }
+}
+
+static BOOL samePacket(CanPacket *a, CanPacket *b)
+{
+    return memcmp(a->buffer + sidh, b->buffer + sidh, 2) == 0
+        && a->buffer[dlc] == b->buffer[dlc]
+        && memcmp(a->buffer + d0, b->buffer + d0, a->buffer[dlc]) == 0;
+}
+
+/**
+ * Check the frames received are those sent, in order, except that frames 
+ * first to last may be missing.
+ */
+static void checkReceived(int first, int last)
+{
+    int i, next = 0;
+
+    for (i=0; i<receivedCount; i++)
+    {
+        while ((next >= first) && (next <= last) && (next < FRAMES)
+                && !samePacket(&received[i], &frames[next]))
+            next++;
+        CHECK(next < FRAMES && samePacket(&received[i], &frames[next]));
+        next++;
+    }
+    CHECK(next >= FRAMES || (last >= FRAMES - 1 && next >= first));
+}
+
+static int frameAt(int pos)
+{
+    int f;
+
+    for (f=0; pos>=frameEnd[f]; f++)
+        ;
+    return f;
+}
+
+/**
+ * Inject a fault at each byte of the frames in turn.
+ * @param kind FAULT_FERR, FAULT_OERR or FAULT_DROP
+ * @param burst bytes lost by an overrun
+ */
+static void testFault(BYTE kind, BYTE burst)
+{
+    int pos;
+
+    for (pos=0; pos<textLen; pos++)
+    {
+        if (burst > textLen - pos)
+            burst = textLen - pos;
+        uartInit(UART_BAUD);
+        receivedCount = 0;
+        sendLine(text, pos);
+        switch (kind)
+        {
+        case FAULT_FERR:
+            hostUartFramingError();
+            break;
+        case FAULT_OERR:
+            hostUartOverrun(burst);
+            break;
+        case FAULT_DROP:
+            hostUartDrop();
+            break;
+        }
+        sendLine(text + pos, textLen - pos);
+        checkReceived(frameAt(pos), frameAt(pos + (kind == FAULT_OERR ? burst - 1 : 0)));
+    }
+}
+
+/**
+ * Fill the receive ring without reading it. The bytes which don't fit are 
+ * lost, which may take out more than one frame, but the ones either side of
+ * the gap must not be spliced together and reception must carry on after.
+ */
+static void testRingOverflow(void)
+{
+    CanPacket   pkt;
+    int         rounds, i;
+
+    uartInit(UART_BAUD);
+    for (rounds=0; rounds<4; rounds++)
+        lineWrite(text, textLen);
+    CHECK(uartRxOflowCount > 0);
+    while (uartRecv(&pkt))
+    {
+        CHECK(samePacket(&pkt, &frames[0]) || samePacket(&pkt, &frames[1])
+                || samePacket(&pkt, &frames[2]));
+    }
+    receivedCount = 0;
+    sendLine(text, textLen);
+    CHECK(receivedCount == FRAMES);
+    for (i=0; i<receivedCount; i++)
+        CHECK(samePacket(&received[i], &frames[i]));
+}
+
+/**
+ * Frames queued with uartSend() come out of the transmit ring as GridConnect.
+ */
+static void testSend(void)
+{
+    BYTE    msg[sizeof(CanPacket)];
+    BYTE    expect[GC_MAX_FRAME_LEN + 1];
+    BYTE    got[GC_MAX_FRAME_LEN + 1];
+    int     len, n, f;
+
+    uartInit(UART_BAUD);
+    for (f=0; f<FRAMES; f++)
+    {
+        memcpy(msg, frames[f].buffer, sizeof(msg));
+        CHECK(uartSend(msg, frames[f].buffer[dlc]));
+        len = gcEncodeFrame(expect, (CanPacket *)msg);
+        hostUartPoll();
+        for (n=0; n<len; )
+        {
+            int r = read(far, got + n, len - n);
+            if (r > 0)
+                n += r;
+        }
+        CHECK(memcmp(got, expect, len) == 0);
+    }
+    CHECK(uartTxFrames == FRAMES);
+}
+
+int main(void)
+{
+    int run;
+
+    srand(36);
+    far = hostUartOpen();
+    for (run=0; run<RUNS; run++)
+    {
+        makeFrames();
+        testFault(FAULT_FERR, 0);
+        testFault(FAULT_DROP, 0);
+        testFault(FAULT_OERR, 1);
+        testFault(FAULT_OERR, 2 + rand() % 20);
+        testRingOverflow();
+        testSend();
+    }
+    printf("%d runs of %d frames with a framing error, dropped byte or overrun at each byte\n", RUNS, FRAMES);
+    printf("interrupt handler: %lu calls, %.0f ns per call\n", 
+            (unsigned long)hostUartIsrCalls, hostUartIsrTime * 1e9 / hostUartIsrCalls);
+    printf("%s\n", hostFailures ? "FAILED" : "PASSED");
+    return hostFailures != 0;
+}
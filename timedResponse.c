@@ -64,7 +64,7 @@
  */
 
 unsigned char timedResponse;
-unsigned char timedResponseStep;
+EVENT_INDEX_T timedResponseStep;
 
 extern BOOL sendProducedEvent(HAPPENING_T happening, BOOL on);
 extern unsigned char APP_doSOD(unsigned char step);
@@ -106,16 +106,17 @@ void doTimedResponse(void) {
             }
             // if its not free and not a continuation then it is start of an event
             if (validStart(timedResponseStep)) {
+                BYTE msg[CBUS_MSG_LEN];
                 WORD n = getNN(timedResponseStep);
-                cbusMsg[d3] = n >> 8;
-                cbusMsg[d4] = n & 0xFF;
+                msg[d3] = n >> 8;
+                msg[d4] = n & 0xFF;
             
                 n = getEN(timedResponseStep);
-                cbusMsg[d5] = n >> 8;
-                cbusMsg[d6] = n & 0xFF;
+                msg[d5] = n >> 8;
+                msg[d6] = n & 0xFF;
             
-                cbusMsg[d7] = tableIndexToEvtIdx(timedResponseStep); 
-                if (!cbusSendOpcMyNN( 0, OPC_ENRSP, cbusMsg )) {
+                msg[d7] = tableIndexToEvtIdx(timedResponseStep); 
+                if (!cbusSendMsg( 0, cbusMakeMsgNN(msg, OPC_ENRSP, MY_NN, NULL))) {
                     // we were unable to send the message so don't update step so that we can try again next time
                     return;
                 }
@@ -35,6 +35,8 @@
 #ifndef TIMEDRESPONSE_H
 #define	TIMEDRESPONSE_H
 
+#include "events.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -51,7 +53,7 @@ extern "C" {
 #define TIMED_RESPONSE_APP_NEXT     2
 
 extern unsigned char timedResponse;
-extern unsigned char timedResponseStep;
+extern EVENT_INDEX_T timedResponseStep;
 
 extern void initTimedResponse(void);
 extern void doTimedResponse(void);